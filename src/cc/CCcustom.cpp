@@ -479,6 +479,7 @@ struct CCcontract_info *CCinit(struct CCcontract_info *cp, uint8_t evalcode)
 			memcpy(cp->CCpriv, TokensCCpriv, 32);
 			cp->validate = TokensValidate;
 			cp->ismyvin = IsTokensInput;
+			cp->threadsafe = 1;
 			break;
         case EVAL_IMPORTGATEWAY:
 			strcpy(cp->unspendableCCaddr, ImportGatewayCCaddr);
@@ -511,6 +512,7 @@ struct CCcontract_info *CCinit(struct CCcontract_info *cp, uint8_t evalcode)
 			memcpy(cp->CCpriv, Tokensv2CCpriv, 32);
 			cp->validate = Tokensv2Validate;
 			cp->ismyvin = IsTokensv2Input;
+			cp->threadsafe = 1;
 			break;
 
 		case EVAL_BASIC1:
@@ -285,6 +285,9 @@ struct CCcontract_info
     /// @private
     uint8_t didinit;
 
+    /// set by CCinit when validate may run concurrently on the script check threads, on a private copy of this structure
+    uint8_t threadsafe;
+
 	std::vector< struct CCVintxProbe > CCvintxprobes;  //<! list of conds for signing cc vin with specific privkeys and eval codes
 
     /// @private
@@ -313,6 +316,7 @@ struct CCcontract_info
         ismyvin = NULL;
         validate = NULL;
         didinit = 0;
+        threadsafe = 0;
     }
 
 };
@@ -564,6 +568,21 @@ uint8_t DecodeTokenCreateOpRetV2(const CScript &scriptPubKey, std::vector<uint8_
 /// @returns funcid ('c' if creation tx or 't' if token transfer tx) or NULL if errors
 uint8_t DecodeTokenOpRetV2(const CScript scriptPubKey, uint256 &tokenid, std::vector<vscript_t>  &oprets);
 
+/// Decodes the tokenid of a token or token 2 transaction for the tokens index, without loading any other tx
+/// @param tx token transaction with the token opreturn in its last vout
+/// @param[out] tokenid id of token, the tx hash for a creation tx
+/// @param[out] funcid 'c' for a creation tx, 't' for a transfer tx
+/// @returns EVAL_TOKENS or EVAL_TOKENSV2 or 0 if tx is not a token tx
+uint8_t DecodeTokensIndexTx(const CTransaction &tx, uint256 &tokenid, uint8_t &funcid);
+
+/// Checks that a cc output of a tx decoded with DecodeTokensIndexTx is a real token output, as token validation sees it
+/// @param tx token transaction
+/// @param v vout number
+/// @param tokenid id of token returned by DecodeTokensIndexTx
+/// @param evalcode EVAL_TOKENS or EVAL_TOKENSV2 returned by DecodeTokensIndexTx
+/// @returns output amount or 0 for token markers and non-token cc outputs (for example assets coin outputs and markers)
+CAmount TokensIndexVoutAmount(const CTransaction &tx, int32_t v, uint256 tokenid, uint8_t evalcode);
+
 
 /// @private
 int64_t AddCClibtxfee(struct CCcontract_info *cp, CMutableTransaction &mtx, CPubKey pk);
@@ -608,7 +608,7 @@ bool TokensValidate(struct CCcontract_info *cp, Eval* eval, const CTransaction &
     if (!TokensIsVer1Active(eval))
         return tokensv0::TokensValidate(cp, eval, tx, nIn);
 
-    if (strcmp(ASSETCHAINS_SYMBOL, "ROGUE") == 0 && chainActive.Height() <= 12500)
+    if (strcmp(ASSETCHAINS_SYMBOL, "ROGUE") == 0 && eval->GetCurrentHeight() <= 12500)
         return true;
     
     // my test chains:
@@ -725,6 +725,25 @@ bool Tokensv2Validate(struct CCcontract_info *cp, Eval* eval, const CTransaction
 }
 
 
+// returns the amount of a real token vout of a tx decoded by DecodeTokensIndexTx, 
+// or 0 for markers and other cc outputs of the tx (like assets coin outputs) which must not go to the tokens index
+CAmount TokensIndexVoutAmount(const CTransaction &tx, int32_t v, uint256 tokenid, uint8_t evalcode)
+{
+    struct CCcontract_info *cp, C;
+    CAmount amount = 0;
+
+    cp = CCinit(&C, evalcode);
+    if (evalcode == EVAL_TOKENS) {
+        if (!IsTokenMarkerVout<V1>(tx.vout[v]))
+            amount = IsTokensvout<V1>(false, true, cp, NULL, tx, v, tokenid);
+    }
+    else if (evalcode == EVAL_TOKENSV2) {
+        if (!IsTokenMarkerVout<V2>(tx.vout[v]))
+            amount = IsTokensvout<V2>(false, true, cp, NULL, tx, v, tokenid);
+    }
+    return amount > 0 ? amount : 0;
+}
+
 // default old version functions:
 
 void GetNonfungibleData(uint256 tokenid, vscript_t &vopretNonfungible)
@@ -765,6 +784,20 @@ CAmount GetTokenBalance(CPubKey pk, uint256 tokenid, bool usemempool)
 }
 UniValue TokenInfo(uint256 tokenid) { return TokenInfo<V1>(tokenid); }
 
+// token list from the creation entries of the tokens index
+static bool TokenListIndex(uint8_t evalcode, UniValue &result)
+{
+    std::vector<std::pair<uint256, CTokensIndexValue> > creates;
+
+    if (!GetTokensCreate(zeroid, creates))
+        return false;
+    for (std::vector<std::pair<uint256, CTokensIndexValue> >::const_iterator it = creates.begin(); it != creates.end(); it++) {
+        if (it->second.evalcode == evalcode)
+            result.push_back(it->first.GetHex());
+    }
+    return true;
+}
+
 UniValue TokenList()
 {
 	UniValue result(UniValue::VARR);
@@ -774,6 +807,9 @@ UniValue TokenList()
 	struct CCcontract_info *cp, C; 
 	cp = CCinit(&C, EVAL_TOKENS);
 
+    if (fTokensIndex && TokenListIndex(EVAL_TOKENS, result))
+        return(result);
+
     auto addTokenId = [&](uint256 txid) {
         CTransaction vintx; 
         uint256 hashBlock;
@@ -813,6 +849,9 @@ UniValue TokenV2List()
 	struct CCcontract_info *cp, C; 
 	cp = CCinit(&C, EVAL_TOKENSV2);
 
+    if (fTokensIndex && TokenListIndex(EVAL_TOKENSV2, result))
+        return(result);
+
     auto addTokenId = [&](uint256 tokenid, const CScript &opreturn) {
         std::vector<uint8_t> origpubkey;
 	    std::string name, description;
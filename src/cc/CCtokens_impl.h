@@ -478,6 +478,35 @@ std::string CreateTokenLocal(CAmount txfee, CAmount tokensupply, std::string nam
 }
 
 
+// sums token outputs on the token cc address of pk from the tokens index, without loading the funding txns.
+// The tokens index only has outputs which IsTokensvout accepted when the tx was connected or added to the mempool, so it is not rechecked here
+template <class V>
+bool GetTokenBalanceIndex(struct CCcontract_info *cp, const CPubKey &pk, uint256 tokenid, bool usemempool, CAmount &balance)
+{
+    char tokenaddr[KOMODO_ADDRESS_BUFSIZE];
+    uint160 hashBytes;
+    int type;
+    vscript_t vopretNonfungible;
+    std::vector<std::pair<CTokensIndexKey, CTokensIndexValue> > tokenOutputs;
+
+    GetNonfungibleData<V>(tokenid, vopretNonfungible);
+    if (vopretNonfungible.size() > 0)
+        cp->evalcodeNFT = vopretNonfungible.begin()[0];  // token cc address depends on NFT evalcode
+    GetTokensCCaddress(cp, tokenaddr, pk, V::IsMixed());
+    if (!CBitcoinAddress(tokenaddr).GetIndexKey(hashBytes, type, true) || !GetTokensIndex(tokenid, hashBytes, tokenOutputs, usemempool))
+        return false;
+
+    balance = 0;
+    for (std::vector<std::pair<CTokensIndexKey, CTokensIndexValue> >::const_iterator it = tokenOutputs.begin(); it != tokenOutputs.end(); it++)
+    {
+        if (it->second.evalcode != V::EvalCode() || it->second.satoshis == 0)
+            continue;
+        if (!myIsutxo_spentinmempool(ignoretxid, ignorevin, it->first.txhash, it->first.index))
+            balance += it->second.satoshis;
+    }
+    return true;
+}
+
 template <class V>
 CAmount GetTokenBalance(CPubKey pk, uint256 tokenid, bool usemempool)
 {
@@ -507,6 +536,9 @@ CAmount GetTokenBalance(CPubKey pk, uint256 tokenid, bool usemempool)
 
 	struct CCcontract_info *cp, C;
 	cp = CCinit(&C, V::EvalCode());
+    CAmount balance;
+    if (fTokensIndex && GetTokenBalanceIndex<V>(cp, pk, tokenid, usemempool, balance))
+        return balance;
 	return(AddTokenCCInputs<V>(cp, mtx, pk, tokenid, 0, 0, usemempool));
 }
 
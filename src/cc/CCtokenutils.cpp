@@ -45,6 +45,11 @@ bool TokensIsVer1Active(const Eval *eval)
         if (GetLatestTimestamp(komodo_currentheight()) < MAY2020_NNELECTION_HARDFORK)
             isTimev1 = false;
     }
+    else if (eval->snapshot != NULL && eval->snapshot->nHeight > 0)   {
+        // connected block validation, take the tip time from the snapshot instead of chainActive
+        if (eval->snapshot->nTipTime < MAY2020_NNELECTION_HARDFORK)
+            isTimev1 = false;
+    }
     else   {
         if (GetLatestTimestamp(eval->GetCurrentHeight()) < MAY2020_NNELECTION_HARDFORK)
             isTimev1 = false;
@@ -416,6 +421,29 @@ uint8_t DecodeTokenOpRetV2(const CScript scriptPubKey, uint256 &tokenid, std::ve
     return (uint8_t)0;
 }
 
+// decodes the tokenid of a tokens v1 or v2 tx from its last vout opreturn, for a creation tx tokenid is the tx hash.
+// Returns the tokens evalcode or 0 if the tx is not a tokens tx
+uint8_t DecodeTokensIndexTx(const CTransaction &tx, uint256 &tokenid, uint8_t &funcid)
+{
+    vscript_t vopret;
+    std::vector<CPubKey> voutPubkeys;
+    std::vector<vscript_t> oprets;
+
+    funcid = 0;
+    if (tx.vout.size() == 0 || !GetOpReturnData(tx.vout.back().scriptPubKey, vopret) || vopret.size() < 2)
+        return (uint8_t)0;
+    // check evalcode before decoding so non-token cc txns do not get logged as bad token oprets
+    if (vopret[0] == EVAL_TOKENS)
+        funcid = DecodeTokenOpRetV1(tx.vout.back().scriptPubKey, tokenid, voutPubkeys, oprets);
+    else if (vopret[0] == EVAL_TOKENSV2)
+        funcid = DecodeTokenOpRetV2(tx.vout.back().scriptPubKey, tokenid, oprets);
+    if (funcid == 0)
+        return (uint8_t)0;
+    if (funcid == 'c')
+        tokenid = tx.GetHash();
+    return vopret[0];
+}
+
 
 
 
@@ -611,13 +611,10 @@ static void AddCCunspentsInMempool(std::vector<std::pair<CAddressUnspentKey, CAd
     if (address.GetIndexKey(hashBytes, type, isCC) == false)
         return;
 
-    // lock mempool
-    ENTER_CRITICAL_SECTION(mempool.cs);
-
     std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> > memOutputs;
     std::vector< std::pair<uint160, int> > addresses;
     addresses.push_back(std::make_pair(hashBytes, type));
-    mempool.getAddressIndex(addresses, memOutputs);
+    mempool.getAddressUnspent(addresses, memOutputs);  // only outputs not spent in mempool
    
     //std::cerr << __func__ << " total memOutputs.size=" << memOutputs.size() << " hashBytes=" << hashBytes.GetHex() << " addrstr=" << addrstr << std::endl;
 
@@ -657,33 +654,25 @@ static void AddCCunspentsInMempool(std::vector<std::pair<CAddressUnspentKey, CAd
     }
     */
     
-    // impl using mempool address and spent indexes
+    // impl using the mempool unspent address index
     for (std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> >::iterator mo = memOutputs.begin(); mo != memOutputs.end(); mo ++)
     {
-        uint256 dummytxid;
-        int32_t dummyvout;
-        
-        if (mo->first.spending == 0 // the entry is an output
-            && !myIsutxo_spentinmempool(dummytxid, dummyvout, mo->first.txhash, mo->first.index) && mo->first.type == type)
-        {
-            // create unspent output key value pair
-            CAddressUnspentKey key;
-            CAddressUnspentValue value;
+        // create unspent output key value pair
+        CAddressUnspentKey key;
+        CAddressUnspentValue value;
 
-            key.type = type;
-            key.hashBytes = hashBytes;
-            key.txhash = mo->first.txhash; 
-            key.index = mo->first.index; 
+        key.type = type;
+        key.hashBytes = hashBytes;
+        key.txhash = mo->first.txhash; 
+        key.index = mo->first.index; 
 
-            value.satoshis = mo->second.amount;  
-            value.blockHeight = 0;
-            // note: value.script is not set
+        value.satoshis = mo->second.amount;  
+        value.blockHeight = 0;
+        // note: value.script is not set
 
-            //std::cerr << __func__ << " adding txhash=" << mo->first.txhash.GetHex() << " index=" << mo->first.index << " amount=" << mo->second.amount << " spending=" << mo->first.spending << " mo->second.prevhash=" << mo->second.prevhash.GetHex() << " mo->second.prevout=" << mo->second.prevout << std::endl;
-            unspentOutputs.push_back(std::make_pair(key, value));
-        }
+        //std::cerr << __func__ << " adding txhash=" << mo->first.txhash.GetHex() << " index=" << mo->first.index << " amount=" << mo->second.amount << " spending=" << mo->first.spending << " mo->second.prevhash=" << mo->second.prevhash.GetHex() << " mo->second.prevout=" << mo->second.prevout << std::endl;
+        unspentOutputs.push_back(std::make_pair(key, value));
     }
-    LEAVE_CRITICAL_SECTION(mempool.cs);
 }
 
 
@@ -916,6 +905,21 @@ int64_t CCfullsupplyV2(uint256 tokenid)
     return(0);
 }
 
+// sums unspent token outputs of an address from the tokens index, no funding tx is loaded or decoded
+static bool CCtoken_balanceIndex(char *coinaddr,uint256 reftokenid,uint8_t evalcode,int64_t &sum)
+{
+    CBitcoinAddress address(coinaddr); uint160 hashBytes; int type;
+    std::vector<std::pair<CTokensIndexKey, CTokensIndexValue> > tokenOutputs;
+
+    sum = 0;
+    if ( address.GetIndexKey(hashBytes,type,true) == 0 || GetTokensIndex(reftokenid,hashBytes,tokenOutputs,false) == 0 )
+        return(false);
+    for (std::vector<std::pair<CTokensIndexKey, CTokensIndexValue> >::const_iterator it=tokenOutputs.begin(); it!=tokenOutputs.end(); it++)
+        if ( it->second.evalcode == evalcode )
+            sum += it->second.satoshis;
+    return(true);
+}
+
 // TODO: remove this func or add IsTokenVout check (in other places just AddTokenCCInputs is used instead, maybe make it to do the job here)
 int64_t CCtoken_balance(char *coinaddr,uint256 reftokenid)
 {
@@ -923,6 +927,8 @@ int64_t CCtoken_balance(char *coinaddr,uint256 reftokenid)
 	std::vector<uint8_t>  vopretExtra;
     std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
 
+    if ( fTokensIndex && CCtoken_balanceIndex(coinaddr,reftokenid,EVAL_TOKENS,sum) )
+        return(sum);
     SetCCunspents(unspentOutputs,coinaddr,true);
     for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++)
     {
@@ -947,6 +953,8 @@ int64_t CCtoken_balanceV2(char *coinaddr,uint256 reftokenid)
 	std::vector<uint8_t>  vopretExtra; std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
     struct CCcontract_info *cp,C;
 
+    if ( fTokensIndex && CCtoken_balanceIndex(coinaddr,reftokenid,EVAL_TOKENSV2,sum) )
+        return(sum);
     cp = CCinit(&C,EVAL_TOKENSV2);
     SetCCunspents(unspentOutputs,coinaddr,true);
     for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++)
@@ -1117,7 +1117,10 @@ bool ProcessCC(struct CCcontract_info *cp,Eval* eval, std::vector<uint8_t> param
     CTransaction createTx; uint256 assetid,assetid2,hashBlock; uint8_t funcid; int32_t height,i,n,from_mempool = 0; int64_t amount; std::vector<uint8_t> origpubkey;
     height = KOMODO_CONNECTING;
     if ( KOMODO_CONNECTING < 0 ) // always comes back with > 0 for final confirmation
+    {
+        eval->bypassed = true;
         return(true);
+    }
     if ( ASSETCHAINS_CC == 0 || (height & ~(1<<30)) < KOMODO_CCACTIVATE )
         return eval->Invalid("CC are disabled or not active yet");
     if ( (KOMODO_CONNECTING & (1<<30)) != 0 )
@@ -1164,7 +1167,10 @@ bool CClib_Dispatch(const CC *cond,Eval *eval,std::vector<uint8_t> paramsNull,co
     }
     height = KOMODO_CONNECTING;
     if ( KOMODO_CONNECTING < 0 ) // always comes back with > 0 for final confirmation
+    {
+        eval->bypassed = true;
         return(true);
+    }
     if ( ASSETCHAINS_CC == 0 || (height & ~(1<<30)) < KOMODO_CCACTIVATE )
         return eval->Invalid("CC are disabled or not active yet");
     if ( (KOMODO_CONNECTING & (1<<30)) != 0 )
@@ -26,6 +26,12 @@
 #include "chain.h"
 #include "core_io.h"
 #include "crosschain.h"
+#include "hash.h"
+#include "random.h"
+#include "util.h"
+
+#include <atomic>
+#include <boost/thread.hpp>
 
 bool CClib_Dispatch(const CC *cond,Eval *eval,std::vector<uint8_t> paramsNull,const CTransaction &txTo,unsigned int nIn, std::shared_ptr<CCheckCCEvalCodes> evalcodeChecker);
 char *CClib_name();
@@ -33,18 +39,148 @@ char *CClib_name();
 Eval* EVAL_TEST = 0;
 struct CCcontract_info CCinfos[0x100];
 extern pthread_mutex_t KOMODO_CC_mutex;
+extern int32_t KOMODO_CCPARALLEL;
+
+namespace {
+
+/**
+ * Valid CC eval cache, to avoid running a contract validator again for a
+ * transaction that already passed it on the same tip (once when accepted
+ * into memory pool, and again in TestBlockValidity and ConnectBlock)
+ */
+class CCEvalCache
+{
+private:
+    std::set<uint256> setValid;
+    boost::shared_mutex cs_ccevalcache;
+
+public:
+    std::atomic<int64_t> nHits, nMisses, nInserts, nEvictions;
+
+    CCEvalCache() : nHits(0), nMisses(0), nInserts(0), nEvictions(0) {}
+
+    bool Get(const uint256 &entry)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_ccevalcache);
+        if (setValid.count(entry) != 0) {
+            nHits++;
+            return true;
+        }
+        nMisses++;
+        return false;
+    }
+
+    void Set(const uint256 &entry)
+    {
+        int64_t nMaxCacheSize = GetArg("-maxccevalcachesize", 50000);
+        if (nMaxCacheSize <= 0) return;
+
+        boost::unique_lock<boost::shared_mutex> lock(cs_ccevalcache);
+
+        while (static_cast<int64_t>(setValid.size()) > nMaxCacheSize)
+        {
+            // Evict a random entry, like the signature cache does
+            std::set<uint256>::iterator it = setValid.lower_bound(GetRandHash());
+            if (it == setValid.end())
+                it = setValid.begin();
+            setValid.erase(it);
+            nEvictions++;
+        }
+        if (setValid.insert(entry).second)
+            nInserts++;
+    }
+
+    int64_t Size()
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_ccevalcache);
+        return setValid.size();
+    }
+};
+
+CCEvalCache ccEvalCache;
+
+}
+
+/*
+ * Cache entry of an eval node: the txid commits to the fulfillment, the eval
+ * code bytes tell apart several eval nodes of one input and the tip hash
+ * stands for every chain context the validators read (height, notarisations,
+ * activation times). Script flags are not part of it as Eval never sees them
+ */
+static uint256 CCEvalCacheEntry(const CC *cond, const CTransaction &tx, unsigned int nIn, const uint256 &hashTip)
+{
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << tx.GetHash() << nIn << hashTip;
+    ss.write((const char *)cond->code, cond->codeLength);
+    return ss.GetHash();
+}
+
+void GetCCEvalCacheStats(CCEvalCacheStats &stats)
+{
+    stats.nEntries = ccEvalCache.Size();
+    stats.nMaxEntries = std::max((int64_t)0, GetArg("-maxccevalcachesize", 50000));
+    stats.nHits = ccEvalCache.nHits;
+    stats.nMisses = ccEvalCache.nMisses;
+    stats.nInserts = ccEvalCache.nInserts;
+    stats.nEvictions = ccEvalCache.nEvictions;
+}
+
+/*
+ * Copy the contract info of a thread-safe validator, so ProcessCC can clear and
+ * fill it without touching the shared CCinfos entry. Must hold KOMODO_CC_mutex
+ */
+static bool CCinfoThreadSafeCopy(const CC *cond,struct CCcontract_info &C)
+{
+    struct CCcontract_info *cp; uint8_t ecode;
+    if ( cond->codeLength == 0 )
+        return false;
+    ecode = cond->code[0];
+    if ( ecode >= EVAL_FIRSTUSER && ecode <= EVAL_LASTUSER )
+        return false;
+    cp = &CCinfos[(int32_t)ecode];
+    if ( cp->didinit == 0 )
+    {
+        CCinit(cp,ecode);
+        cp->didinit = 1;
+    }
+    if ( cp->threadsafe == 0 )
+        return false;
+    C = *cp;
+    return true;
+}
 
-bool RunCCEval(const CC *cond, const CTransaction &tx, unsigned int nIn,std::shared_ptr<CCheckCCEvalCodes> evalcodeChecker)
+bool RunCCEval(const CC *cond, const CTransaction &tx, unsigned int nIn,std::shared_ptr<CCheckCCEvalCodes> evalcodeChecker,bool fCacheStore)
 {
-    EvalRef eval;
+    EvalRef eval; struct CCcontract_info C; bool out,fUnlocked = false,fCached = false; uint256 cacheEntry;
+    if ( evalcodeChecker.get() != NULL && evalcodeChecker->snapshot.IsSet() )
+        eval->snapshot = &evalcodeChecker->snapshot;
+    if ( eval->snapshot != NULL && EVAL_TEST == 0 )
+    {
+        cacheEntry = CCEvalCacheEntry(cond, tx, nIn, eval->snapshot->hashTip);
+        if ( ccEvalCache.Get(cacheEntry) )
+            return true;
+        fCached = true;
+    }
     pthread_mutex_lock(&KOMODO_CC_mutex);
-    bool out = eval->Dispatch(cond, tx, nIn, evalcodeChecker);
-    pthread_mutex_unlock(&KOMODO_CC_mutex);
+    if ( KOMODO_CCPARALLEL != 0 && eval->snapshot != NULL && CCinfoThreadSafeCopy(cond,C) != 0 )
+    {
+        // evals against a tip snapshot (connected block or mempool accept): thread-safe validators run unlocked
+        eval->ccinfo = &C;
+        fUnlocked = true;
+        pthread_mutex_unlock(&KOMODO_CC_mutex);
+    }
+    out = eval->Dispatch(cond, tx, nIn, evalcodeChecker);
+    if ( !fUnlocked )
+        pthread_mutex_unlock(&KOMODO_CC_mutex);
     if ( eval->state.IsValid() != out)
         fprintf(stderr,"out %d vs %d isValid\n",(int32_t)out,(int32_t)eval->state.IsValid());
     //assert(eval->state.IsValid() == out);
 
-    if (eval->state.IsValid()) return true;
+    if (eval->state.IsValid()) {
+        if ( out && fCached && fCacheStore && !eval->bypassed )
+            ccEvalCache.Set(cacheEntry);
+        return true;
+    }
 
     std::string lvl = eval->state.IsInvalid() ? "Invalid" : "Error!";
     fprintf(stderr, "CC Eval %s %s: %s spending tx %s\n",
@@ -98,7 +234,7 @@ bool Eval::Dispatch(const CC *cond, const CTransaction &txTo, unsigned int nIn,s
             return CClib_Dispatch(cond,this,vparams,txTo,nIn,evalcodeChecker);
         else return Invalid("mismatched -ac_cclib vs CClib_name");
     }
-    cp = &CCinfos[(int32_t)ecode];
+    cp = this->ccinfo != NULL ? this->ccinfo : &CCinfos[(int32_t)ecode];
     if ( cp->didinit == 0 )
     {
         CCinit(cp,ecode);
@@ -151,6 +287,8 @@ bool Eval::GetTxConfirmed(const uint256 &hash, CTransaction &txOut, CBlockIndex
 
 unsigned int Eval::GetCurrentHeight() const
 {
+    if ( snapshot != NULL )
+        return snapshot->nHeight;
     return chainActive.Height();
 }
 
@@ -73,6 +73,8 @@ typedef uint8_t EvalCode;
 class AppVM;
 class NotarisationData;
 class CCheckCCEvalCodes;
+struct CCEvalSnapshot;
+struct CCcontract_info;
 
 
 class Eval
@@ -81,6 +83,18 @@ public:
     CValidationState state;
     std::vector<unsigned char> evalParam;
 
+    /*
+     * Read-only chain state of the tip the tx is checked on (connected block or mempool accept),
+     * NULL elsewhere. ccinfo is a private copy of the contract info when the validator runs unlocked.
+     * bypassed is set when the contract validator was not run (KOMODO_CONNECTING unset), so the
+     * result says nothing about validity and must not go into the CC eval cache
+     */
+    const CCEvalSnapshot *snapshot;
+    struct CCcontract_info *ccinfo;
+    bool bypassed;
+
+    Eval() : snapshot(NULL), ccinfo(NULL), bypassed(false) {}
+
     bool Invalid(std::string s) { return state.Invalid(false, 0, s); }
     bool Error(std::string s) { return state.Error(s); }
     bool Valid() { return true; }
@@ -138,7 +152,16 @@ public:
 
 
 
-bool RunCCEval(const CC *cond, const CTransaction &tx, unsigned int nIn, std::shared_ptr<CCheckCCEvalCodes> evalcodeChecker);
+bool RunCCEval(const CC *cond, const CTransaction &tx, unsigned int nIn, std::shared_ptr<CCheckCCEvalCodes> evalcodeChecker, bool fCacheStore = false);
+
+/*
+ * Counters of the cache of successful CC evals (-maxccevalcachesize)
+ */
+struct CCEvalCacheStats
+{
+    int64_t nEntries, nMaxEntries, nHits, nMisses, nInserts, nEvictions;
+};
+void GetCCEvalCacheStats(CCEvalCacheStats &stats);
 
 
 /*
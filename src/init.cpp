@@ -102,6 +102,9 @@ extern uint8_t  ASSETCHAINS_PUBLIC;
 extern int32_t KOMODO_SNAPSHOT_INTERVAL;
 
 extern void komodo_init(int32_t height);
+extern void komodo_statesnapshot();
+extern void NSPV_cache_load();
+extern void NSPV_cache_save();
 
 ZCJoinSplit* pzcashParams = NULL;
 
@@ -265,6 +268,9 @@ void Shutdown()
         if (pcoinsTip != NULL) {
             FlushStateToDisk();
         }
+        komodo_statesnapshot();
+        if ( KOMODO_NSPV_SUPERLITE )
+            NSPV_cache_save();
         delete pcoinsTip;
         pcoinsTip = NULL;
         delete pcoinscatcher;
@@ -396,6 +402,8 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-mempooltxinputlimit=<n>", _("[DEPRECATED FROM OVERWINTER] Set the maximum number of transparent inputs in a transaction that the mempool will accept (default: 0 = no limit applied)"));
     strUsage += HelpMessageOpt("-par=<n>", strprintf(_("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"),
         -(int)boost::thread::hardware_concurrency(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS));
+    strUsage += HelpMessageOpt("-ccparallel", _("Run thread-safe CC validators of connected blocks on the script verification threads instead of one at a time (default: 1)"));
+    strUsage += HelpMessageOpt("-statethreads=<n>", _("Decode the komodostate file on <n> threads while it is loaded, 0 or 1 decodes it on the loading thread (default: 0)"));
 #ifndef _WIN32
     strUsage += HelpMessageOpt("-pid=<file>", strprintf(_("Specify pid file (default: %s)"), "komodod.pid"));
 #endif
@@ -406,10 +414,12 @@ std::string HelpMessage(HelpMessageMode mode)
 #if !defined(WIN32)
     strUsage += HelpMessageOpt("-sysperms", _("Create new files with system default permissions, instead of umask 077 (only effective with disabled wallet functionality)"));
 #endif
+    strUsage += HelpMessageOpt("-txcache=<n>", strprintf(_("Megabytes of decoded confirmed transactions kept in memory for contract validation lookups, 0 disables (default: %u)"), DEFAULT_TXCACHE));
     strUsage += HelpMessageOpt("-txindex", strprintf(_("Maintain a full transaction index, used by the getrawtransaction rpc call (default: %u)"), 0));
     strUsage += HelpMessageOpt("-addressindex", strprintf(_("Maintain a full address index, used to query for the balance, txids and unspent outputs for addresses (default: %u)"), DEFAULT_ADDRESSINDEX));
     strUsage += HelpMessageOpt("-timestampindex", strprintf(_("Maintain a timestamp index for block hashes, used to query blocks hashes by a range of timestamps (default: %u)"), DEFAULT_TIMESTAMPINDEX));
     strUsage += HelpMessageOpt("-spentindex", strprintf(_("Maintain a full spent index, used to query the spending txid and input index for an outpoint (default: %u)"), DEFAULT_SPENTINDEX));
+    strUsage += HelpMessageOpt("-tokensindex", strprintf(_("Maintain a tokens index by tokenid and address, used for token balances, holders and token lists (default: %u)"), DEFAULT_TOKENSINDEX));
     strUsage += HelpMessageGroup(_("Connection options:"));
     strUsage += HelpMessageOpt("-addnode=<ip>", _("Add a node to connect to and attempt to keep the connection open"));
     strUsage += HelpMessageOpt("-asmap=<file>", strprintf("Specify asn mapping used for bucketing of the peers (default: %s). Relative paths will be prefixed by the net-specific datadir location.", DEFAULT_ASMAP_FILENAME));
@@ -432,6 +442,16 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-permitbaremultisig", strprintf(_("Relay non-P2SH multisig (default: %u)"), 1));
     strUsage += HelpMessageOpt("-peerbloomfilters", strprintf(_("Support filtering of blocks and transaction with Bloom filters (default: %u)"), 1));
     strUsage += HelpMessageOpt("-nspv_msg", strprintf(_("Enable NSPV messages processing (default: %u)"), DEFAULT_NSPV_PROCESSING));
+    strUsage += HelpMessageOpt("-nspvcache=<n>", _("Size in MB of the nSPV server response cache, 0 to disable (default: 64)"));
+    strUsage += HelpMessageOpt("-nspvlitecache=<n>", _("Number of notarizations kept in the nSPV superlite caches, with 2x notarization proofs and 4x txproofs (default: 64)"));
+    strUsage += HelpMessageOpt("-nspvcachefile", _("Persist the nSPV superlite caches in nspvcache.dat across restarts (default: 0)"));
+    strUsage += HelpMessageOpt("-nspvhdrs", _("Keep the headers validated for nSPV superlite proofs in nspvhdrs.dat and extend them as notarizations arrive (default: 1)"));
+    strUsage += HelpMessageOpt("-dexvalidators=<n>", _("Number of threads that pre-validate incoming DEX packets, 0 to process them on the network thread (default: 2)"));
+    strUsage += HelpMessageOpt("-dexstore", _("Keep accepted DEX datablobs in the DEX directory so a restart reloads them instead of re-pulling from peers (default: 0)"));
+    strUsage += HelpMessageOpt("-dexrecon", _("Reconcile DEX time buckets with peers through compact set sketches instead of long shorthash pings (default: 1)"));
+    strUsage += HelpMessageOpt("-dexpowthreads=<n>", _("Number of threads that search the proof of work nonce of higher priority DEX broadcasts (default: 2)"));
+    strUsage += HelpMessageOpt("-dexrelaybps=<n>", _("Bytes per second each peer may be sent by the DEX push relay, higher priority datablobs go first, 0 is unlimited (default: 0)"));
+    strUsage += HelpMessageOpt("-dexrelaytotalbps=<n>", _("Bytes per second of DEX push relay over all peers, 0 is unlimited (default: 0)"));
     if (showDebug)
         strUsage += HelpMessageOpt("-enforcenodebloom", strprintf("Enforce minimum protocol version to limit use of Bloom filters (default: %u)", 0));
     strUsage += HelpMessageOpt("-port=<port>", strprintf(_("Listen for connections on <port> (default: %u or testnet: %u)"), 7770, 17770));
@@ -513,6 +533,7 @@ std::string HelpMessage(HelpMessageMode mode)
         strUsage += HelpMessageOpt("-limitfreerelay=<n>", strprintf("Continuously rate-limit free transactions to <n>*1000 bytes per minute (default: %u)", 15));
         strUsage += HelpMessageOpt("-relaypriority", strprintf("Require high priority for relaying free or low-fee transactions (default: %u)", 0));
         strUsage += HelpMessageOpt("-maxsigcachesize=<n>", strprintf("Limit size of signature cache to <n> entries (default: %u)", 50000));
+        strUsage += HelpMessageOpt("-maxccevalcachesize=<n>", strprintf("Limit size of the cache of successful CC evals to <n> entries (default: %u)", 50000));
         strUsage += HelpMessageOpt("-maxtipage=<n>", strprintf("Maximum tip age in seconds to consider node in initial block download (default: %u)", DEFAULT_MAX_TIP_AGE));
     }
     strUsage += HelpMessageOpt("-minrelaytxfee=<amt>", strprintf(_("Fees (in %s/kB) smaller than this are considered zero fee for relaying (default: %s)"),
@@ -758,6 +779,8 @@ void ThreadNotifyRecentlyAdded()
 /* declarations needed for ThreadUpdateKomodoInternals */
 void komodo_passport_iteration();
 void komodo_cbopretupdate(int32_t forceflag);
+void komodo_kvsweep(int32_t height);
+int32_t komodo_currentheight();
 
 void ThreadUpdateKomodoInternals() {
     RenameThread("int-updater");
@@ -802,6 +825,7 @@ void ThreadUpdateKomodoInternals() {
                 {
                     if ( ASSETCHAINS_CBOPRET != 0 )
                         komodo_cbopretupdate(0);
+                    komodo_kvsweep(komodo_currentheight());
                 }
         }
     }
@@ -1613,6 +1637,7 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
 
     if ( KOMODO_NSPV_SUPERLITE )
     {
+        NSPV_cache_load();
         std::vector<boost::filesystem::path> vImportFiles;
         threadGroup.create_thread(boost::bind(&ThreadImport, vImportFiles));
         StartNode(threadGroup, scheduler);
@@ -1673,10 +1698,12 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     LogPrintf("* Using %.1fMiB for block index database\n", nBlockTreeDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for chain state database\n", nCoinDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for in-memory UTXO set\n", nCoinCacheUsage * (1.0 / 1024 / 1024));
+    nTxCacheUsage = std::max((int64_t)0, GetArg("-txcache", DEFAULT_TXCACHE)) << 20;
+    LogPrintf("* Using %.1fMiB for decoded transaction cache\n", nTxCacheUsage * (1.0 / 1024 / 1024));
 
     if ( fReindex == 0 )
     {
-        bool checkval, fAddressIndex, fSpentIndex, fUnspentCCIndexTmp;
+        bool checkval, fAddressIndex, fSpentIndex, fUnspentCCIndexTmp, fTokensIndexTmp;
         pblocktree = new CBlockTreeDB(nBlockTreeDBCache, false, fReindex, dbCompression, dbMaxOpenFiles);
         fAddressIndex = GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX);
         checkval = false;  // need to reinit checkval otherwise it might be undefined if ReadFlag returns false
@@ -1706,6 +1733,16 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
             fprintf(stderr,"set unspentccindex, will reindex. could take a while.\n");
             fReindex = true;
         }
+
+        fTokensIndexTmp = GetBoolArg("-tokensindex", DEFAULT_TOKENSINDEX);
+        checkval = false;
+        pblocktree->ReadFlag("tokensindex", checkval);
+        if ( checkval != fTokensIndexTmp && fTokensIndexTmp != 0 )
+        {
+            pblocktree->WriteFlag("tokensindex", fTokensIndexTmp);
+            fprintf(stderr,"set tokensindex, will reindex. could take a while.\n");
+            fReindex = true;
+        }
     }
 
     bool clearWitnessCaches = false;
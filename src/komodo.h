@@ -363,7 +363,8 @@ void komodo_stateupdate(int32_t height,uint8_t notarypubs[][33],uint8_t numnotar
     struct komodo_state *sp; char fname[512],symbol[KOMODO_ASSETCHAIN_MAXLEN],dest[KOMODO_ASSETCHAIN_MAXLEN]; int32_t retval,ht,func; uint8_t num,pubkeys[64][33];
     if ( didinit == 0 )
     {
-        portable_mutex_init(&KOMODO_KV_mutex);
+        pthread_rwlock_init(&KOMODO_KV_rwlock,NULL);
+        portable_mutex_init(&KOMODO_KVPENDING_mutex);
         portable_mutex_init(&KOMODO_CC_mutex);
         didinit = 1;
     }
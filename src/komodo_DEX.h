@@ -21,9 +21,17 @@
  _functions() assume DEX_globalmutex is locked when it is called
  functions() assume that DEX_globalmutes is not locked when it is called and must lock/unlock to call _functions()
  
+ locking is split three ways so the rpc read paths dont stall behind ingest:
+ DEX_globalmutex serializes all writers (network ingest/poll, local broadcast, cancel) and owns the network only state (Pendings, peermaps, perf counters)
+ DEX_indexlock is a rwlock, writers also take it exclusively around any change of G->Hashtables or the DEX_index lists (add, purge, cancel). readers (DEX_list, DEX_get, DEX_orderbook, file lookups) only take it shared, so they run concurrently with each other and with the ping/relay side of ingest. DEX_stats reads the perf counters, so it takes DEX_globalmutex first
+ DEX_shardmutex[modval % KOMODO_DEX_SHARDS] protects the per datablob relay state (peermask, requested, numsent) of one time bucket
+ lock order is DEX_globalmutex -> DEX_indexlock -> DEX_shardmutex, a datablob is only freed with DEX_indexlock held exclusively
+ komodo_DEXmsg() only queues the packet, -dexvalidators worker threads do the txpow hashing of a batch lock free (komodo_DEX_prevalidate) and then feed the survivors to _komodo_DEXprocess() under a single DEX_globalmutex hold
+ 
  message format: <relay depth> <funcid> <timestamp> <payload>
  
  <payload> is the datablob for a 'Q' quote or <uint16_t> + n * <uint32_t> for a 'P' ping of recent shorthashes
+ or <uint16_t ncells> <int32_t modval> + ncells * (<uint16_t count> <uint32_t keysum> <uint32_t checksum>) for an 'S' set sketch of a whole time bucket. an 'S' with ncells == 0 is a hello (modval -1) or a "could not decode modval, ping it for a while" nack
  
  To achieve very fast performance a hybrid push/poll/pull gossip protocol is used. All new quotes are broadcast KOMODO_DEX_RELAYDEPTH levels deep, this gets the quote to large percentage of nodes assuming <ave peers> ^ KOMODO_DEX_RELAYDEPTH power is approx totalnodes/2. Nodes in the broacast "cone" will receive a new quote in less than a second in most cases.
  
@@ -65,6 +73,8 @@ uint8_t *komodo_DEX_decrypt(uint8_t *senderpub,uint8_t **allocatedp,uint8_t *dat
 void komodo_DEX_pubkey(bits256 &pub0);
 void komodo_DEX_privkey(bits256 &priv0);
 int32_t komodo_DEX_request(int32_t priority,uint32_t shorthash,uint32_t timestamp,char *tagA,char *tagB);
+void *komodo_DEX_validator(void *arg);
+void komodo_DEX_storeload();
 
 #define KOMODO_DEX_PURGELIST 0
 
@@ -81,6 +91,7 @@ int32_t komodo_DEX_request(int32_t priority,uint32_t shorthash,uint32_t timestam
 #define KOMODO_DEX_MAXPERSEC (1 << KOMODO_DEX_HASHLOG2) // effective limit of sustained datablobs/sec
 //#define KOMODO_DEX_HASHMASK (KOMODO_DEX_MAXPERSEC - 1)
 #define KOMODO_DEX_PURGETIME (3600)
+#define KOMODO_DEX_SHARDS 64 // relay state locks, modval % KOMODO_DEX_SHARDS
 #define KOMODO_DEX_MAXPING (KOMODO_DEX_MAXPERSEC / 17)
 
 #define KOMOD_DEX_PEERMASKSIZE 128
@@ -103,11 +114,24 @@ int32_t komodo_DEX_request(int32_t priority,uint32_t shorthash,uint32_t timestam
 
 #define KOMODO_DEX_TXPOWDIVBITS 12 // each doubling of size, increases minpriority
 #define KOMODO_DEX_TXPOWMASK ((1LL << KOMODO_DEX_TXPOWBITS)-1)
+#define KOMODO_DEX_POWTHREADMIN 4 // below this priority the nonce search is too short to be worth extra threads
+#define KOMODO_DEX_MAXPOWTHREADS 64
+#define KOMODO_DEX_RELAYLEVELS 16 // one relay queue per datablob priority, higher ones are capped into the last
 //#define KOMODO_DEX_CREATEINDEX_MINPRIORITY 6 // 64x baseline diff -> approx 1 minute if baseline is 1 second diff
 
 #define KOMODO_DEX_FILEBUFSIZE 10000
 #define KOMODO_DEX_STREAMSIZE 100
+#define KOMODO_DEX_FILETHREADS 4 // DEX_subscribe decrypts and writes this many fragments in parallel
 #define KOMODO_DEX_ANONSIZE 1024
+#define KOMODO_DEX_SLABSIZE (1 << 16) // datablobs are carved from per second slabs, bigger ones get a slab of their own
+#define KOMODO_DEX_INDEXCHUNK 256 // DEX_index objects come from chunks of this many, an index released once empty goes to a free list for reuse
+#define KOMODO_DEX_STORESEGMENT 60 // -dexstore log files hold this many seconds of datablob timestamps each
+#define KOMODO_DEX_STORESLOTS (KOMODO_DEX_PURGETIME/KOMODO_DEX_STORESEGMENT + 2)
+#define KOMODO_DEX_STOREMAGIC 0x58454453 // "SDEX"
+#define KOMODO_DEX_IBLTCELLS 60 // 'S' set sketch size, multiple of 3, decodes differences up to about 2/3 of this
+#define KOMODO_DEX_RECONMIN (KOMODO_DEX_IBLTCELLS * 5) // only sketch a bucket when the 'P' ping would carry at least this many shorthashes
+#define KOMODO_DEX_RECONBACKOFF 10 // seconds of plain pings after a peer could not decode our sketch
+#define KOMODO_DEX_BOOKCHANGES 4096 // per tagAB orderbook changelog entries kept for DEX_orderbookchanges
 
 #define _komodo_DEXquotehash(hash,len) (uint32_t)(((hash).ulongs[0] >> (KOMODO_DEX_TXPOWBITS + komodo_DEX_sizepriority(len))))
 #define komodo_DEX_id(ptr) _komodo_DEXquotehash(ptr->hash,ptr->datalen)
@@ -121,7 +145,7 @@ struct DEX_datablob
     struct DEX_datablob *nexts[KOMODO_DEX_MAXINDICES],*prevs[KOMODO_DEX_MAXINDICES];
     bits256 hash;
     uint8_t peermask[KOMOD_DEX_PEERMASKSIZE];
-    uint32_t recvtime,cancelled,lastlist,shorthash;
+    uint32_t recvtime,cancelled,shorthash;
     int32_t datalen;
     int8_t priority,sizepriority;
     uint8_t numsent,offset,linkmask,requested;
@@ -130,14 +154,6 @@ struct DEX_datablob
 
 struct DEX_index_list { struct DEX_datablob *nexts[KOMODO_DEX_MAXINDICES],*prevs[KOMODO_DEX_MAXINDICES]; };
 
-struct DEX_index
-{
-    UT_hash_handle hh;
-    struct DEX_datablob *head,*tail;
-    uint8_t keylen;
-    uint8_t key[KOMODO_DEX_MAXKEYSIZE];
-} *DEX_destpubs,*DEX_tagAs,*DEX_tagBs,*DEX_tagABs;
-
 struct DEX_orderbookentry
 {
     bits256 hash;
@@ -147,16 +163,69 @@ struct DEX_orderbookentry
     uint8_t pubkey33[33],priority;
 };
 
+struct DEX_bookkey // ascending amountB/amountA, then larger amountA first, which is the order DEX_orderbook returns
+{
+    double price;
+    uint64_t amountA;
+    struct DEX_datablob *ptr;
+    bool operator<(const DEX_bookkey &b) const
+    {
+        if ( price != b.price )
+            return(price < b.price);
+        if ( amountA != b.amountA )
+            return(amountA > b.amountA);
+        return(ptr < b.ptr);
+    }
+};
+
+struct DEX_bookchange { uint32_t changeid,changetime; char type; struct DEX_orderbookentry entry; }; // type is 'A'dded, 'X' cancelled, 'P'urged
+
+struct DEX_index
+{
+    UT_hash_handle hh;
+    struct DEX_datablob *head,*tail;
+    std::set<struct DEX_bookkey> *book; // only for tagABs, live quotes in price order
+    std::deque<struct DEX_bookchange> *changes;
+    uint32_t droppedid;
+    uint8_t keylen;
+    uint8_t key[KOMODO_DEX_MAXKEYSIZE];
+} *DEX_destpubs,*DEX_tagAs,*DEX_tagBs,*DEX_tagABs;
+
 // start perf metrics
 static double DEX_lag,DEX_lag2,DEX_lag3;
 static int64_t DEX_totalsent,DEX_totalrecv,DEX_totaladd,DEX_duplicate,DEX_progress;
 static int64_t DEX_lookup32,DEX_collision32,DEX_add32,DEX_maxlag;
-static int64_t DEX_Numpending,DEX_freed,DEX_truncated;
+static int64_t DEX_Numpending,DEX_freed,DEX_truncated,DEX_overflow;
+static int64_t DEX_pings,DEX_pingbytes,DEX_sketches,DEX_sketchbytes,DEX_reconok,DEX_reconfail,DEX_reconfetch;
+static int64_t DEX_powquotes,DEX_powhashes; static double DEX_powmillis; static int32_t DEX_powlast,DEX_powmax;
+static pthread_mutex_t DEX_powmutex = PTHREAD_MUTEX_INITIALIZER; // nonce searches run outside DEX_globalmutex, from any rpc thread
+static int64_t DEX_relayqueued[KOMODO_DEX_RELAYLEVELS],DEX_relaysent[KOMODO_DEX_RELAYLEVELS],DEX_relaydeferred[KOMODO_DEX_RELAYLEVELS],DEX_relaybytes,DEX_relaytokens; static uint32_t DEX_relaytime;
 // end perf metrics
 
-static uint32_t Got_Recent_Quote;
+static uint32_t Got_Recent_Quote,DEX_bookchangeid,DEX_bookfreedid; // DEX_bookfreedid is the last changeid of any released tagAB changelog
 bits256 DEX_pubkey,GENESIS_PUBKEY,GENESIS_PRIVKEY;
-pthread_mutex_t DEX_globalmutex;
+pthread_mutex_t DEX_globalmutex,DEX_shardmutex[KOMODO_DEX_SHARDS];
+pthread_rwlock_t DEX_indexlock;
+
+// incoming packets are queued by the net thread and pre-validated on DEX_numvalidators worker threads
+#define KOMODO_DEX_VALIDATEBATCH 64
+#define KOMODO_DEX_MAXRAWQUEUE (KOMODO_DEX_MAXPERSEC * 4)
+struct DEX_rawpacket;
+static std::deque<struct DEX_rawpacket *> DEX_rawpackets;
+static pthread_mutex_t DEX_rawmutex;
+static pthread_cond_t DEX_rawcond;
+static int32_t DEX_numvalidators;
+
+struct DEX_slab
+{
+    struct DEX_slab *next;
+    int32_t size,used;
+    uint8_t space[];
+};
+
+struct DEX_arena { struct DEX_slab *slabs; int32_t live; }; // all datablobs with the same timestamp % KOMODO_DEX_PURGETIME
+
+static int64_t DEX_slabs,DEX_slabbytes,DEX_slabused,DEX_slablive,DEX_indexchunks,DEX_indexes;
 
 static struct DEX_globals
 {
@@ -164,13 +233,19 @@ static struct DEX_globals
     uint32_t Pendings[KOMODO_DEX_MAXLAG * KOMODO_DEX_MAXPERSEC - 1];
     
     struct DEX_datablob *Hashtables[KOMODO_DEX_PURGETIME];
+    struct DEX_arena Arenas[KOMODO_DEX_PURGETIME];
 #if KOMODO_DEX_PURGELIST
     struct DEX_datablob *Purgelist[KOMODO_DEX_MAXPERSEC * KOMODO_DEX_MAXLAG];
     int32_t numpurges;
 #endif
     FILE *fp;
+    FILE *storefps[KOMODO_DEX_STORESLOTS];
+    uint32_t storesegs[KOMODO_DEX_STORESLOTS];
+    int32_t storeloading;
 } *G;
 
+struct DEX_storerec { uint32_t magic; int32_t len; uint32_t recvtime,shorthash; bits256 hash; }; // followed by the packet as received
+
 void komodo_DEX_pubkeyupdate()
 {
     komodo_DEX_pubkey(DEX_pubkey);
@@ -182,12 +257,17 @@ void komodo_DEX_pubkeyupdate()
 
 void komodo_DEX_init()
 {
-    static int32_t onetime; int32_t modval;
+    static int32_t onetime; int32_t modval,i;
     if ( onetime == 0 )
     {
         decode_hex(GENESIS_PUBKEY.bytes,sizeof(GENESIS_PUBKEY),GENESIS_PUBKEYSTR);
         decode_hex(GENESIS_PRIVKEY.bytes,sizeof(GENESIS_PRIVKEY),GENESIS_PRIVKEYSTR);
         pthread_mutex_init(&DEX_globalmutex,0);
+        pthread_rwlock_init(&DEX_indexlock,0);
+        for (i=0; i<KOMODO_DEX_SHARDS; i++)
+            pthread_mutex_init(&DEX_shardmutex[i],0);
+        pthread_mutex_init(&DEX_rawmutex,0);
+        pthread_cond_init(&DEX_rawcond,0);
         komodo_DEX_pubkeyupdate();
         G = (struct DEX_globals *)calloc(1,sizeof(*G));
         if ( (G->fp= fopen((char *)"DEX.log",(char *)"wb")) == 0 )
@@ -196,14 +276,26 @@ void komodo_DEX_init()
             exit(-1);
         }
         char str[67]; fprintf(stderr,"DEX_pubkey.(01%s) sizeof DEX_globals %ld\n\n",bits256_str(str,DEX_pubkey),sizeof(*G));
+        for (i=0; i<KOMODO_DEX_VALIDATORS; i++)
+        {
+            pthread_t tid;
+            if ( pthread_create(&tid,NULL,komodo_DEX_validator,NULL) != 0 )
+            {
+                fprintf(stderr,"couldnt start DEX validator.%d, using %d\n",i,i);
+                break;
+            }
+            pthread_detach(tid);
+        }
+        DEX_numvalidators = i;
+        if ( KOMODO_DEX_STORE != 0 )
+            komodo_DEX_storeload();
         onetime = 1;
     }
 }
 
-uint32_t komodo_DEX_listid()
+pthread_mutex_t *komodo_DEX_shard(int32_t modval)
 {
-    static uint32_t listid;
-    return(++listid);
+    return(&DEX_shardmutex[modval % KOMODO_DEX_SHARDS]);
 }
 
 int32_t komodo_DEX_islagging()
@@ -349,21 +441,178 @@ DL_FOREACH2ind(tail,el,prevs,ind)
 #define DL_FOREACH2ind(tail,el,prevs,ind)                                                              \
 for(el=tail;el;el=(el)->prevs[ind])
 
+int32_t komodo_DEX_bookkey(struct DEX_bookkey &key,struct DEX_datablob *ptr)
+{
+    uint64_t amountA,amountB;
+    iguana_rwnum(0,&ptr->data[KOMODO_DEX_ROUTESIZE],sizeof(amountA),&amountA);
+    iguana_rwnum(0,&ptr->data[KOMODO_DEX_ROUTESIZE + sizeof(amountA)],sizeof(amountB),&amountB);
+    if ( amountA == 0 || amountB == 0 )
+        return(-1);
+    key.price = (double)amountB / amountA;
+    key.amountA = amountA;
+    key.ptr = ptr;
+    return(0);
+}
+
+void komodo_DEX_orderbookentryset(struct DEX_orderbookentry *op,struct DEX_datablob *ptr,int32_t revflag)
+{
+    uint64_t amountA,amountB; double price = 0.; int32_t offset = KOMODO_DEX_ROUTESIZE + 2*sizeof(uint64_t);
+    memset(op,0,sizeof(*op));
+    if ( ptr->data[offset] == 33 ) // destpub follows the amounts, see komodo_DEX_extract
+        memcpy(op->pubkey33,&ptr->data[offset+1],33);
+    iguana_rwnum(0,&ptr->data[KOMODO_DEX_ROUTESIZE],sizeof(amountA),&amountA);
+    iguana_rwnum(0,&ptr->data[KOMODO_DEX_ROUTESIZE + sizeof(amountA)],sizeof(amountB),&amountB);
+    if ( revflag == 0 )
+    {
+        op->amountA = amountA;
+        op->amountB = amountB;
+        if ( amountA != 0 )
+            price = (double)amountB / amountA;
+    }
+    else
+    {
+        op->amountA = amountB;
+        op->amountB = amountA;
+        if ( amountB != 0 )
+            price = (double)amountA / amountB;
+    }
+    op->price = price;
+    iguana_rwnum(0,&ptr->data[2],sizeof(op->timestamp),&op->timestamp);
+    op->hash = ptr->hash;
+    op->shorthash = ptr->shorthash; // datalen is already 0 for an expired datablob, the quotehash has to come from before the purge
+    op->priority = ptr->priority;
+}
+
+void _komodo_DEX_bookchange(struct DEX_index *index,struct DEX_datablob *ptr,char type)
+{
+    struct DEX_bookchange change;
+    if ( index->changes == 0 )
+        index->changes = new std::deque<struct DEX_bookchange>();
+    change.changeid = ++DEX_bookchangeid;
+    change.changetime = (uint32_t)time(NULL);
+    change.type = type;
+    komodo_DEX_orderbookentryset(&change.entry,ptr,0);
+    index->changes->push_back(change);
+    while ( index->changes->size() > KOMODO_DEX_BOOKCHANGES )
+    {
+        index->droppedid = index->changes->front().changeid;
+        index->changes->pop_front();
+    }
+}
+
+void _komodo_DEX_bookadd(struct DEX_index *index,struct DEX_datablob *ptr)
+{
+    struct DEX_bookkey key;
+    if ( ptr->cancelled != 0 || komodo_DEX_bookkey(key,ptr) < 0 )
+        return;
+    if ( index->book == 0 )
+        index->book = new std::set<struct DEX_bookkey>();
+    if ( index->book->insert(key).second != 0 )
+        _komodo_DEX_bookchange(index,ptr,'A');
+}
+
+void _komodo_DEX_bookremove(struct DEX_index *index,struct DEX_datablob *ptr,char type)
+{
+    struct DEX_bookkey key;
+    if ( index->book == 0 || komodo_DEX_bookkey(key,ptr) < 0 )
+        return;
+    if ( index->book->erase(key) != 0 )
+        _komodo_DEX_bookchange(index,ptr,type);
+}
+
+struct DEX_datablob *_komodo_DEX_alloc(int32_t modval,int32_t size)
+{
+    struct DEX_arena *arena = &G->Arenas[modval]; struct DEX_slab *slab; struct DEX_datablob *ptr; int32_t slabsize;
+    size = (size + 7) & ~7;
+    if ( (slab= arena->slabs) == 0 || slab->used + size > slab->size )
+    {
+        slabsize = (size > KOMODO_DEX_SLABSIZE/4) ? size : KOMODO_DEX_SLABSIZE;
+        if ( (slab= (struct DEX_slab *)calloc(1,sizeof(*slab) + slabsize)) == 0 )
+            return(0);
+        slab->size = slabsize;
+        if ( slabsize == size && arena->slabs != 0 ) // keep the partly used slab at the head for the small ones
+        {
+            slab->next = arena->slabs->next;
+            arena->slabs->next = slab;
+        }
+        else
+        {
+            slab->next = arena->slabs;
+            arena->slabs = slab;
+        }
+        DEX_slabs++;
+        DEX_slabbytes += slabsize;
+    }
+    ptr = (struct DEX_datablob *)&slab->space[slab->used];
+    slab->used += size;
+    arena->live++;
+    DEX_slabused += size;
+    DEX_slablive++;
+    return(ptr);
+}
+
+void _komodo_DEX_free(struct DEX_datablob *ptr) // the whole slab list goes when the last datablob of its second is released
+{
+    struct DEX_arena *arena; struct DEX_slab *slab; uint32_t t;
+    iguana_rwnum(0,&ptr->data[2],sizeof(t),&t);
+    arena = &G->Arenas[t % KOMODO_DEX_PURGETIME];
+    DEX_slablive--;
+    DEX_freed++;
+    if ( --arena->live <= 0 )
+    {
+        while ( (slab= arena->slabs) != 0 )
+        {
+            arena->slabs = slab->next;
+            DEX_slabs--;
+            DEX_slabbytes -= slab->size;
+            DEX_slabused -= slab->used;
+            free(slab);
+        }
+        arena->live = 0;
+    }
+}
+
+static struct DEX_index *DEX_indexfreelist; // released indexes, linked through hh.next which no hashtable uses anymore
+
+struct DEX_index *_komodo_DEX_indexalloc()
+{
+    static struct DEX_index *chunk; static int32_t numleft; struct DEX_index *index;
+    if ( (index= DEX_indexfreelist) != 0 )
+    {
+        DEX_indexfreelist = (struct DEX_index *)index->hh.next;
+        memset(index,0,sizeof(*index));
+        DEX_indexes++;
+        return(index);
+    }
+    if ( numleft == 0 )
+    {
+        if ( (chunk= (struct DEX_index *)calloc(KOMODO_DEX_INDEXCHUNK,sizeof(*chunk))) == 0 )
+            return(0);
+        numleft = KOMODO_DEX_INDEXCHUNK;
+        DEX_indexchunks++;
+    }
+    numleft--;
+    DEX_indexes++;
+    return(chunk++);
+}
+
 void _komodo_DEX_enqueue(int32_t ind,struct DEX_index *index,struct DEX_datablob *ptr)
 {
     if ( GETBIT(&ptr->linkmask,ind) != 0 )
     {
-        fprintf(stderr,"duplicate link attempted ind.%d ptr.%p listid.%d\n",ind,ptr,ptr->lastlist);
+        fprintf(stderr,"duplicate link attempted ind.%d ptr.%p linkmask.%x\n",ind,ptr,ptr->linkmask);
         return;
     }
     if ( ptr->datalen < KOMODO_DEX_ROUTESIZE )
     {
-        fprintf(stderr,"already truncated datablob cant be linked ind.%d ptr.%p listid.%d\n",ind,ptr,ptr->lastlist);
+        fprintf(stderr,"already truncated datablob cant be linked ind.%d ptr.%p linkmask.%x\n",ind,ptr,ptr->linkmask);
         return;
     }
     DL_APPENDind(index->head,ptr,ind);
     index->tail = ptr;
     SETBIT(&ptr->linkmask,ind);
+    if ( ind == KOMODO_DEX_MAXINDICES-1 )
+        _komodo_DEX_bookadd(index,ptr);
 }
 
 uint32_t _komodo_DEXtotal(int32_t *histo,int32_t &total)
@@ -420,6 +669,8 @@ int32_t _komodo_DEX_purgeindex(int32_t ind,struct DEX_index *index,uint32_t cuto
         {
             if ( index->tail == index->head )
                 index->tail = 0;
+            if ( ind == KOMODO_DEX_MAXINDICES-1 )
+                _komodo_DEX_bookremove(index,ptr,'P');
             DL_DELETEind(index->head,ptr,ind);
             n++;
             CLEARBIT(&ptr->linkmask,ind);
@@ -428,8 +679,7 @@ int32_t _komodo_DEX_purgeindex(int32_t ind,struct DEX_index *index,uint32_t cuto
 #if KOMODO_DEX_PURGELIST
                 G->Purgelist[G->numpurges++] = ptr;
 #else
-                free(ptr);
-                DEX_freed++;
+                _komodo_DEX_free(ptr);
 #endif
              } // else fprintf(stderr,"%p ind.%d linkmask.%x\n",ptr,ind,ptr->linkmask);
              ptr = index->head;
@@ -469,6 +719,14 @@ int32_t _komodo_DEXpurge(uint32_t cutoff)
             ptr->datalen = 0;
             CLEARBIT(&ptr->linkmask,KOMODO_DEX_MAXINDICES);
             DEX_truncated++;
+            if ( ptr->linkmask == 0 ) // not in any index list, nothing else will release it
+            {
+#if KOMODO_DEX_PURGELIST
+                G->Purgelist[G->numpurges++] = ptr;
+#else
+                _komodo_DEX_free(ptr);
+#endif
+            }
             n++;
         } // else fprintf(stderr,"modval.%d unexpected purge.%d t.%u vs cutoff.%u\n",modval,i,t,cutoff);
     }
@@ -495,6 +753,40 @@ int32_t _komodo_DEXpurge(uint32_t cutoff)
     return(n);
 }
 
+// drops the orderbook changes recorded at or before cutoff, DEX_orderbookchanges callers that far behind get a reset
+void _komodo_DEX_booktrim(struct DEX_index *index,uint32_t cutoff)
+{
+    while ( index->changes != 0 && index->changes->size() > 0 && index->changes->front().changetime <= cutoff )
+    {
+        index->droppedid = index->changes->front().changeid;
+        index->changes->pop_front();
+    }
+    if ( index->changes != 0 && index->changes->size() == 0 )
+    {
+        delete index->changes;
+        index->changes = 0;
+    }
+    if ( index->book != 0 && index->book->size() == 0 )
+    {
+        delete index->book;
+        index->book = 0;
+    }
+}
+
+// an index without datablobs and without an orderbook or changelog is removed from its hashtable and goes to the free list
+int32_t _komodo_DEX_indexrelease(struct DEX_index *&table,struct DEX_index *index)
+{
+    if ( index->head != 0 || index->tail != 0 || index->book != 0 || index->changes != 0 )
+        return(0);
+    HASH_DELETE(hh,table,index);
+    if ( index->droppedid > DEX_bookfreedid )
+        DEX_bookfreedid = index->droppedid;
+    index->hh.next = DEX_indexfreelist;
+    DEX_indexfreelist = index;
+    DEX_indexes--;
+    return(1);
+}
+
 int32_t _komodo_DEX_purgeindices(uint32_t cutoff)
 {
     int32_t i,j,n=0; uint32_t t; struct DEX_datablob *ptr; struct DEX_index *index = 0,*tmp;
@@ -503,6 +795,7 @@ int32_t _komodo_DEX_purgeindices(uint32_t cutoff)
         HASH_ITER(hh,DEX_destpubs,index,tmp)
         {
             n += _komodo_DEX_purgeindex(0,index,cutoff);
+            _komodo_DEX_indexrelease(DEX_destpubs,index);
         }
     }
     if ( DEX_tagAs != 0 )
@@ -510,6 +803,7 @@ int32_t _komodo_DEX_purgeindices(uint32_t cutoff)
         HASH_ITER(hh,DEX_tagAs,index,tmp)
         {
             n += _komodo_DEX_purgeindex(1,index,cutoff);
+            _komodo_DEX_indexrelease(DEX_tagAs,index);
         }
     }
     if ( DEX_tagBs != 0 )
@@ -517,6 +811,7 @@ int32_t _komodo_DEX_purgeindices(uint32_t cutoff)
         HASH_ITER(hh,DEX_tagBs,index,tmp)
         {
             n += _komodo_DEX_purgeindex(2,index,cutoff);
+            _komodo_DEX_indexrelease(DEX_tagBs,index);
         }
     }
     if ( DEX_tagABs != 0 )
@@ -524,6 +819,8 @@ int32_t _komodo_DEX_purgeindices(uint32_t cutoff)
         HASH_ITER(hh,DEX_tagABs,index,tmp)
         {
             n += _komodo_DEX_purgeindex(3,index,cutoff);
+            _komodo_DEX_booktrim(index,cutoff);
+            _komodo_DEX_indexrelease(DEX_tagABs,index);
         }
     }
 #if KOMODO_DEX_PURGELIST
@@ -539,8 +836,7 @@ int32_t _komodo_DEX_purgeindices(uint32_t cutoff)
                     G->Purgelist[i] = G->Purgelist[--G->numpurges];
                     G->Purgelist[G->numpurges] = 0;
                     i--;
-                    free(ptr);
-                    DEX_freed++;
+                    _komodo_DEX_free(ptr);
                 } else fprintf(stderr,"ptr is still accessed? linkmask.%x\n",ptr->linkmask);
             }
         } else fprintf(stderr,"unexpected null ptr at %d of %d\n",i,G->numpurges);
@@ -594,7 +890,7 @@ struct DEX_index *_komodo_DEX_indexfind(int32_t ind,uint8_t *keybuf,int32_t keyl
 
 struct DEX_index *_komodo_DEX_indexcreate(int32_t ind,uint8_t *key,int8_t keylen,struct DEX_datablob *ptr)
 {
-    struct DEX_index *index = (struct DEX_index *)calloc(1,sizeof(*index));
+    struct DEX_index *index = _komodo_DEX_indexalloc();
     if ( index == 0 )
     {
         fprintf(stderr,"out of memory\n");
@@ -609,6 +905,8 @@ struct DEX_index *_komodo_DEX_indexcreate(int32_t ind,uint8_t *key,int8_t keylen
         char str[111]; fprintf(stderr," ind.%d %p index create (%s) len.%d\n",ind,index,komodo_DEX_keystr(str,key,keylen),keylen);
     }
     index->keylen = keylen;
+    if ( ind == 3 ) // the pair may have had a changelog that was released, callers from before that need a reset
+        index->droppedid = DEX_bookfreedid;
     switch ( ind )
     {
         case 0: HASH_ADD_KEYPTR(hh,DEX_destpubs,index->key,index->keylen,index); break;
@@ -804,6 +1102,68 @@ int32_t komodo_DEX_tagsextract(uint64_t &amountA,uint64_t &amountB,char taga[],c
     return(0);
 }
 
+// -dexstore keeps an append only log of accepted datablobs in <datadir>/DEX/<timestamp/KOMODO_DEX_STORESEGMENT>, whole files are deleted as their seconds purge
+
+void komodo_DEX_storefname(char *fname,uint32_t seg)
+{
+    boost::filesystem::path dirname = GetDataDir() / "DEX";
+    sprintf(fname,"%s/%u",dirname.string().c_str(),seg);
+}
+
+void _komodo_DEX_storeappend(uint32_t recvtime,bits256 hash,uint32_t shorthash,uint8_t *msg,int32_t len)
+{
+    struct DEX_storerec rec; uint32_t t,seg; int32_t slot; char fname[512];
+    if ( KOMODO_DEX_STORE == 0 || G->storeloading != 0 )
+        return;
+    iguana_rwnum(0,&msg[2],sizeof(t),&t);
+    seg = (t / KOMODO_DEX_STORESEGMENT);
+    slot = (seg % KOMODO_DEX_STORESLOTS);
+    if ( G->storefps[slot] == 0 || G->storesegs[slot] != seg )
+    {
+        if ( G->storefps[slot] != 0 )
+            fclose(G->storefps[slot]);
+        komodo_DEX_storefname(fname,seg);
+        if ( (G->storefps[slot]= fopen(fname,"ab")) == 0 )
+        {
+            fprintf(stderr,"DEX store couldnt open %s\n",fname);
+            return;
+        }
+        G->storesegs[slot] = seg;
+    }
+    memset(&rec,0,sizeof(rec));
+    rec.magic = KOMODO_DEX_STOREMAGIC;
+    rec.len = len;
+    rec.recvtime = recvtime;
+    rec.shorthash = shorthash;
+    rec.hash = hash;
+    if ( fwrite(&rec,1,sizeof(rec),G->storefps[slot]) != sizeof(rec) || fwrite(msg,1,len,G->storefps[slot]) != len )
+        fprintf(stderr,"DEX store write error seg.%u\n",seg);
+}
+
+void _komodo_DEX_storeflush()
+{
+    int32_t slot;
+    for (slot=0; slot<KOMODO_DEX_STORESLOTS; slot++)
+        if ( G->storefps[slot] != 0 )
+            fflush(G->storefps[slot]);
+}
+
+void _komodo_DEX_storepurge(uint32_t cutoff) // called for every purged second, drops the file once its last second is gone
+{
+    uint32_t seg; int32_t slot; char fname[512];
+    if ( KOMODO_DEX_STORE == 0 || (cutoff % KOMODO_DEX_STORESEGMENT) != KOMODO_DEX_STORESEGMENT-1 )
+        return;
+    seg = (cutoff / KOMODO_DEX_STORESEGMENT);
+    slot = (seg % KOMODO_DEX_STORESLOTS);
+    if ( G->storefps[slot] != 0 && G->storesegs[slot] == seg )
+    {
+        fclose(G->storefps[slot]);
+        G->storefps[slot] = 0;
+    }
+    komodo_DEX_storefname(fname,seg);
+    remove(fname);
+}
+
 struct DEX_datablob *_komodo_DEXfind(int32_t modval,uint32_t shorthash)
 {
     uint32_t hashval; int32_t i,hashind; struct DEX_datablob *ptr;
@@ -837,7 +1197,7 @@ struct DEX_datablob *_komodo_DEXadd(uint32_t now,int32_t modval,bits256 hash,uin
     memset(tagB,0,sizeof(tagB));
     if ( (offset= komodo_DEX_extract(amountA,amountB,lenA,tagA,lenB,tagB,destpub33,plen,&msg[KOMODO_DEX_ROUTESIZE],len-KOMODO_DEX_ROUTESIZE)) < 0 )
         return(0);
-    if ( (ptr= (struct DEX_datablob *)calloc(1,sizeof(*ptr) + len)) != 0 )
+    if ( (ptr= _komodo_DEX_alloc(modval,sizeof(*ptr) + len)) != 0 )
     {
         ptr->recvtime = now;
         ptr->hash = hash;
@@ -848,6 +1208,7 @@ struct DEX_datablob *_komodo_DEXadd(uint32_t now,int32_t modval,bits256 hash,uin
         ptr->offset = offset + KOMODO_DEX_ROUTESIZE; // payload is after relaydepth, funcid, timestamp
         memcpy(ptr->data,msg,len);
         ptr->data[0] = msg[0] != 0xff ? msg[0] - 1 : msg[0];
+        _komodo_DEX_storeappend(now,hash,shorthash,msg,len);
         {
             HASH_ADD(hh,G->Hashtables[modval],shorthash,sizeof(ptr->shorthash),ptr);
             SETBIT(&ptr->linkmask,KOMODO_DEX_MAXINDICES);
@@ -892,9 +1253,162 @@ int32_t komodo_DEXgenping(uint8_t funcid,std::vector<uint8_t> &ping,uint32_t tim
     return(len);
 }
 
+// set reconciliation, -dexrecon peers exchange an invertible bloom lookup table of a modval bucket instead of an explicit 'P' list when that list would be long
+
+struct DEX_ibltcell { int16_t count; uint32_t keysum,checksum; };
+
+struct DEX_reconpeer { uint8_t sent,capable; uint32_t pingonly; };
+static std::map<int32_t,struct DEX_reconpeer> DEX_reconpeers; // by CNode id, DEX_globalmutex
+
+uint32_t komodo_DEX_ibltcheck(uint32_t h)
+{
+    h ^= h >> 16;
+    h *= 0x7feb352d;
+    h ^= h >> 15;
+    h *= 0x846ca68b;
+    h ^= h >> 16;
+    return(h);
+}
+
+void komodo_DEX_ibltinsert(struct DEX_ibltcell *cells,int32_t ncells,uint32_t h,int32_t dir)
+{
+    int32_t i,sub,pos;
+    sub = ncells / 3;
+    for (i=0; i<3; i++) // one cell in each third, so the 3 positions never collide
+    {
+        pos = i*sub + (komodo_DEX_ibltcheck(h + 0x9e3779b9*(i+1)) % sub);
+        cells[pos].count += dir;
+        cells[pos].keysum ^= h;
+        cells[pos].checksum ^= komodo_DEX_ibltcheck(h);
+    }
+}
+
+int32_t komodo_DEX_ibltpeel(struct DEX_ibltcell *cells,int32_t ncells,uint32_t *theirs,int32_t &ntheirs,uint32_t *ours,int32_t &nours,int32_t maxn)
+{
+    int32_t i,found; uint32_t h;
+    ntheirs = nours = 0;
+    do
+    {
+        for (found=i=0; i<ncells; i++)
+        {
+            if ( (cells[i].count == 1 || cells[i].count == -1) && cells[i].checksum == komodo_DEX_ibltcheck(cells[i].keysum) )
+            {
+                h = cells[i].keysum;
+                if ( cells[i].count == 1 )
+                {
+                    if ( ntheirs >= maxn )
+                        return(-1);
+                    theirs[ntheirs++] = h;
+                    komodo_DEX_ibltinsert(cells,ncells,h,-1);
+                }
+                else
+                {
+                    if ( nours >= maxn )
+                        return(-1);
+                    ours[nours++] = h;
+                    komodo_DEX_ibltinsert(cells,ncells,h,1);
+                }
+                found++;
+            }
+        }
+    } while ( found != 0 );
+    for (i=0; i<ncells; i++)
+        if ( cells[i].count != 0 || cells[i].keysum != 0 || cells[i].checksum != 0 )
+            return(-1);
+    return(0);
+}
+
+int32_t komodo_DEXgensketch(std::vector<uint8_t> &sketch,uint32_t timestamp,int32_t modval,struct DEX_ibltcell *cells,uint16_t ncells)
+{
+    int32_t i,len = 0; uint16_t count;
+    sketch.resize(2 + sizeof(timestamp) + sizeof(ncells) + sizeof(modval) + ncells*(sizeof(count) + 2*sizeof(uint32_t)));
+    sketch[len++] = 0;
+    sketch[len++] = 'S';
+    len += iguana_rwnum(1,&sketch[len],sizeof(timestamp),&timestamp);
+    len += iguana_rwnum(1,&sketch[len],sizeof(ncells),&ncells);
+    len += iguana_rwnum(1,&sketch[len],sizeof(modval),&modval);
+    for (i=0; i<ncells; i++)
+    {
+        count = (uint16_t)cells[i].count;
+        len += iguana_rwnum(1,&sketch[len],sizeof(count),&count);
+        len += iguana_rwnum(1,&sketch[len],sizeof(cells[i].keysum),&cells[i].keysum);
+        len += iguana_rwnum(1,&sketch[len],sizeof(cells[i].checksum),&cells[i].checksum);
+    }
+    return(len);
+}
+
+void _komodo_DEX_reconhello(CNode *peer,uint32_t now,int32_t modval) // ncells 0: modval -1 announces -dexrecon, otherwise it says the sketch for modval didnt decode
+{
+    std::vector<uint8_t> hello;
+    if ( komodo_DEXgensketch(hello,now,modval,0,0) > 0 )
+        peer->PushMessage("DEX",hello);
+    if ( modval < 0 )
+        DEX_reconpeers[peer->id].sent = 1;
+}
+
+int32_t komodo_DEX_powcheck(uint64_t h,int32_t priority) // 0 if h has the txpow signature and at least priority trailing zero bits after it
+{
+    int32_t j;
+    if ( (h & KOMODO_DEX_TXPOWMASK) != (0x777 & KOMODO_DEX_TXPOWMASK) )
+        return(-1);
+    h >>= KOMODO_DEX_TXPOWBITS;
+    for (j=0; j<priority; j++,h>>=1)
+        if ( (h & 1) != 0 )
+            return(-1);
+    return(0);
+}
+
+struct DEX_powsearch // one nonce search, the threads interleave nonces with a stride of numthreads
+{
+    pthread_mutex_t mutex; // guards the winning quote, hash and shorthash, nextid and hashes
+    std::vector<uint8_t> *quote;
+    bits256 hash;
+    uint64_t hashes;
+    uint32_t nonce0,shorthash;
+    int32_t len,priority,numthreads,nextid;
+    std::atomic<int32_t> found; // polled lock free by every nonce iteration
+};
+
+void *komodo_DEX_powsearcher(void *arg)
+{
+    struct DEX_powsearch *ps = (struct DEX_powsearch *)arg; std::vector<uint8_t> quote; bits256 hash; uint32_t i,nonce,timestamp,shorthash,maxiters; int32_t id,len = ps->len;
+    pthread_mutex_lock(&ps->mutex);
+    quote = *ps->quote;
+    id = ps->nextid++;
+    pthread_mutex_unlock(&ps->mutex);
+    maxiters = 0xffffffff / ps->numthreads;
+    for (i=0,nonce=ps->nonce0+id; i<maxiters; i++,nonce+=ps->numthreads)
+    {
+        if ( ps->found.load(std::memory_order_relaxed) != 0 )
+            break;
+        timestamp = (uint32_t)time(NULL);
+        iguana_rwnum(1,&quote[2],sizeof(timestamp),&timestamp);
+        iguana_rwnum(1,&quote[len - sizeof(nonce)],sizeof(nonce),&nonce);
+        shorthash = komodo_DEXquotehash(hash,&quote[0],len);
+        if ( komodo_DEX_powcheck(hash.ulongs[0],ps->priority) == 0 )
+        {
+            i++;
+            pthread_mutex_lock(&ps->mutex);
+            if ( ps->found.load() == 0 )
+            {
+                *ps->quote = quote;
+                ps->hash = hash;
+                ps->shorthash = shorthash;
+                ps->found = 1;
+            }
+            pthread_mutex_unlock(&ps->mutex);
+            break;
+        }
+    }
+    pthread_mutex_lock(&ps->mutex);
+    ps->hashes += i;
+    pthread_mutex_unlock(&ps->mutex);
+    return(0);
+}
+
 int32_t komodo_DEXgenquote(uint8_t funcid,int32_t priority,bits256 &hash,uint32_t &shorthash,std::vector<uint8_t> &quote,uint32_t timestamp,uint8_t hdr[],int32_t hdrlen,uint8_t data[],int32_t datalen)
 {
-    int32_t i,j,len = 0; uint64_t h; uint32_t nonce = rand();
+    int32_t i,len = 0; uint32_t nonce = rand();
     quote.resize(2 + sizeof(uint32_t) + hdrlen + datalen + sizeof(nonce)); // send list of recently added shorthashes
     quote[len++] = KOMODO_DEX_RELAYDEPTH;
     quote[len++] = funcid;
@@ -908,28 +1422,46 @@ int32_t komodo_DEXgenquote(uint8_t funcid,int32_t priority,bits256 &hash,uint32_
     }
     len += sizeof(nonce);
 #if KOMODO_DEX_TXPOWMASK
-    for (i=0; i<0xffffffff; i++,nonce++)
     {
-        timestamp = (uint32_t)time(NULL);
-        iguana_rwnum(1,&quote[2],sizeof(timestamp),&timestamp);
-        iguana_rwnum(1,&quote[len - sizeof(nonce)],sizeof(nonce),&nonce);
-        shorthash = komodo_DEXquotehash(hash,&quote[0],len);
-        h = hash.ulongs[0];
-        if ( (h & KOMODO_DEX_TXPOWMASK) == (0x777 & KOMODO_DEX_TXPOWMASK) )
+        struct DEX_powsearch ps; pthread_t tids[KOMODO_DEX_MAXPOWTHREADS]; int32_t n,achieved; double startmillis = OS_milliseconds();
+        pthread_mutex_init(&ps.mutex,0);
+        memset(&ps.hash,0,sizeof(ps.hash));
+        ps.hashes = 0, ps.shorthash = 0, ps.nextid = 0, ps.found = 0;
+        ps.quote = &quote;
+        ps.len = len;
+        ps.priority = priority;
+        ps.nonce0 = nonce;
+        ps.numthreads = 1;
+        if ( priority >= KOMODO_DEX_POWTHREADMIN && KOMODO_DEX_POWTHREADS > 1 )
+            ps.numthreads = (KOMODO_DEX_POWTHREADS < KOMODO_DEX_MAXPOWTHREADS) ? KOMODO_DEX_POWTHREADS : KOMODO_DEX_MAXPOWTHREADS;
+        for (n=0; n<ps.numthreads-1; n++)
+            if ( pthread_create(&tids[n],NULL,komodo_DEX_powsearcher,&ps) != 0 )
+                break;
+        if ( n < ps.numthreads-1 ) // stride has to match the threads that actually run
         {
-            h >>= KOMODO_DEX_TXPOWBITS;
-            for (j=0; j<priority; j++,h>>=1)
-                if ( (h & 1) != 0 )
-                    break;
-            if ( j < priority )
-            {
-                //fprintf(stderr,"i.%u j.%d failed priority.%d ulongs[0] %016llx\n",i,j,priority,(long long)hash.ulongs[0]);
-                continue;
-            }
-            if ( i > 10000000 )
-                fprintf(stderr,"nonce calc: i.%u j.%d priority.%d ulongs[0] %016llx\n",i,j,priority,(long long)hash.ulongs[0]);
-            break;
+            ps.found = 1;
+            for (i=0; i<n; i++)
+                pthread_join(tids[i],NULL);
+            ps.found = ps.nextid = 0, ps.numthreads = 1, n = 0;
         }
+        komodo_DEX_powsearcher(&ps);
+        for (i=0; i<n; i++)
+            pthread_join(tids[i],NULL);
+        pthread_mutex_destroy(&ps.mutex);
+        if ( ps.found == 0 )
+            shorthash = komodo_DEXquotehash(hash,&quote[0],len);
+        else hash = ps.hash, shorthash = ps.shorthash;
+        if ( ps.hashes > 10000000 )
+            fprintf(stderr,"nonce calc: hashes.%llu threads.%d priority.%d ulongs[0] %016llx\n",(long long)ps.hashes,ps.numthreads,priority,(long long)hash.ulongs[0]);
+        achieved = komodo_DEX_priority(hash.ulongs[0],len);
+        pthread_mutex_lock(&DEX_powmutex);
+        DEX_powquotes++;
+        DEX_powhashes += ps.hashes;
+        DEX_powmillis += (OS_milliseconds() - startmillis);
+        DEX_powlast = achieved;
+        if ( achieved > DEX_powmax )
+            DEX_powmax = achieved;
+        pthread_mutex_unlock(&DEX_powmutex);
     }
 #else
     iguana_rwnum(1,&quote[len - sizeof(nonce)],sizeof(nonce),&nonce);
@@ -938,29 +1470,98 @@ int32_t komodo_DEXgenquote(uint8_t funcid,int32_t priority,bits256 &hash,uint32_
     return(len);
 }
 
-int32_t komodo_DEXpacketsend(CNode *peer,uint8_t peerpos,struct DEX_datablob *ptr,uint8_t resp0)
+int32_t komodo_DEXpacketsend(CNode *peer,uint8_t peerpos,struct DEX_datablob *ptr,uint8_t resp0) // streams the datablob straight into the send buffer, same wire bytes as a std::vector<uint8_t>
 {
-    std::vector<uint8_t> packet; int32_t i;
+    uint64_t packetlen;
     //fprintf(stderr,"%d packet send %p datalen.%d\n",peer->id,ptr,ptr->datalen);
     if ( ptr->datalen < KOMODO_DEX_ROUTESIZE || ptr->datalen > KOMODO_DEX_MAXPACKETSIZE )
     {
         fprintf(stderr,"illegal datalen.%d\n",ptr->datalen);
         return(-1);
     }
-    packet.resize(ptr->datalen);
-    memcpy(&packet[0],ptr->data,ptr->datalen);
-    packet[0] = resp0;
-    peer->PushMessage("DEX",packet);
+    packetlen = ptr->datalen;
+    peer->PushMessage("DEX",COMPACTSIZE(packetlen),resp0,CFlatData(&ptr->data[1],&ptr->data[ptr->datalen]));
     DEX_totalsent++;
     return(ptr->datalen);
 }
 
+void _komodo_DEX_relayrefill(int64_t &tokens,uint32_t &lasttime,uint32_t now,int64_t bps) // token bucket with at most one second of burst
+{
+    if ( bps <= 0 )
+        return;
+    if ( lasttime == 0 || now > lasttime )
+    {
+        tokens += bps * (lasttime == 0 ? 1 : (now - lasttime));
+        if ( tokens > bps )
+            tokens = bps;
+        lasttime = now;
+    }
+}
+
+void _komodo_DEX_relaydrain(uint32_t now,CNode *peer,uint16_t peerpos,std::vector<struct DEX_datablob *> *relayq)
+{
+    // called with the shard of the time bucket held, before the bucket is pinged so the peer has the pushed datablobs by the time it sees the ping
+    // weighted round robin, each round priority level p pushes up to p+1 datablobs. a send is allowed while a -dexrelaybps budget is positive, so a datablob bigger than the budget goes out on debt instead of blocking the queue
+    // once a budget runs dry the rest is deferred, the peer gets them through the ping that follows
+    struct DEX_datablob *ptr; int32_t p,n,pending=0,budget=1,heads[KOMODO_DEX_RELAYLEVELS]; uint32_t t; size_t i;
+    _komodo_DEX_relayrefill(peer->dexrelaytokens,peer->dexrelaytime,now,KOMODO_DEX_RELAYBPS);
+    _komodo_DEX_relayrefill(DEX_relaytokens,DEX_relaytime,now,KOMODO_DEX_RELAYTOTALBPS);
+    memset(heads,0,sizeof(heads));
+    for (p=0; p<KOMODO_DEX_RELAYLEVELS; p++)
+        pending += relayq[p].size();
+    while ( pending > 0 && budget != 0 )
+    {
+        for (p=KOMODO_DEX_RELAYLEVELS-1; p>=0 && budget!=0; p--)
+        {
+            for (n=0; n<=p && heads[p]<(int32_t)relayq[p].size(); n++)
+            {
+                if ( (KOMODO_DEX_RELAYBPS > 0 && peer->dexrelaytokens <= 0) || (KOMODO_DEX_RELAYTOTALBPS > 0 && DEX_relaytokens <= 0) )
+                {
+                    budget = 0;
+                    break;
+                }
+                ptr = relayq[p][heads[p]++];
+                pending--;
+                komodo_DEXpacketsend(peer,peerpos,ptr,ptr->data[0]);
+                ptr->numsent++;
+                peer->dexrelaytokens -= ptr->datalen;
+                DEX_relaytokens -= ptr->datalen;
+                DEX_relayqueued[p]++;
+                DEX_relaysent[p]++;
+                DEX_relaybytes += ptr->datalen;
+            }
+        }
+    }
+    for (p=0; p<KOMODO_DEX_RELAYLEVELS; p++)
+    {
+        for (i=heads[p]; i<relayq[p].size(); i++)
+        {
+            // a datablob stamped ahead of our clock is queued again next pass, only count it once its relay window closes
+            iguana_rwnum(0,&relayq[p][i]->data[2],sizeof(t),&t);
+            if ( t+KOMODO_DEX_LOCALHEARTBEAT <= now+1 )
+            {
+                DEX_relayqueued[p]++;
+                DEX_relaydeferred[p]++;
+            }
+        }
+    }
+}
+
 int32_t _komodo_DEXmodval(uint32_t now,const int32_t modval,CNode *peer)
 {
     static uint32_t recents[16][KOMODO_DEX_MAXPERSEC],sendbuf[KOMODO_DEX_MAXPING];
-    std::vector<uint8_t> packet; int32_t i,j,n=0,mult,p,vip=0,maxp=0,sum=0; uint16_t peerpos,num[16]; uint8_t priority,relay,funcid,*msg; uint32_t t,h; struct DEX_datablob *ptr=0,*tmp;
+    std::vector<uint8_t> packet; std::vector<struct DEX_datablob *> relayq[KOMODO_DEX_RELAYLEVELS]; struct DEX_ibltcell cells[KOMODO_DEX_IBLTCELLS]; struct DEX_reconpeer *rp = 0; int32_t i,j,n=0,mult,p,vip=0,maxp=0,sum=0,total=0; uint16_t peerpos,num[16]; uint8_t priority,relay,funcid,*msg; uint32_t t,h; struct DEX_datablob *ptr=0,*tmp;
     if ( modval < 0 || modval >= KOMODO_DEX_PURGETIME || (peerpos= _komodo_DEXpeerpos(now,peer->id)) == 0xffff )
         return(-1);
+    if ( KOMODO_DEX_RECON != 0 )
+    {
+        rp = &DEX_reconpeers[peer->id];
+        if ( rp->sent == 0 )
+            _komodo_DEX_reconhello(peer,now,-1);
+        if ( rp->capable == 0 || now < rp->pingonly )
+            rp = 0;
+        else memset(cells,0,sizeof(cells));
+    }
     memset(num,0,sizeof(num));
     HASH_ITER(hh,G->Hashtables[modval],ptr,tmp)
     {
@@ -968,6 +1569,8 @@ int32_t _komodo_DEXmodval(uint32_t now,const int32_t modval,CNode *peer)
         h = ptr->shorthash;
         if ( ptr->datalen >= KOMODO_DEX_ROUTESIZE && ptr->datalen < KOMODO_DEX_MAXPACKETSIZE )
         {
+            if ( rp != 0 )
+                komodo_DEX_ibltinsert(cells,KOMODO_DEX_IBLTCELLS,h,1);
             msg = &ptr->data[0];
             relay = msg[0];
             funcid = msg[1];
@@ -976,8 +1579,8 @@ int32_t _komodo_DEXmodval(uint32_t now,const int32_t modval,CNode *peer)
             {
                 if ( GETBIT(ptr->peermask,peerpos) == 0 || ptr->requested > 0 )
                 {
-                    if ( (p= ptr->priority) >= 16 )
-                        p = 15;
+                    if ( (p= ptr->priority) >= KOMODO_DEX_RELAYLEVELS )
+                        p = KOMODO_DEX_RELAYLEVELS-1;
                     if ( p < 0 )
                     {
                         fprintf(stderr,"unexpected negative priority.%d\n",p);
@@ -1008,8 +1611,7 @@ int32_t _komodo_DEXmodval(uint32_t now,const int32_t modval,CNode *peer)
                         {
                             if ( komodo_DEX_islagging() == 0 )
                             {
-                                komodo_DEXpacketsend(peer,peerpos,ptr,ptr->data[0]);
-                                ptr->numsent++;
+                                relayq[p].push_back(ptr); // sent by _komodo_DEX_relaydrain once the time bucket is scanned
                             }
                         }
                     }
@@ -1017,11 +1619,24 @@ int32_t _komodo_DEXmodval(uint32_t now,const int32_t modval,CNode *peer)
             }
         } else fprintf(stderr,"ptr.%p %08x with illegal size %d\n",ptr,ptr->shorthash,ptr->datalen);
     }
+    _komodo_DEX_relaydrain(now,peer,peerpos,relayq);
     if ( vip != 0 )
     {
         //fprintf(G->fp,"missing vip.%d dexmodval.%d peer.%d n.%d\n",vip,modval,peerpos,n);
         //fflush(G->fp);
     }
+    for (p=0; p<16; p++)
+        total += num[p];
+    if ( rp != 0 && vip == 0 && total >= KOMODO_DEX_RECONMIN ) // requested packets still go out as pings
+    {
+        if ( komodo_DEXgensketch(packet,now,modval,cells,KOMODO_DEX_IBLTCELLS) > 0 )
+        {
+            peer->PushMessage("DEX",packet);
+            DEX_sketches++;
+            DEX_sketchbytes += packet.size();
+        }
+        return(total);
+    }
     for (p=15; p>=0; p--)
     {
         if ( num[p] != 0 )
@@ -1032,13 +1647,21 @@ int32_t _komodo_DEXmodval(uint32_t now,const int32_t modval,CNode *peer)
                 for (n=0; i<num[p]; i+=mult,n++)
                     sendbuf[n] = recents[p][i];
                 if ( komodo_DEXgenping('P',packet,now,modval,sendbuf,n) > 0 )
+                {
                     peer->PushMessage("DEX",packet);
+                    DEX_pings++;
+                    DEX_pingbytes += packet.size();
+                }
                 sum += n;
             }
             else
             {
                 if ( komodo_DEXgenping('P',packet,now,modval,recents[p],num[p]) > 0 )
+                {
                     peer->PushMessage("DEX",packet);
+                    DEX_pings++;
+                    DEX_pingbytes += packet.size();
+                }
                 sum += num[p];
             }
             if ( komodo_DEX_islagging() != 0 )
@@ -1115,7 +1738,10 @@ int32_t komodo_DEX_cancelupdate(struct DEX_datablob *ptr,char *tagA,char *tagB,b
         return(0);
     else
     {
+        struct DEX_index *index;
         ptr->cancelled = cutoff;
+        if ( taga[0] != 0 && tagb[0] != 0 && (index= _DEX_indexsearch(KOMODO_DEX_MAXINDICES-1,0,0,(int8_t)strlen(taga),(uint8_t *)taga,(int8_t)strlen(tagb),(uint8_t *)tagb)) != 0 )
+            _komodo_DEX_bookremove(index,ptr,'X');
         //fprintf(stderr,"(%08x) cancel at %u\n",ptr->shorthash,ptr->cancelled);
         return(1);
     }
@@ -1161,7 +1787,7 @@ int32_t _komodo_DEX_cancelpubkey(char *tagA,char *tagB,uint8_t *cancelkey33,uint
 int32_t _komodo_DEX_locatorsextract(int32_t sendflag,uint32_t shorthash,int32_t modval,int32_t priority)
 {
     static bits256 zero;
-    uint8_t *allocated=0,*decoded; int32_t i,j,n=0,numrequests,newlen=0; bits256 senderpub; uint64_t locator; struct DEX_datablob *refptr,*ptr;
+    uint8_t *allocated=0,*decoded; int32_t i,j,m,n=0,numrequests,newlen=0; bits256 senderpub; uint64_t locator; struct DEX_datablob *refptr,*ptr;
     if ( (refptr= _komodo_DEXfind(modval,shorthash)) == 0 )
         return(-1);
     if ( (decoded= komodo_DEX_datablobdecrypt(&senderpub,&allocated,&newlen,refptr,zero,(char *)"")) != 0 && (newlen & 7) == 0 )
@@ -1172,9 +1798,12 @@ int32_t _komodo_DEX_locatorsextract(int32_t sendflag,uint32_t shorthash,int32_t
         for (i=sizeof(uint64_t),j=0; i<newlen; i+=8,j++)
         {
             iguana_rwnum(0,&decoded[j*8 + 8],sizeof(locator),&locator);
-            if ( (ptr= _komodo_DEXfind((int32_t)(locator >> 32) % KOMODO_DEX_PURGETIME,(uint32_t)locator)) != 0 )
+            m = (int32_t)(locator >> 32) % KOMODO_DEX_PURGETIME;
+            if ( (ptr= _komodo_DEXfind(m,(uint32_t)locator)) != 0 )
             {
+                pthread_mutex_lock(komodo_DEX_shard(m));
                 ptr->requested = numrequests;
+                pthread_mutex_unlock(komodo_DEX_shard(m));
                 //fprintf(stderr,"%u ",ptr->shorthash);
                 n++;
             }
@@ -1234,13 +1863,17 @@ int32_t _komodo_DEX_commandprocessor(struct DEX_datablob *ptr,int32_t addedflag,
                     if ( newlen == 4 )
                     {
                         iguana_rwnum(0,decoded,sizeof(shorthash),&shorthash);
+                        pthread_rwlock_wrlock(&DEX_indexlock);
                         _komodo_DEX_cancelid(shorthash,senderpub,t);
+                        pthread_rwlock_unlock(&DEX_indexlock);
                     }
                     else if ( newlen == 33 && decoded[0] == 0x01 ) // depends on pubkey format
                     {
                         if ( memcmp(&decoded[1],senderpub.bytes,32) == 0 )
                         {
+                            pthread_rwlock_wrlock(&DEX_indexlock);
                             _komodo_DEX_cancelpubkey((char *)"",(char *)"",decoded,t);
+                            pthread_rwlock_unlock(&DEX_indexlock);
                         } else fprintf(stderr,"unexpected payload mismatch senderpub\n");
                     }
                     else if ( newlen < KOMODO_DEX_MAXKEYSIZE )
@@ -1262,7 +1895,9 @@ int32_t _komodo_DEX_commandprocessor(struct DEX_datablob *ptr,int32_t addedflag,
                             memcpy(_tagb,&decoded[2+lenA],lenB);
                             pubkey33[0] = 0x01;
                             memcpy(&pubkey33[1],senderpub.bytes,32);
+                            pthread_rwlock_wrlock(&DEX_indexlock);
                             _komodo_DEX_cancelpubkey(_taga,_tagb,pubkey33,t);
+                            pthread_rwlock_unlock(&DEX_indexlock);
                         } else fprintf(stderr,"skip lenA.%d lenB.%d vs newlen.%d\n",lenA,lenB,newlen);
                     }
                 }
@@ -1274,10 +1909,75 @@ int32_t _komodo_DEX_commandprocessor(struct DEX_datablob *ptr,int32_t addedflag,
     return(newlen);
 }
 
-int32_t _komodo_DEXprocess(uint32_t now,CNode *pfrom,uint8_t *msg,int32_t len)
+struct DEX_rawpacket
+{
+    CNode *pfrom;
+    uint32_t recvtime,shorthash;
+    int32_t priority;
+    bits256 hash;
+    std::vector<uint8_t> msg;
+};
+
+int32_t komodo_DEX_prevalidate(struct DEX_rawpacket *rp) // no lock needed, does the txpow hashing for the quote types
+{
+    int32_t len; uint8_t funcid,*msg;
+    if ( (len= (int32_t)rp->msg.size()) <= KOMODO_DEX_ROUTESIZE+sizeof(uint32_t) || len >= KOMODO_DEX_MAXPACKETSIZE )
+        return(-1);
+    msg = &rp->msg[0];
+    funcid = msg[1];
+    rp->shorthash = 0;
+    rp->priority = 0;
+    memset(rp->hash.bytes,0,sizeof(rp->hash));
+    if ( funcid == 'Q' || funcid == 'X' || funcid == 'R' || funcid == 'A' )
+    {
+        rp->shorthash = komodo_DEXquotehash(rp->hash,msg,len);
+        rp->priority = komodo_DEX_priority(rp->hash.ulongs[0],len);
+        if ( (rp->hash.ulongs[0] & KOMODO_DEX_TXPOWMASK) != (0x777 & KOMODO_DEX_TXPOWMASK) )
+        {
+            static uint32_t count;
+            if ( count++ < 10 )
+                fprintf(stderr,"reject quote due to invalid hash[0] %016llx\n",(long long)rp->hash.ulongs[0]);
+            return(-2);
+        }
+        else if ( rp->priority < 0 )
+        {
+            static uint32_t count;
+            if ( count++ < 10 )
+                fprintf(stderr,"reject quote due to insufficient priority.%d for size.%d, needed %d\n",komodo_DEX_priority(rp->hash.ulongs[0],0),len,komodo_DEX_sizepriority(len));
+            return(-3);
+        }
+    }
+    return(0);
+}
+
+int32_t _komodo_DEX_getmissing(CNode *pfrom,uint32_t now,int32_t m,uint32_t h,uint32_t recentpriority) // 'G' request a shorthash the peer has and we dont, unless it is already pending
+{
+    std::vector<uint8_t> getshorthash; int32_t p,tmpval;
+    if ( DEX_Numpending > KOMODO_DEX_MAXPERSEC )
+        return(0);
+    p = komodo_DEX_countbits(h);
+    if ( p < KOMODO_DEX_VIPLEVEL && komodo_DEX_islagging() != 0 && p < recentpriority ) // adjusts for txpowbits and sizebits
+    {
+        //fprintf(stderr,"skip estimated priority.%d with recent %d\n",komodo_DEX_countbits(h),recentpriority);
+        return(0);
+    }
+    tmpval = komodo_DEXfind32(G->Pendings,(int32_t)(sizeof(G->Pendings)/sizeof(*G->Pendings)),h,0);
+    if ( tmpval < 0 ) //|| (p >= KOMODO_DEX_VIPLEVEL && (rand() % 10)) )
+    {
+        komodo_DEXadd32(G->Pendings,(int32_t)(sizeof(G->Pendings)/sizeof(*G->Pendings)),h);
+        //fprintf(G->fp,">>>> %d/%08x <<<<< ",m,h);
+        DEX_Numpending++;
+        komodo_DEXgenget(getshorthash,now,h,m);
+        pfrom->PushMessage("DEX",getshorthash);
+        return(1);
+    }
+    return(0);
+}
+
+int32_t _komodo_DEXprocess(uint32_t now,CNode *pfrom,uint8_t *msg,int32_t len,bits256 hash,uint32_t h,int32_t priority) // hash, h and priority are from komodo_DEX_prevalidate
 {
     static uint32_t cache[2],pongbuf[KOMODO_DEX_MAXPING];
-    int32_t i,j,ind,m,p,tmpval,haves,offset,flag,modval,lag,priority,addedflag=0; uint16_t n,peerpos; uint32_t t,h; uint8_t funcid,relay=0; bits256 hash; struct DEX_datablob *ptr;
+    int32_t i,j,ind,m,p,tmpval,haves,offset,flag,modval,lag,addedflag=0; uint16_t n,peerpos; uint32_t t; uint8_t funcid,relay=0; struct DEX_datablob *ptr;
     peerpos = _komodo_DEXpeerpos(now,pfrom->id);
     //fprintf(stderr,"peer.%d msg[%d] %c\n",peerpos,len,msg[1]);
     if ( len > KOMODO_DEX_ROUTESIZE+sizeof(uint32_t) && peerpos != 0xffff && len < KOMODO_DEX_MAXPACKETSIZE )
@@ -1289,8 +1989,6 @@ int32_t _komodo_DEXprocess(uint32_t now,CNode *pfrom,uint8_t *msg,int32_t len)
         lag = (now - t);
         if ( lag < 0 )
             lag = 0;
-        h = komodo_DEXquotehash(hash,msg,len);
-        priority = komodo_DEX_priority(hash.ulongs[0],len);
         if ( t > now+KOMODO_DEX_LOCALHEARTBEAT )
         {
             fprintf(stderr,"reject packet from future t.%u vs now.%u\n",t,now);
@@ -1305,24 +2003,14 @@ int32_t _komodo_DEXprocess(uint32_t now,CNode *pfrom,uint8_t *msg,int32_t len)
             DEX_totalrecv++;
             //fprintf(stderr," f.%c t.%u [%d] ",funcid,t,relay);
             //fprintf(G->fp," recv modval.%d from (%s) relay.%d p.%d shorthash.%08x %016llx\n",modval,pfrom->addr.ToString().c_str(),relay,priority,h,(long long)hash.ulongs[0]);
-            if ( (hash.ulongs[0] & KOMODO_DEX_TXPOWMASK) != (0x777 & KOMODO_DEX_TXPOWMASK) )
-            {
-                static uint32_t count;
-                if ( count++ < 10 )
-                    fprintf(stderr,"reject quote due to invalid hash[0] %016llx\n",(long long)hash.ulongs[0]);
-            }
-            else if ( priority < 0 )
-            {
-                static uint32_t count;
-                if ( count++ < 10 )
-                    fprintf(stderr,"reject quote due to insufficient priority.%d for size.%d, needed %d\n",komodo_DEX_priority(hash.ulongs[0],0),len,komodo_DEX_sizepriority(len));
-                
-            }
-            else if ( relay <= KOMODO_DEX_RELAYDEPTH || relay == 0xff )
+            if ( relay <= KOMODO_DEX_RELAYDEPTH || relay == 0xff )
             {
                 if ( (ptr= _komodo_DEXfind(modval,h)) == 0 )
                 {
-                    if ( (ptr= _komodo_DEXadd(now,modval,hash,h,msg,len)) != 0 )
+                    pthread_rwlock_wrlock(&DEX_indexlock);
+                    ptr = _komodo_DEXadd(now,modval,hash,h,msg,len);
+                    pthread_rwlock_unlock(&DEX_indexlock);
+                    if ( ptr != 0 )
                     {
                         addedflag = 1;
                         if ( komodo_DEXfind32(G->Pendings,(int32_t)(sizeof(G->Pendings)/sizeof(*G->Pendings)),h,1) >= 0 )
@@ -1357,7 +2045,9 @@ int32_t _komodo_DEXprocess(uint32_t now,CNode *pfrom,uint8_t *msg,int32_t len)
                 }
                 if ( ptr != 0 )
                 {
+                    pthread_mutex_lock(komodo_DEX_shard(modval));
                     SETBIT(ptr->peermask,peerpos);
+                    pthread_mutex_unlock(komodo_DEX_shard(modval));
                     if ( funcid != 'Q' )
                         _komodo_DEX_commandprocessor(ptr,addedflag,peerpos);
                 }
@@ -1365,7 +2055,6 @@ int32_t _komodo_DEXprocess(uint32_t now,CNode *pfrom,uint8_t *msg,int32_t len)
         }
         else if ( funcid == 'P' || funcid == 'p' )
         {
-            std::vector<uint8_t> getshorthash;
             haves = 0;
             if ( len >= 12 && len < KOMODO_DEX_MAXPING*sizeof(uint32_t)+64 )
             {
@@ -1379,29 +2068,15 @@ int32_t _komodo_DEXprocess(uint32_t now,CNode *pfrom,uint8_t *msg,int32_t len)
                         offset += iguana_rwnum(0,&msg[offset],sizeof(h),&h);
                         if ( (ptr= _komodo_DEXfind(m,h)) != 0 )
                         {
+                            pthread_mutex_lock(komodo_DEX_shard(m));
                             SETBIT(ptr->peermask,peerpos);
+                            pthread_mutex_unlock(komodo_DEX_shard(m));
                             pongbuf[haves++] = h;
                             continue;
                         }
-                        if ( funcid == 'p' || DEX_Numpending > KOMODO_DEX_MAXPERSEC )
+                        if ( funcid == 'p' )
                             continue;
-                        p = komodo_DEX_countbits(h);
-                        if ( p < KOMODO_DEX_VIPLEVEL && komodo_DEX_islagging() != 0 && p < cache[1] ) // adjusts for txpowbits and sizebits
-                        {
-                            //fprintf(stderr,"skip estimated priority.%d with cache[%u %d]\n",komodo_DEX_countbits(h),cache[0],cache[1]);
-                            continue;
-                        }
-                        tmpval = komodo_DEXfind32(G->Pendings,(int32_t)(sizeof(G->Pendings)/sizeof(*G->Pendings)),h,0);
-                        if ( tmpval < 0 ) //|| (p >= KOMODO_DEX_VIPLEVEL && (rand() % 10)) )
-                        {
-                            komodo_DEXadd32(G->Pendings,(int32_t)(sizeof(G->Pendings)/sizeof(*G->Pendings)),h);
-                            //fprintf(G->fp,">>>> %d/%08x <<<<< ",m,h);
-                            if ( tmpval < 0 )
-                                DEX_Numpending++;
-                            komodo_DEXgenget(getshorthash,now,h,m);
-                            pfrom->PushMessage("DEX",getshorthash);
-                            flag++;
-                        }
+                        flag += _komodo_DEX_getmissing(pfrom,now,m,h,cache[1]);
                         //fprintf(G->fp,"%d/%08x ",m,h);
                     }
                     if ( (0) && flag != 0 )
@@ -1419,6 +2094,63 @@ int32_t _komodo_DEXprocess(uint32_t now,CNode *pfrom,uint8_t *msg,int32_t len)
                 }
             } // else banscore this
         }
+        else if ( funcid == 'S' && len >= (int32_t)(KOMODO_DEX_ROUTESIZE+sizeof(uint16_t)+sizeof(int32_t)) )
+        {
+            struct DEX_ibltcell cells[KOMODO_DEX_IBLTCELLS]; struct DEX_reconpeer *rp; struct DEX_datablob *tmp; uint32_t theirs[KOMODO_DEX_IBLTCELLS],ours[KOMODO_DEX_IBLTCELLS]; int32_t ntheirs,nours; uint16_t ncells,count;
+            offset = KOMODO_DEX_ROUTESIZE;
+            offset += iguana_rwnum(0,&msg[offset],sizeof(ncells),&ncells);
+            offset += iguana_rwnum(0,&msg[offset],sizeof(m),&m);
+            rp = &DEX_reconpeers[pfrom->id];
+            if ( ncells == 0 )
+            {
+                if ( m < 0 )
+                {
+                    rp->capable = 1;
+                    if ( KOMODO_DEX_RECON != 0 && rp->sent == 0 )
+                        _komodo_DEX_reconhello(pfrom,now,-1);
+                } else rp->pingonly = now + KOMODO_DEX_RECONBACKOFF;
+            }
+            else if ( KOMODO_DEX_RECON != 0 && ncells <= KOMODO_DEX_IBLTCELLS && (ncells % 3) == 0 && offset+ncells*(sizeof(count)+2*sizeof(uint32_t)) == len && m >= 0 && m < KOMODO_DEX_PURGETIME )
+            {
+                rp->capable = 1;
+                for (i=0; i<ncells; i++)
+                {
+                    offset += iguana_rwnum(0,&msg[offset],sizeof(count),&count);
+                    cells[i].count = (int16_t)count;
+                    offset += iguana_rwnum(0,&msg[offset],sizeof(cells[i].keysum),&cells[i].keysum);
+                    offset += iguana_rwnum(0,&msg[offset],sizeof(cells[i].checksum),&cells[i].checksum);
+                }
+                HASH_ITER(hh,G->Hashtables[m],ptr,tmp)
+                {
+                    if ( ptr->datalen >= KOMODO_DEX_ROUTESIZE && ptr->datalen < KOMODO_DEX_MAXPACKETSIZE )
+                        komodo_DEX_ibltinsert(cells,ncells,ptr->shorthash,-1);
+                }
+                if ( komodo_DEX_ibltpeel(cells,ncells,theirs,ntheirs,ours,nours,KOMODO_DEX_IBLTCELLS) == 0 )
+                {
+                    DEX_reconok++;
+                    for (flag=i=0; i<ntheirs; i++)
+                        flag += _komodo_DEX_getmissing(pfrom,now,m,theirs[i],cache[1]);
+                    DEX_reconfetch += flag;
+                    pthread_mutex_lock(komodo_DEX_shard(m)); // the peer has everything of ours in m except the decoded ones
+                    HASH_ITER(hh,G->Hashtables[m],ptr,tmp)
+                    {
+                        if ( ptr->datalen < KOMODO_DEX_ROUTESIZE || ptr->datalen >= KOMODO_DEX_MAXPACKETSIZE )
+                            continue;
+                        for (i=0; i<nours; i++)
+                            if ( ours[i] == ptr->shorthash )
+                                break;
+                        if ( i == nours )
+                            SETBIT(ptr->peermask,peerpos);
+                    }
+                    pthread_mutex_unlock(komodo_DEX_shard(m));
+                }
+                else
+                {
+                    DEX_reconfail++;
+                    _komodo_DEX_reconhello(pfrom,now,m);
+                }
+            }
+        }
         else if ( funcid == 'G' )
         {
             iguana_rwnum(0,&msg[KOMODO_DEX_ROUTESIZE],sizeof(h),&h);
@@ -1787,7 +2519,10 @@ UniValue komodo_DEXbroadcast(uint64_t *locatorp,uint8_t funcid,char *hexstr,int3
             modval = (timestamp % KOMODO_DEX_PURGETIME);
             if ( (ptr= _komodo_DEXfind(modval,shorthash)) == 0 )
             {
-                if ( (ptr= _komodo_DEXadd(timestamp,modval,hash,shorthash,&packet[0],packet.size())) == 0 )
+                pthread_rwlock_wrlock(&DEX_indexlock);
+                ptr = _komodo_DEXadd(timestamp,modval,hash,shorthash,&packet[0],packet.size());
+                pthread_rwlock_unlock(&DEX_indexlock);
+                if ( ptr == 0 )
                 {
                     char str[65];
                     for (i=0; i<len&&i<64; i++)
@@ -1916,7 +2651,7 @@ int32_t komodo_DEX_ptrfilter(uint64_t &amountA,uint64_t &amountB,struct DEX_data
 
 UniValue _komodo_DEXlist(uint32_t stopat,int32_t minpriority,char *tagA,char *tagB,char *destpub33,char *minA,char *maxA,char *minB,char *maxB,char *stophashstr)
 {
-    UniValue result(UniValue::VOBJ),a(UniValue::VARR);  struct DEX_datablob *ptr; int32_t err,ind,n=0,skipflag; bits256 stophash; struct DEX_index *tips[KOMODO_DEX_MAXINDICES],*index; uint64_t minamountA=0,maxamountA=(1LL<<63),minamountB=0,maxamountB=(1LL<<63),amountA,amountB; int8_t lenA=0,lenB=0,plen=0; uint8_t destpub[33]; uint32_t thislist;
+    UniValue result(UniValue::VOBJ),a(UniValue::VARR);  struct DEX_datablob *ptr; int32_t err,ind,n=0,skipflag; bits256 stophash; struct DEX_index *tips[KOMODO_DEX_MAXINDICES],*index; uint64_t minamountA=0,maxamountA=(1LL<<63),minamountB=0,maxamountB=(1LL<<63),amountA,amountB; int8_t lenA=0,lenB=0,plen=0; uint8_t destpub[33]; std::set<struct DEX_datablob *> seen;
     if ( stophashstr != 0 && is_hexstr(stophashstr,0) == 64 )
         decode_hex(stophash.bytes,32,stophashstr);
     else memset(stophash.bytes,0,32);
@@ -1927,7 +2662,6 @@ UniValue _komodo_DEXlist(uint32_t stopat,int32_t minpriority,char *tagA,char *ta
         result.push_back(Pair((char *)"errcode",err));
         return(result);
     }
-    thislist = komodo_DEX_listid();
     n = 0;
     for (ind=0; ind<KOMODO_DEX_MAXINDICES; ind++)
     {
@@ -1938,9 +2672,8 @@ UniValue _komodo_DEXlist(uint32_t stopat,int32_t minpriority,char *tagA,char *ta
                 if ( (stopat != 0 && komodo_DEX_id(ptr) == stopat) || memcmp(stophash.bytes,ptr->hash.bytes,32) == 0 )
                     break;
                 skipflag = komodo_DEX_ptrfilter(amountA,amountB,ptr,minpriority,lenA,tagA,lenB,tagB,plen,destpub,minamountA,maxamountA,minamountB,maxamountB);
-                if ( skipflag == 0 && ptr->lastlist != thislist )
+                if ( skipflag == 0 && seen.insert(ptr).second != 0 ) // readers run concurrently, so dedup locally
                 {
-                    ptr->lastlist = thislist;
                     //fprintf(stderr,"%u ",ptr->shorthash);
                     a.push_back(komodo_DEX_dataobj(ptr));
                     n++;
@@ -1960,61 +2693,7 @@ UniValue _komodo_DEXlist(uint32_t stopat,int32_t minpriority,char *tagA,char *ta
     return(result);
 }
 
-// orderbook support
-
-static int _cmp_orderbook(const void *a,const void *b) // bids
-{
-    int32_t retval = 0;
-#define ptr_a (*(struct DEX_orderbookentry **)a)->price
-#define ptr_b (*(struct DEX_orderbookentry **)b)->price
-    if ( ptr_b > ptr_a+SMALLVAL )
-        retval = -1;
-    else if ( ptr_b < ptr_a-SMALLVAL )
-        retval = 1;
-    else
-    {
-#undef ptr_a
-#undef ptr_b
-#define ptr_a (*(struct DEX_orderbookentry **)a)->amountA
-#define ptr_b (*(struct DEX_orderbookentry **)b)->amountA
-        //printf("cmp %.8f vs %.8f <- %p %p\n",dstr(ptr_a),dstr(ptr_b),a,b);
-        if ( ptr_b > ptr_a )
-            return(1);
-        else if ( ptr_b < ptr_a )
-            return(-1);
-    }
-    // printf("%.8f vs %.8f -> %d\n",ptr_a,ptr_b,retval);
-    return(retval);
-#undef ptr_a
-#undef ptr_b
-}
-
-static int _revcmp_orderbook(const void *a,const void *b) // asks
-{
-    int32_t retval = 0;
-#define ptr_a (*(struct DEX_orderbookentry **)a)->price
-#define ptr_b (*(struct DEX_orderbookentry **)b)->price
-    if ( ptr_b > ptr_a+SMALLVAL )
-        retval = 1;
-    else if ( ptr_b < ptr_a-SMALLVAL )
-        retval = -1;
-    else
-    {
-#undef ptr_a
-#undef ptr_b
-#define ptr_a (*(struct DEX_orderbookentry **)a)->amountA
-#define ptr_b (*(struct DEX_orderbookentry **)b)->amountA
-        //printf("revcmp %.8f vs %.8f <- %p %p\n",dstr(ptr_a),dstr(ptr_b),a,b);
-        if ( ptr_b > ptr_a )
-            return(1);
-        else if ( ptr_b < ptr_a )
-            return(-1);
-    }
-    // printf("%.8f vs %.8f -> %d\n",ptr_a,ptr_b,retval);
-    return(retval);
-#undef ptr_a
-#undef ptr_b
-}
+// orderbook support, each tagAB index keeps its live quotes in a price ordered set that is updated on add, cancel and purge
 
 UniValue DEX_orderbookjson(struct DEX_orderbookentry *op)
 {
@@ -2039,52 +2718,15 @@ UniValue DEX_orderbookjson(struct DEX_orderbookentry *op)
     return(item);
 }
 
-struct DEX_orderbookentry *DEX_orderbookentry(struct DEX_datablob *ptr,int32_t revflag,char *base,char *rel)
-{
-    struct DEX_orderbookentry *op; uint64_t amountA,amountB; double price = 0.;
-    char taga[KOMODO_DEX_MAXKEYSIZE+1],tagb[KOMODO_DEX_MAXKEYSIZE+1],pubkeystr[67]; uint8_t destpub33[33];
-    if ( komodo_DEX_tagsextract(amountA,amountB,taga,tagb,pubkeystr,destpub33,ptr) == 0 )
-    {
-        if ( strcmp(taga,base) != 0 || strcmp(tagb,rel) != 0 )
-            return(0);
-    }
-    if ( (op= (struct DEX_orderbookentry *)calloc(1,sizeof(*op))) != 0 )
-    {
-        memcpy(op->pubkey33,destpub33,33);
-        iguana_rwnum(0,&ptr->data[KOMODO_DEX_ROUTESIZE],sizeof(amountA),&amountA);
-        iguana_rwnum(0,&ptr->data[KOMODO_DEX_ROUTESIZE + sizeof(amountA)],sizeof(amountB),&amountB);
-        if ( revflag == 0 )
-        {
-            op->amountA = amountA;
-            op->amountB = amountB;
-            if ( amountA != 0 )
-                price = (double)amountB / amountA;
-        }
-        else
-        {
-            op->amountA = amountB;
-            op->amountB = amountA;
-            if ( amountB != 0 )
-                price = (double)amountA / amountB;
-        }
-        op->price = price;
-        iguana_rwnum(0,&ptr->data[2],sizeof(op->timestamp),&op->timestamp);
-        op->hash = ptr->hash;
-        op->shorthash = _komodo_DEXquotehash(ptr->hash,ptr->datalen);
-        op->priority = ptr->priority;
-        
-    }
-    return(op);
-}
-
 UniValue _komodo_DEXorderbook(int32_t revflag,int32_t maxentries,int32_t minpriority,char *tagA,char *tagB,char *destpub33,char *minA,char *maxA,char *minB,char *maxB)
 {
-    UniValue result(UniValue::VOBJ),a(UniValue::VARR); struct DEX_orderbookentry *op; std::vector<struct DEX_orderbookentry *>orders; struct DEX_datablob *ptr; uint32_t thislist; int32_t i,err,ind,n=0,skipflag; struct DEX_index *tips[KOMODO_DEX_MAXINDICES],*index; uint64_t minamountA=0,maxamountA=(1LL<<63),minamountB=0,maxamountB=(1LL<<63),amountA,amountB; int8_t lenA=0,lenB=0,plen=0; uint8_t destpub[33];
+    UniValue a(UniValue::VARR); struct DEX_orderbookentry entry; std::set<struct DEX_bookkey>::iterator it; struct DEX_datablob *ptr; int32_t err,n=0; struct DEX_index *tips[KOMODO_DEX_MAXINDICES],*index; uint64_t minamountA=0,maxamountA=(1LL<<63),minamountB=0,maxamountB=(1LL<<63),amountA,amountB; int8_t lenA=0,lenB=0,plen=0; uint8_t destpub[33];
     if ( maxentries <= 0 )
         maxentries = 10;
     if ( tagA[0] == 0 || tagB[0] == 0 )
     {
         fprintf(stderr,"need both tagA and tagB to specify base/rel for orderbook\n");
+        UniValue result(UniValue::VOBJ);
         result.push_back(Pair((char *)"result",(char *)"error"));
         result.push_back(Pair((char *)"errcode",-13));
         return(result);
@@ -2094,43 +2736,67 @@ UniValue _komodo_DEXorderbook(int32_t revflag,int32_t maxentries,int32_t minprio
         //fprintf(stderr,"couldnt find any\n");
         return(a);
     }
-    thislist = komodo_DEX_listid();
-    n = 0;
-    for (ind=KOMODO_DEX_MAXINDICES-1; ind<KOMODO_DEX_MAXINDICES; ind++) // only need tagABs
+    if ( (index= tips[KOMODO_DEX_MAXINDICES-1]) == 0 || index->book == 0 )
+        return(a);
+    // asks are ascending amountB/amountA, bids come from the reversed tagAB index and that is also ascending amountB/amountA in its own terms
+    for (it=index->book->begin(); it!=index->book->end() && n<maxentries; it++)
     {
-        if ( (index= tips[ind]) != 0 )
+        ptr = it->ptr;
+        if ( ptr->cancelled != 0 || ptr->datalen < KOMODO_DEX_ROUTESIZE )
+            continue;
+        if ( komodo_DEX_ptrfilter(amountA,amountB,ptr,minpriority,lenA,tagA,lenB,tagB,plen,destpub,minamountA,maxamountA,minamountB,maxamountB) == 0 )
         {
-            for (ptr=index->tail; ptr!=0; ptr=ptr->prevs[ind])
-            {
-                skipflag = komodo_DEX_ptrfilter(amountA,amountB,ptr,minpriority,lenA,tagA,lenB,tagB,plen,destpub,minamountA,maxamountA,minamountB,maxamountB);
-                if ( skipflag == 0 && ptr->cancelled == 0 && amountA != 0 && amountB != 0 )
-                {
-                    if ( ptr->lastlist != thislist && (op= DEX_orderbookentry(ptr,revflag,tagA,tagB)) != 0 ) //
-                    {
-                        //fprintf(stderr,"ADD n.%d lastlist.%u vs %u\n",n,ptr->lastlist,thislist);
-                        ptr->lastlist = thislist;
-                        orders.push_back(op);
-                        n++;
-                    } else fprintf(stderr,"skip ptr->lastlist.%u vs thislist.%d\n",ptr->lastlist,thislist);
-                } //else fprintf(stderr,"skipflag.%d cancelled.%u plen.%d amountA %.8f amountB %.8f\n",skipflag,ptr->cancelled,plen,dstr(amountA),dstr(amountB));
-                if ( ptr == index->head )
-                    break;
-            }
+            komodo_DEX_orderbookentryset(&entry,ptr,revflag);
+            a.push_back(DEX_orderbookjson(&entry));
+            n++;
         }
     }
-    if ( n > 0 )
+    return(a);
+}
+
+UniValue _komodo_DEXorderbookchanges(int32_t revflag,uint32_t sinceid,char *tagA,char *tagB)
+{
+    UniValue result(UniValue::VOBJ),a(UniValue::VARR),item; struct DEX_orderbookentry entry; std::deque<struct DEX_bookchange>::iterator it; struct DEX_index *index; int32_t lenA,lenB,reset = 0;
+    lenA = (int32_t)strlen(tagA);
+    lenB = (int32_t)strlen(tagB);
+    if ( lenA == 0 || lenB == 0 || lenA >= KOMODO_DEX_TAGSIZE || lenB >= KOMODO_DEX_TAGSIZE )
     {
-        //fprintf(stderr,"sort %d orders for %s/%s\n",n,tagA,tagB);
-        qsort(&orders[0],n,sizeof(struct DEX_orderbookentry *),revflag != 0 ? _revcmp_orderbook : _cmp_orderbook);
-        for (i=0; i<maxentries&&i<n; i++)
+        result.push_back(Pair((char *)"result",(char *)"error"));
+        result.push_back(Pair((char *)"errcode",-13));
+        return(result);
+    }
+    if ( (index= _DEX_indexsearch(KOMODO_DEX_MAXINDICES-1,0,0,lenA,(uint8_t *)tagA,lenB,(uint8_t *)tagB)) == 0 || index->changes == 0 )
+    {
+        if ( sinceid < (index != 0 ? index->droppedid : DEX_bookfreedid) ) // the pair's changelog was trimmed or released since
+            reset = 1;
+    }
+    else
+    {
+        if ( sinceid < index->droppedid ) // changelog no longer reaches back that far, caller needs a fresh DEX_orderbook
+            reset = 1;
+        else
         {
-            a.push_back(DEX_orderbookjson(orders[i]));
-            free(orders[i]);
+            for (it=index->changes->begin(); it!=index->changes->end(); it++)
+            {
+                if ( it->changeid <= sinceid )
+                    continue;
+                entry = it->entry;
+                if ( revflag != 0 )
+                {
+                    entry.amountA = it->entry.amountB;
+                    entry.amountB = it->entry.amountA;
+                    entry.price = (it->entry.amountB != 0) ? (double)it->entry.amountA / it->entry.amountB : 0.;
+                }
+                item = DEX_orderbookjson(&entry);
+                item.push_back(Pair((char *)"change",it->type == 'A' ? (char *)"add" : (it->type == 'X' ? (char *)"cancel" : (char *)"expire")));
+                item.push_back(Pair((char *)"changeid",(int64_t)it->changeid));
+                a.push_back(item);
+            }
         }
-        for (; i<n; i++)
-            free(orders[i]);
     }
-    return(a);
+    result.push_back(Pair((char *)"reset",reset));
+    result.push_back(Pair((char *)"changes",a));
+    return(result);
 }
 
 // general stats
@@ -2140,7 +2806,8 @@ UniValue komodo_DEX_stats()
     static uint32_t lastadd,lasttime;
     UniValue result(UniValue::VOBJ); char str[65],pubstr[67],logstr[1024],recvaddr[64]; int32_t i,total,histo[64]; uint32_t now,totalhash,d;
     pubkey2addr(recvaddr,NOTARY_PUBKEY33);
-    pthread_mutex_lock(&DEX_globalmutex);
+    pthread_mutex_lock(&DEX_globalmutex); // perf counters and lastadd/lasttime
+    pthread_rwlock_rdlock(&DEX_indexlock);
     now = (uint32_t)time(NULL);
     bits256_str(pubstr+2,DEX_pubkey);
     pubstr[0] = '0';
@@ -2160,7 +2827,7 @@ UniValue komodo_DEX_stats()
         result.push_back(Pair((char *)"progress",(double)DEX_progress/100.));
     memset(histo,0,sizeof(histo));
     totalhash = _komodo_DEXtotal(histo,total);
-    sprintf(logstr,"RAM.%d %08x R.%lld S.%lld A.%lld dup.%lld | L.%lld A.%lld coll.%lld | lag (%.4f %.4f %.4f) err.%lld pend.%lld T/F %lld/%lld | ",total,totalhash,(long long)DEX_totalrecv,(long long)DEX_totalsent,(long long)DEX_totaladd,(long long)DEX_duplicate,(long long)DEX_lookup32,(long long)DEX_add32,(long long)DEX_collision32,DEX_lag,DEX_lag2,DEX_lag3,(long long)DEX_maxlag,(long long)DEX_Numpending,(long long)DEX_truncated,(long long)DEX_freed);
+    sprintf(logstr,"RAM.%d %08x R.%lld S.%lld A.%lld dup.%lld | L.%lld A.%lld coll.%lld | lag (%.4f %.4f %.4f) err.%lld pend.%lld T/F %lld/%lld drop.%lld | ",total,totalhash,(long long)DEX_totalrecv,(long long)DEX_totalsent,(long long)DEX_totaladd,(long long)DEX_duplicate,(long long)DEX_lookup32,(long long)DEX_add32,(long long)DEX_collision32,DEX_lag,DEX_lag2,DEX_lag3,(long long)DEX_maxlag,(long long)DEX_Numpending,(long long)DEX_truncated,(long long)DEX_freed,(long long)DEX_overflow);
     for (i=13; i>=0; i--)
         sprintf(logstr+strlen(logstr),"%.0f ",(double)histo[i]);//1000.*histo[i]/(total+1)); // expected 1 1 2 5 | 10 10 10 10 10 | 10 9 9 7 5
     if ( (d= (now-lasttime)) <= 0 )
@@ -2169,6 +2836,61 @@ UniValue komodo_DEX_stats()
     lasttime = now;
     lastadd = DEX_totaladd;
     result.push_back(Pair((char *)"perfstats",logstr));
+    {
+        UniValue pool(UniValue::VOBJ);
+        pool.push_back(Pair((char *)"slabs",DEX_slabs));
+        pool.push_back(Pair((char *)"bytes",DEX_slabbytes));
+        pool.push_back(Pair((char *)"used",DEX_slabused));
+        pool.push_back(Pair((char *)"datablobs",DEX_slablive));
+        pool.push_back(Pair((char *)"occupancy",DEX_slabbytes != 0 ? (double)DEX_slabused/DEX_slabbytes : 0.));
+        pool.push_back(Pair((char *)"indexes",DEX_indexes));
+        pool.push_back(Pair((char *)"indexchunks",DEX_indexchunks));
+        result.push_back(Pair((char *)"pool",pool));
+    }
+    {
+        UniValue recon(UniValue::VOBJ);
+        recon.push_back(Pair((char *)"pings",DEX_pings));
+        recon.push_back(Pair((char *)"pingbytes",DEX_pingbytes));
+        recon.push_back(Pair((char *)"sketches",DEX_sketches));
+        recon.push_back(Pair((char *)"sketchbytes",DEX_sketchbytes));
+        recon.push_back(Pair((char *)"decoded",DEX_reconok));
+        recon.push_back(Pair((char *)"failed",DEX_reconfail));
+        recon.push_back(Pair((char *)"fetched",DEX_reconfetch));
+        result.push_back(Pair((char *)"recon",recon));
+    }
+    {
+        UniValue pow(UniValue::VOBJ);
+        pthread_mutex_lock(&DEX_powmutex);
+        pow.push_back(Pair((char *)"threads",(int64_t)KOMODO_DEX_POWTHREADS));
+        pow.push_back(Pair((char *)"quotes",DEX_powquotes));
+        pow.push_back(Pair((char *)"hashes",DEX_powhashes));
+        pow.push_back(Pair((char *)"hashrate",DEX_powmillis > 0. ? (1000. * DEX_powhashes) / DEX_powmillis : 0.));
+        pow.push_back(Pair((char *)"lastpriority",(int64_t)DEX_powlast));
+        pow.push_back(Pair((char *)"maxpriority",(int64_t)DEX_powmax));
+        pthread_mutex_unlock(&DEX_powmutex);
+        result.push_back(Pair((char *)"pow",pow));
+    }
+    {
+        UniValue relay(UniValue::VOBJ),levels(UniValue::VARR);
+        relay.push_back(Pair((char *)"peerbps",(int64_t)KOMODO_DEX_RELAYBPS));
+        relay.push_back(Pair((char *)"totalbps",(int64_t)KOMODO_DEX_RELAYTOTALBPS));
+        relay.push_back(Pair((char *)"bytes",DEX_relaybytes));
+        for (i=0; i<KOMODO_DEX_RELAYLEVELS; i++)
+        {
+            if ( DEX_relayqueued[i] != 0 )
+            {
+                UniValue level(UniValue::VOBJ);
+                level.push_back(Pair((char *)"priority",(int64_t)i));
+                level.push_back(Pair((char *)"queued",DEX_relayqueued[i]));
+                level.push_back(Pair((char *)"sent",DEX_relaysent[i]));
+                level.push_back(Pair((char *)"deferred",DEX_relaydeferred[i]));
+                levels.push_back(level);
+            }
+        }
+        relay.push_back(Pair((char *)"levels",levels));
+        result.push_back(Pair((char *)"relay",relay));
+    }
+    pthread_rwlock_unlock(&DEX_indexlock);
     pthread_mutex_unlock(&DEX_globalmutex);
     return(result);
 }
@@ -2185,7 +2907,9 @@ UniValue komodo_DEXcancel(char *pubkeystr,uint32_t shorthash,char *tagA,char *ta
         len = iguana_rwnum(1,&hex[len],sizeof(shorthash),&shorthash);
         {
             pthread_mutex_lock(&DEX_globalmutex);
+            pthread_rwlock_wrlock(&DEX_indexlock);
             _komodo_DEX_cancelid(shorthash,DEX_pubkey,(uint32_t)time(NULL));
+            pthread_rwlock_unlock(&DEX_indexlock);
             pthread_mutex_unlock(&DEX_globalmutex);
         }
     }
@@ -2203,7 +2927,9 @@ UniValue komodo_DEXcancel(char *pubkeystr,uint32_t shorthash,char *tagA,char *ta
         len = 33;
         {
             pthread_mutex_lock(&DEX_globalmutex);
+            pthread_rwlock_wrlock(&DEX_indexlock);
             _komodo_DEX_cancelpubkey((char *)"",(char *)"",pub33,(uint32_t)time(NULL));
+            pthread_rwlock_unlock(&DEX_indexlock);
             pthread_mutex_unlock(&DEX_globalmutex);
         }
     }
@@ -2225,7 +2951,9 @@ UniValue komodo_DEXcancel(char *pubkeystr,uint32_t shorthash,char *tagA,char *ta
         memcpy(&hex[len],tagB,lenB), len += lenB;
         {
             pthread_mutex_lock(&DEX_globalmutex);
+            pthread_rwlock_wrlock(&DEX_indexlock);
             _komodo_DEX_cancelpubkey(tagA,tagB,pub33,(uint32_t)time(NULL));
+            pthread_rwlock_unlock(&DEX_indexlock);
             pthread_mutex_unlock(&DEX_globalmutex);
         }
     }
@@ -2241,39 +2969,65 @@ UniValue komodo_DEXcancel(char *pubkeystr,uint32_t shorthash,char *tagA,char *ta
 UniValue komodo_DEXget(uint32_t shorthash)
 {
     UniValue result;
-    pthread_mutex_lock(&DEX_globalmutex);
+    pthread_rwlock_rdlock(&DEX_indexlock);
     result = _komodo_DEXget(shorthash);
-    pthread_mutex_unlock(&DEX_globalmutex);
+    pthread_rwlock_unlock(&DEX_indexlock);
     return(result);
 }
 
 UniValue komodo_DEXlist(uint32_t stopat,int32_t minpriority,char *tagA,char *tagB,char *destpub33,char *minA,char *maxA,char *minB,char *maxB,char *stophashstr)
 {
     UniValue result;
-    pthread_mutex_lock(&DEX_globalmutex);
+    pthread_rwlock_rdlock(&DEX_indexlock);
     result = _komodo_DEXlist(stopat,minpriority,tagA,tagB,destpub33,minA,maxA,minB,maxB,stophashstr);
-    pthread_mutex_unlock(&DEX_globalmutex);
+    pthread_rwlock_unlock(&DEX_indexlock);
     return(result);
 }
 
 UniValue komodo_DEXorderbook(int32_t revflag,int32_t maxentries,int32_t minpriority,char *tagA,char *tagB,char *destpub33,char *minA,char *maxA,char *minB,char *maxB)
 {
     UniValue result;
-    pthread_mutex_lock(&DEX_globalmutex);
+    pthread_rwlock_rdlock(&DEX_indexlock);
     result = _komodo_DEXorderbook(revflag,maxentries,minpriority,tagA,tagB,destpub33,minA,maxA,minB,maxB);
-    pthread_mutex_unlock(&DEX_globalmutex);
+    pthread_rwlock_unlock(&DEX_indexlock);
+    return(result);
+}
+
+UniValue komodo_DEXorderbookchanges(int32_t revflag,uint32_t sinceid,char *tagA,char *tagB)
+{
+    UniValue result;
+    pthread_rwlock_rdlock(&DEX_indexlock);
+    result = _komodo_DEXorderbookchanges(revflag,sinceid,tagA,tagB);
+    pthread_rwlock_unlock(&DEX_indexlock);
     return(result);
 }
 
-bits256 komodo_DEX_filehash(FILE *fp,uint64_t offset0,uint64_t rlen,char *fname)
+uint32_t komodo_DEX_booklistid()
+{
+    uint32_t listid;
+    pthread_rwlock_rdlock(&DEX_indexlock);
+    listid = DEX_bookchangeid;
+    pthread_rwlock_unlock(&DEX_indexlock);
+    return(listid);
+}
+
+bits256 komodo_DEX_filehash(FILE *fp,uint64_t offset0,uint64_t rlen,char *fname) // streamed, so a big file is never loaded whole
 {
-    bits256 filehash; uint8_t *data = (uint8_t *)calloc(1,rlen);
+    struct sha256_vstate md; bits256 filehash; uint8_t buf[KOMODO_DEX_FILEBUFSIZE * 4]; uint64_t len; int32_t n;
     fseek(fp,offset0,SEEK_SET);
     memset(filehash.bytes,0,sizeof(filehash));
-    if ( fread(data,1,rlen,fp) == rlen )
-        vcalc_sha256(0,filehash.bytes,data,rlen);
-    else fprintf(stderr," reading %lld bytes from %s.%llu\n",(long long)rlen,fname,(long long)offset0);
-    free(data);
+    sha256_vinit(&md);
+    for (len=0; len<rlen; len+=n)
+    {
+        n = (int32_t)((rlen - len) < sizeof(buf) ? (rlen - len) : sizeof(buf));
+        if ( fread(buf,1,n,fp) != n )
+        {
+            fprintf(stderr," reading %lld bytes from %s.%llu\n",(long long)rlen,fname,(long long)offset0);
+            return(filehash);
+        }
+        sha256_vprocess(&md,buf,n);
+    }
+    sha256_vdone(&md,filehash.bytes);
     return(filehash);
 }
 
@@ -2355,28 +3109,34 @@ int32_t komodo_DEX_request(int32_t priority,uint32_t shorthash,uint32_t timestam
     str[1] = '1';
     bits256_str(str+2,DEX_pubkey);
     komodo_DEXbroadcast(0,'R',hexstr,priority+KOMODO_DEX_CMDPRIORITY,tagA,tagB,str,(char *)"",(char *)"");
-    return(_komodo_DEX_locatorsextract(1,shorthash,timestamp % KOMODO_DEX_PURGETIME,priority));
+    pthread_rwlock_rdlock(&DEX_indexlock);
+    n = _komodo_DEX_locatorsextract(1,shorthash,timestamp % KOMODO_DEX_PURGETIME,priority);
+    pthread_rwlock_unlock(&DEX_indexlock);
+    return(n);
 }
 
-int32_t komodo_DEX_locatorsync(int32_t &needrequest,int32_t &written,FILE *fp,uint64_t locator,long offset,bits256 senderpub,char *tagA)
+int32_t komodo_DEX_locatorsync(int32_t &needrequest,int32_t &written,int32_t fd,uint64_t locator,long offset,bits256 senderpub,char *tagA)
 {
-    uint32_t t,h; struct DEX_datablob *fragptr; int32_t fraglen,errflag=0; uint8_t buf[KOMODO_DEX_FILEBUFSIZE];
+    uint32_t t,h; struct DEX_datablob *fragptr; int32_t fraglen=0,errflag=0; uint8_t buf[KOMODO_DEX_FILEBUFSIZE];
     t = locator >> 32;
     h = locator & 0xffffffff;
     {
-        pthread_mutex_lock(&DEX_globalmutex);
-        fragptr = _komodo_DEXfind(t % KOMODO_DEX_PURGETIME,h);
-        pthread_mutex_unlock(&DEX_globalmutex);
+        pthread_rwlock_rdlock(&DEX_indexlock); // held shared across the decrypt so the fragment cant be purged under us
+        if ( (fragptr= _komodo_DEXfind(t % KOMODO_DEX_PURGETIME,h)) != 0 )
+        {
+            if ( (fraglen= komodo_DEX_decryptbuf(buf,sizeof(buf),fragptr,senderpub,(char *)tagA)) <= 0 )
+                fprintf(stderr,"error decrypting into buf for offset of %ld, fraglen.%d datalen.%d h.%u\n",offset,fraglen,fragptr->datalen,h);
+        }
+        pthread_rwlock_unlock(&DEX_indexlock);
     }
     errflag = 0;
     if ( fragptr != 0 )
     {
-        if ( (fraglen= komodo_DEX_decryptbuf(buf,sizeof(buf),fragptr,senderpub,(char *)tagA)) > 0 )
+        if ( fraglen > 0 )
         {
-            fseek(fp,offset,SEEK_SET);
-            if ( fwrite(buf,1,fraglen,fp) != fraglen )
+            if ( pwrite(fd,buf,fraglen,offset) != fraglen )
             {
-                fprintf(stderr,"write error offset %ld %ld\n",offset,ftell(fp));
+                fprintf(stderr,"write error offset %ld\n",offset);
                 errflag = 1;
             }
             else
@@ -2385,11 +3145,7 @@ int32_t komodo_DEX_locatorsync(int32_t &needrequest,int32_t &written,FILE *fp,ui
                 //fprintf(stderr,"write %s:%ld [%d] sizepriority.%d\n",fname,i*sizeof(buf)+offset0,fraglen,komodo_DEX_sizepriority(fragptr->datalen));
             }
         }
-        else
-        {
-            fprintf(stderr,"error decrypting into buf for offset of %ld, fraglen.%d datalen.%d h.%u\n",offset,fraglen,fragptr->datalen,h);
-            errflag = 1;
-        }
+        else errflag = 1;
     }
     else
     {
@@ -2400,6 +3156,79 @@ int32_t komodo_DEX_locatorsync(int32_t &needrequest,int32_t &written,FILE *fp,ui
     return(-errflag);
 }
 
+struct DEX_filesync // shared by the DEX_subscribe fragment workers, locators[] doubles as the resume map: 0 means that fragment is already in the file
+{
+    pthread_mutex_t mutex;
+    uint64_t *locators;
+    bits256 senderpub;
+    char *tagA;
+    int32_t fd,num,next,written,missing,needrequest;
+};
+
+void *komodo_DEX_filesyncer(void *arg)
+{
+    struct DEX_filesync *fs = (struct DEX_filesync *)arg; uint64_t locator; int32_t i,written=0,missing=0,needrequest=0;
+    while ( 1 )
+    {
+        pthread_mutex_lock(&fs->mutex);
+        while ( fs->next < fs->num && fs->locators[fs->next] == 0 )
+            fs->next++;
+        if ( (i= fs->next) < fs->num )
+            fs->next++;
+        pthread_mutex_unlock(&fs->mutex);
+        if ( i >= fs->num )
+            break;
+        locator = fs->locators[i];
+        if ( komodo_DEX_locatorsync(needrequest,written,fs->fd,locator,(long)i*KOMODO_DEX_FILEBUFSIZE,fs->senderpub,fs->tagA) < 0 )
+        {
+            missing++;
+            fs->locators[i] = 0; // each worker only touches the entries it claimed
+        }
+    }
+    pthread_mutex_lock(&fs->mutex);
+    fs->written += written;
+    fs->missing += missing;
+    fs->needrequest |= needrequest;
+    pthread_mutex_unlock(&fs->mutex);
+    return(0);
+}
+
+int32_t komodo_DEX_filesync(int32_t &needrequest,int32_t &written,FILE *fp,uint64_t *locators,uint64_t *prevlocators,int32_t num,uint64_t filesize,bits256 senderpub,char *tagA)
+{
+    struct DEX_filesync fs; pthread_t tids[KOMODO_DEX_FILETHREADS]; uint8_t *had; int32_t i,n,pending=0;
+    had = (uint8_t *)calloc(1,(num >> 3) + 1);
+    for (i=0; i<num; i++)
+    {
+        if ( locators[i] != 0 )
+            pending++;
+        else SETBIT(had,i); // we already had it from previous rpc call
+    }
+    fflush(fp);
+    if ( filesize <= (uint64_t)num*KOMODO_DEX_FILEBUFSIZE && ftruncate(fileno(fp),filesize) != 0 ) // preallocate, fragments then land in any order
+        fprintf(stderr,"couldnt size file to %llu\n",(long long)filesize);
+    memset(&fs,0,sizeof(fs));
+    pthread_mutex_init(&fs.mutex,0);
+    fs.locators = locators;
+    fs.num = num;
+    fs.fd = fileno(fp);
+    fs.senderpub = senderpub;
+    fs.tagA = tagA;
+    for (n=0; n<KOMODO_DEX_FILETHREADS-1 && n<pending-1; n++)
+        if ( pthread_create(&tids[n],NULL,komodo_DEX_filesyncer,&fs) != 0 )
+            break;
+    komodo_DEX_filesyncer(&fs);
+    for (i=0; i<n; i++)
+        pthread_join(tids[i],NULL);
+    pthread_mutex_destroy(&fs.mutex);
+    for (i=0; i<num; i++)
+        if ( GETBIT(had,i) != 0 )
+            locators[i] = prevlocators[i];
+    free(had);
+    written += fs.written;
+    needrequest |= fs.needrequest;
+    return(fs.missing);
+}
+
 UniValue komodo_DEXsubscribe(int32_t &cmpflag,char *origfname,int32_t priority,uint32_t shorthash,char *publisher,int32_t sliceid)
 {
     static uint64_t locators[KOMODO_DEX_MAXPACKETSIZE/sizeof(uint64_t)+1],zero[4];
@@ -2432,7 +3261,7 @@ UniValue komodo_DEXsubscribe(int32_t &cmpflag,char *origfname,int32_t priority,u
         sprintf(tagBstr,"locators");
     }
     {
-        pthread_mutex_lock(&DEX_globalmutex);
+        pthread_rwlock_rdlock(&DEX_indexlock);
         memset(checkhash.bytes,0,sizeof(checkhash));
         if ( (ptr= _komodo_DEX_latestptr(sliceid == 0 ? (char *)"files" : (char *)"slices",origfname,publisher,offset0)) != 0 )
         {
@@ -2463,7 +3292,7 @@ UniValue komodo_DEXsubscribe(int32_t &cmpflag,char *origfname,int32_t priority,u
                     break;
             }
         }
-        pthread_mutex_unlock(&DEX_globalmutex);
+        pthread_rwlock_unlock(&DEX_indexlock);
     }
     if ( ptr == 0 )
     {
@@ -2528,19 +3357,7 @@ UniValue komodo_DEXsubscribe(int32_t &cmpflag,char *origfname,int32_t priority,u
                 fp = fopen(fullfname,(char *)"wb");
             if ( fp != 0 )
             {
-                for (i=0; i<(int32_t)amountB; i++)
-                {
-                    if ( (locator= locators[i]) == 0 ) // we already had it from previous rpc call
-                    {
-                        locators[i] = prevlocators[i];
-                        continue;
-                    }
-                    if ( komodo_DEX_locatorsync(requestflag,written,fp,locator,i*KOMODO_DEX_FILEBUFSIZE,senderpub,(char *)tagA) < 0 )
-                    {
-                        missing++;
-                        locators[i] = 0;
-                    }
-                }
+                missing = komodo_DEX_filesync(requestflag,written,fp,locators,prevlocators,(int32_t)amountB,amountA,senderpub,(char *)tagA);
                 fclose(fp), fp = 0;
                 if ( (fp= fopen(fullfname,"rb")) != 0 )
                 {
@@ -2855,7 +3672,10 @@ UniValue komodo_DEXstream(char *fname,int32_t priority)
         offset0 = ((uint64_t)sliceid - 1) * mult;
         prevsliceid = sliceid;
         sprintf(tagBstr,"%llu",(long long)offset0);
-        if ( (ptr= _komodo_DEX_latestptr(fname,tagBstr,pubkeystr,0)) == 0 )
+        pthread_rwlock_rdlock(&DEX_indexlock);
+        ptr = _komodo_DEX_latestptr(fname,tagBstr,pubkeystr,0);
+        pthread_rwlock_unlock(&DEX_indexlock);
+        if ( ptr == 0 )
         {
             //fprintf(stderr,"sliceid.%d cant find (%s/%s) %s\n",sliceid,fname,tagBstr,pubkeystr);
             break;
@@ -3062,7 +3882,7 @@ UniValue komodo_DEX_notarize(char *coin,int32_t prevheight)
     pubkeystr[1] = '1';
     bits256_str(pubkeystr+2,DEX_pubkey);
     {
-        pthread_mutex_lock(&DEX_globalmutex);
+        pthread_rwlock_rdlock(&DEX_indexlock);
         if ( (ptr= _komodo_DEX_latestptr(coin,(char *)"notarizations",pubkeystr,0)) != 0 )
         {
             if ( (decoded= komodo_DEX_datablobdecrypt(&senderpub,&allocated,&newlen,ptr,DEX_pubkey,coin)) != 0 && newlen == 40 )
@@ -3115,26 +3935,156 @@ UniValue komodo_DEX_notarize(char *coin,int32_t prevheight)
                 free(allocated), allocated = 0;
         }
         //fprintf(stderr,"fname.%s auto search %s %s %s shorthash.%08x sliceid.%d\n",fname,origfname,tagBstr,publisher,shorthash,sliceid);
-         pthread_mutex_unlock(&DEX_globalmutex);
+        pthread_rwlock_unlock(&DEX_indexlock);
     }
     return(result);
 }
 
-void komodo_DEXmsg(CNode *pfrom,std::vector<uint8_t> request) // received a packet during interrupt time
+void komodo_DEX_storeload() // rebuild G->Hashtables and the indices from the -dexstore log, the stored hash is trusted so no txpow hashing is redone
 {
-    int32_t len; std::vector<uint8_t> response; bits256 hash; uint32_t timestamp = (uint32_t)time(NULL);
-    if ( (len= request.size()) > 0 )
+    boost::filesystem::path dirname = GetDataDir() / "DEX"; struct DEX_storerec rec; struct DEX_datablob *ptr; char fname[512]; uint8_t *filedata,*msg; long fpos,filesize; uint32_t seg,now,cutoff,t; int32_t n=0,errs=0; int64_t starttime = time(NULL);
+    if ( boost::filesystem::exists(dirname) == 0 )
+    {
+        boost::filesystem::create_directories(dirname);
+        return;
+    }
+    now = (uint32_t)time(NULL);
+    cutoff = now - KOMODO_DEX_PURGETIME + 6; // same as komodo_DEXpoll
+    boost::filesystem::directory_iterator end;
+    for (boost::filesystem::directory_iterator it(dirname); it!=end; it++) // anything older than the purge window is stale
+    {
+        seg = (uint32_t)atol(it->path().filename().string().c_str());
+        if ( (seg+1) * KOMODO_DEX_STORESEGMENT <= cutoff )
+            boost::filesystem::remove(it->path());
+    }
+    pthread_mutex_lock(&DEX_globalmutex);
+    G->storeloading = 1;
+    for (seg=cutoff/KOMODO_DEX_STORESEGMENT; seg<=now/KOMODO_DEX_STORESEGMENT; seg++)
+    {
+        komodo_DEX_storefname(fname,seg);
+        if ( (filedata= komodo_mapfile(fname,&filesize)) == 0 )
+            continue;
+        for (fpos=0; fpos+(long)sizeof(rec)<=filesize; fpos+=sizeof(rec)+rec.len)
+        {
+            memcpy(&rec,&filedata[fpos],sizeof(rec));
+            if ( rec.magic != KOMODO_DEX_STOREMAGIC || rec.len <= KOMODO_DEX_ROUTESIZE || rec.len >= KOMODO_DEX_MAXPACKETSIZE || fpos+(long)sizeof(rec)+rec.len > filesize )
+            {
+                errs++; // a torn write at the tail, the rest of this file is unusable
+                break;
+            }
+            msg = &filedata[fpos + sizeof(rec)];
+            iguana_rwnum(0,&msg[2],sizeof(t),&t);
+            if ( t <= cutoff || t > now+KOMODO_DEX_LOCALHEARTBEAT )
+                continue;
+            if ( _komodo_DEXfind(t % KOMODO_DEX_PURGETIME,rec.shorthash) != 0 )
+                continue;
+            pthread_rwlock_wrlock(&DEX_indexlock);
+            ptr = _komodo_DEXadd(rec.recvtime,t % KOMODO_DEX_PURGETIME,rec.hash,rec.shorthash,msg,rec.len);
+            pthread_rwlock_unlock(&DEX_indexlock);
+            if ( ptr != 0 )
+            {
+                if ( ptr->data[1] != 'Q' ) // replays cancels in log order
+                    _komodo_DEX_commandprocessor(ptr,1,0);
+                n++;
+            }
+        }
+        komodo_unmapfile(filedata,filesize);
+    }
+    G->storeloading = 0;
+    pthread_mutex_unlock(&DEX_globalmutex);
+    fprintf(stderr,"DEX store loaded %d datablobs, errs.%d in %d seconds\n",n,errs,(int32_t)(time(NULL) - starttime));
+}
+
+void *komodo_DEX_validator(void *arg) // -dexvalidators worker, hashes a batch without any DEX lock then inserts the batch under one DEX_globalmutex hold
+{
+    std::vector<struct DEX_rawpacket *> batch; struct DEX_rawpacket *rp; int32_t i;
+    while ( 1 )
     {
+        pthread_mutex_lock(&DEX_rawmutex);
+        while ( DEX_rawpackets.size() == 0 )
+            pthread_cond_wait(&DEX_rawcond,&DEX_rawmutex);
+        while ( DEX_rawpackets.size() > 0 && batch.size() < KOMODO_DEX_VALIDATEBATCH )
+        {
+            batch.push_back(DEX_rawpackets.front());
+            DEX_rawpackets.pop_front();
+        }
+        pthread_mutex_unlock(&DEX_rawmutex);
+        for (i=0; i<batch.size(); i++)
+        {
+            if ( komodo_DEX_prevalidate(batch[i]) < 0 )
+                batch[i]->msg.clear();
+        }
         pthread_mutex_lock(&DEX_globalmutex);
-        _komodo_DEXprocess(timestamp,pfrom,&request[0],len);
+        for (i=0; i<batch.size(); i++)
+        {
+            rp = batch[i];
+            if ( rp->msg.size() > 0 )
+                _komodo_DEXprocess(rp->recvtime,rp->pfrom,&rp->msg[0],(int32_t)rp->msg.size(),rp->hash,rp->shorthash,rp->priority);
+        }
         pthread_mutex_unlock(&DEX_globalmutex);
+        {
+            LOCK(cs_vNodes);
+            for (i=0; i<batch.size(); i++)
+                batch[i]->pfrom->Release();
+        }
+        for (i=0; i<batch.size(); i++)
+            delete batch[i];
+        batch.clear();
+    }
+    return(0);
+}
+
+void komodo_DEXpeerfinalize(int32_t peerid) // the CNode is being deleted, no queued packet holds a ref to it anymore
+{
+    if ( G == 0 )
+        return;
+    pthread_mutex_lock(&DEX_globalmutex);
+    DEX_reconpeers.erase(peerid);
+    pthread_mutex_unlock(&DEX_globalmutex);
+}
+
+void komodo_DEXmsg(CNode *pfrom,std::vector<uint8_t> request) // received a packet during interrupt time
+{
+    int32_t len; struct DEX_rawpacket *rp; uint32_t timestamp = (uint32_t)time(NULL);
+    if ( (len= request.size()) > 0 )
+    {
+        rp = new DEX_rawpacket();
+        rp->pfrom = pfrom;
+        rp->recvtime = timestamp;
+        rp->msg.swap(request);
+        if ( DEX_numvalidators == 0 )
+        {
+            if ( komodo_DEX_prevalidate(rp) == 0 )
+            {
+                pthread_mutex_lock(&DEX_globalmutex);
+                _komodo_DEXprocess(timestamp,pfrom,&rp->msg[0],len,rp->hash,rp->shorthash,rp->priority);
+                pthread_mutex_unlock(&DEX_globalmutex);
+            }
+            delete rp;
+            return;
+        }
+        pthread_mutex_lock(&DEX_rawmutex);
+        if ( DEX_rawpackets.size() >= KOMODO_DEX_MAXRAWQUEUE ) // gossip will resend it, dont let a burst grow the queue without bound
+        {
+            pthread_mutex_unlock(&DEX_rawmutex);
+            DEX_overflow++;
+            delete rp;
+            return;
+        }
+        {
+            LOCK(cs_vNodes);
+            pfrom->AddRef();
+        }
+        DEX_rawpackets.push_back(rp);
+        pthread_cond_signal(&DEX_rawcond);
+        pthread_mutex_unlock(&DEX_rawmutex);
     }
 }
 
 void komodo_DEXpoll(CNode *pto) // from mainloop polling
 {
     static uint32_t purgetime;
-    std::vector<uint8_t> packet; uint32_t i,now,numiters,shorthash,len,ptime,modval,peerpos;
+    std::vector<uint8_t> packet; uint32_t i,now,numiters,shorthash,len,ptime,modval,peerpos; int32_t n;
     now = (uint32_t)time(NULL);
     ptime = now - KOMODO_DEX_PURGETIME + 6;
     pthread_mutex_lock(&DEX_globalmutex);
@@ -3145,11 +4095,18 @@ void komodo_DEXpoll(CNode *pto) // from mainloop polling
             purgetime = ptime;
         else
         {
+            pthread_rwlock_wrlock(&DEX_indexlock);
             for (; purgetime<ptime; purgetime++)
+            {
                 _komodo_DEXpurge(purgetime);
+                _komodo_DEX_storepurge(purgetime);
+            }
             _komodo_DEX_purgeindices(ptime - 3); // call once at the end
+            pthread_rwlock_unlock(&DEX_indexlock);
         }
         DEX_Numpending *= 0.999; // decay pending to compensate for hashcollision remnants
+        if ( KOMODO_DEX_STORE != 0 )
+            _komodo_DEX_storeflush();
     }
     if ( (now == Got_Recent_Quote && now > pto->dexlastping) || now >= pto->dexlastping+KOMODO_DEX_LOCALHEARTBEAT )
     {
@@ -3161,7 +4118,10 @@ void komodo_DEXpoll(CNode *pto) // from mainloop polling
         for (i=0; i<numiters; i++)
         {
             modval = (now + 1 - i) % KOMODO_DEX_PURGETIME;
-            if ( _komodo_DEXmodval(now,modval,pto) > 0 )
+            pthread_mutex_lock(komodo_DEX_shard(modval));
+            n = _komodo_DEXmodval(now,modval,pto);
+            pthread_mutex_unlock(komodo_DEX_shard(modval));
+            if ( n > 0 )
                 pto->dexlastping = now;
             if ( komodo_DEX_islagging() != 0 && i > KOMODO_DEX_MAXLAG )
                 break;
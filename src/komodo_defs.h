@@ -474,6 +474,9 @@ int32_t komodo_notaries(uint8_t pubkeys[64][33],int32_t height,uint32_t timestam
 char *bitcoin_address(char *coinaddr,uint8_t addrtype,uint8_t *pubkey_or_rmd160,int32_t len);
 int32_t komodo_minerids(uint8_t *minerids,int32_t height,int32_t width);
 int32_t komodo_kvsearch(uint256 *refpubkeyp,int32_t current_height,uint32_t *flagsp,int32_t *heightp,uint8_t value[IGUANA_MAXSCRIPTSIZE],uint8_t *key,int32_t keylen);
+int32_t komodo_kvsearch_pending(uint256 *refpubkeyp,int32_t current_height,uint32_t *flagsp,int32_t *heightp,uint8_t value[IGUANA_MAXSCRIPTSIZE],uint8_t *key,int32_t keylen,uint256 *txidp);
+int32_t komodo_kvprefix(std::vector<struct komodo_kvitem> &items,int32_t current_height,std::string prefix,std::string afterkey,int32_t maxn,int32_t pendingflag);
+void komodo_kvsweep(int32_t height);
 
 uint32_t komodo_blocktime(uint256 hash);
 int32_t komodo_longestchain();
@@ -113,7 +113,9 @@ void komodo_event_undo(struct komodo_state *sp,struct komodo_event *ep)
     switch ( ep->type )
     {
         case KOMODO_EVENT_RATIFY: printf("rewind of ratify, needs to be coded.%d\n",ep->height); break;
-        case KOMODO_EVENT_NOTARIZED: break;
+        case KOMODO_EVENT_NOTARIZED:
+            komodo_notarized_undo(sp,ep->height,((struct komodo_event_notarized *)ep->space)->notarizedheight);
+            break;
         case KOMODO_EVENT_KMDHEIGHT:
             if ( ep->height <= sp->SAVEDHEIGHT )
                 sp->SAVEDHEIGHT = ep->height;
@@ -20,6 +20,10 @@
 #include "cc/CCPrices.h"
 #include "cc/pricesfeed.h"
 
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
 /*#include "secp256k1/include/secp256k1.h"
 #include "secp256k1/include/secp256k1_schnorrsig.h"
 #include "secp256k1/include/secp256k1_musig.h"
@@ -1159,99 +1163,6 @@ const char *komodo_opreturn(int32_t height,uint64_t value,uint8_t *opretbuf,int3
 
 int32_t komodo_parsestatefiledata(struct komodo_state *sp,uint8_t *filedata,long *fposp,long datalen,char *symbol,char *dest);
 
-void komodo_stateind_set(struct komodo_state *sp,uint32_t *inds,int32_t n,uint8_t *filedata,long datalen,char *symbol,char *dest)
-{
-    uint8_t func; long lastK,lastT,lastN,lastV,fpos,lastfpos; int32_t i,count,doissue,iter,numn,numv,numN,numV,numR; uint32_t tmp,prevpos100,offset;
-    count = numR = numN = numV = numn = numv = 0;
-    lastK = lastT = lastN = lastV = -1;
-    for (iter=0; iter<2; iter++)
-    {
-        for (lastfpos=fpos=prevpos100=i=0; i<n; i++)
-        {
-            tmp = inds[i];
-            if ( (i % 100) == 0 )
-                prevpos100 = tmp;
-            else
-            {
-                func = (tmp & 0xff);
-                offset = (tmp >> 8);
-                fpos = prevpos100 + offset;
-                if ( lastfpos >= datalen || (filedata[lastfpos] != func && func != 0) )
-                    printf("i.%d/n.%d lastfpos.%ld >= datalen.%ld or [%d] != func.%d\n",i,n,lastfpos,datalen,filedata[lastfpos],func);
-                else if ( iter == 0 )
-                {
-                    switch ( func )
-                    {
-                        default: case 'P': case 'U': case 'D':
-                            inds[i] &= 0xffffff00;
-                            break;
-                        case 'K':
-                            lastK = lastfpos;
-                            inds[i] &= 0xffffff00;
-                            break;
-                        case 'T':
-                            lastT = lastfpos;
-                            inds[i] &= 0xffffff00;
-                            break;
-                        case 'N':
-                            lastN = lastfpos;
-                            numN++;
-                            break;
-                        case 'V':
-                            lastV = lastfpos;
-                            numV++;
-                            break;
-                        case 'R':
-                            numR++;
-                            break;
-                    }
-                }
-                else
-                {
-                    doissue = 0;
-                    if ( func == 'K' )
-                    {
-                        if ( lastK == lastfpos )
-                            doissue = 1;
-                    }
-                    else if ( func == 'T' )
-                    {
-                        if ( lastT == lastfpos )
-                            doissue = 1;
-                    }
-                    else if ( func == 'N' )
-                    {
-                        if ( numn > numN-128 )
-                            doissue = 1;
-                        numn++;
-                    }
-                    else if ( func == 'V' )
-                    {
-                        if ( KOMODO_PAX != 0 && numv > numV-1440 )
-                            doissue = 1;
-                        numv++;
-                    }
-                    else if ( func == 'R' )
-                        doissue = 1;
-                    if ( doissue != 0 )
-                    {
-                        //printf("issue %c total.%d lastfpos.%ld\n",func,count,lastfpos);
-                        komodo_parsestatefiledata(sp,filedata,&lastfpos,datalen,symbol,dest);
-                        count++;
-                    }
-                }
-            }
-            lastfpos = fpos;
-        }
-    }
-    printf("numR.%d numV.%d numN.%d count.%d\n",numR,numV,numN,count);
-    /*else if ( func == 'K' ) // KMD height: stop after 1st
-    else if ( func == 'T' ) // KMD height+timestamp: stop after 1st
-    else if ( func == 'N' ) // notarization, scan backwards 1440+ blocks;
-    else if ( func == 'V' ) // price feed: can stop after 1440+
-    else if ( func == 'R' ) // opreturn:*/
-}
-
 void *OS_loadfile(char *fname,uint8_t **bufp,long *lenp,long *allocsizep)
 {
     FILE *fp;
@@ -1298,132 +1209,598 @@ uint8_t *OS_fileptr(long *allocsizep,char *fname)
     return((uint8_t *)retptr);
 }
 
-long komodo_stateind_validate(struct komodo_state *sp,char *indfname,uint8_t *filedata,long datalen,uint32_t *prevpos100p,uint32_t *indcounterp,char *symbol,char *dest)
+// komodostate.ind is a versioned index with one komodo_stateind_rec per complete record of the komodostate file, it is revalidated structurally against the mapped file on every start
+// komodostate.snap holds this chains komodo_state as of hdr.statelen, written on clean shutdown so startup only parses the records appended after it
+
+#define KOMODO_STATEIND_MAGIC 0x32444e49 // "IND2"
+#define KOMODO_STATESNAP_MAGIC 0x50414e53 // "SNAP"
+#define KOMODO_STATEIND_VERSION 2
+#define KOMODO_STATEIND_TAILSIZE 4096
+
+struct komodo_stateind_hdr { uint32_t magic,version; uint64_t statelen,numrecs; bits256 tailhash; };
+struct komodo_stateind_rec { uint64_t fpos; int32_t height; uint8_t func,pad[3]; };
+
+int32_t memread(void *dest,int32_t size,uint8_t *filedata,long *fposp,long datalen);
+
+// read only mapping of a whole file (a heap copy on windows), release it with komodo_unmapfile() and never with OS_releasemap()
+uint8_t *komodo_mapfile(char *fname,long *lenp)
 {
-    FILE *fp; long fsize,lastfpos=0,fpos=0; uint8_t *inds,func; int32_t i,n; uint32_t offset,tmp,prevpos100 = 0;
-    *indcounterp = *prevpos100p = 0;
-    if ( (inds= OS_fileptr(&fsize,indfname)) != 0 )
+#ifndef _WIN32
+    int fd; off_t filesize; void *ptr;
+    *lenp = 0;
+    if ( (fd= open(fname,O_RDONLY)) < 0 )
+        return(0);
+    if ( (filesize= lseek(fd,0,SEEK_END)) <= 0 || (ptr= mmap(0,filesize,PROT_READ,MAP_PRIVATE,fd,0)) == MAP_FAILED )
     {
-        lastfpos = 0;
-        fprintf(stderr,"inds.%p validate %s fsize.%ld datalen.%ld n.%d lastfpos.%ld\n",inds,indfname,fsize,datalen,(int32_t)(fsize / sizeof(uint32_t)),lastfpos);
-        if ( (fsize % sizeof(uint32_t)) == 0 )
-        {
-            n = (int32_t)(fsize / sizeof(uint32_t));
-            for (i=0; i<n; i++)
-            {
-                memcpy(&tmp,&inds[i * sizeof(uint32_t)],sizeof(uint32_t));
-                if ( 0 && i > n-10 )
-                    printf("%d: tmp.%08x [%c] prevpos100.%u\n",i,tmp,tmp&0xff,prevpos100);
-                if ( (i % 100) == 0 )
-                    prevpos100 = tmp;
-                else
-                {
-                    func = (tmp & 0xff);
-                    offset = (tmp >> 8);
-                    fpos = prevpos100 + offset;
-                    if ( lastfpos >= datalen || filedata[lastfpos] != func )
-                    {
-                        printf("validate.%d error (%u %d) prev100 %u -> fpos.%ld datalen.%ld [%d] (%c) vs (%c) lastfpos.%ld\n",i,offset,func,prevpos100,fpos,datalen,lastfpos < datalen ? filedata[lastfpos] : -1,func,filedata[lastfpos],lastfpos);
-                        return(-1);
-                    }
-                }
-                lastfpos = fpos;
-            }
-            *indcounterp = n;
-            *prevpos100p = prevpos100;
-            if ( sp != 0 )
-                komodo_stateind_set(sp,(uint32_t *)inds,n,filedata,fpos,symbol,dest);
-            //printf("free inds.%p %s validated[%d] fpos.%ld datalen.%ld, offset %ld vs fsize.%ld\n",inds,indfname,i,fpos,datalen,i * sizeof(uint32_t),fsize);
-            free(inds);
-            return(fpos);
-        } else printf("wrong filesize %s %ld\n",indfname,fsize);
-    }
-    free(inds);
-    fprintf(stderr,"indvalidate return -1\n");
-    return(-1);
+        close(fd);
+        return(0);
+    }
+    close(fd);
+    *lenp = (long)filesize;
+    return((uint8_t *)ptr);
+#else
+    long allocsize; uint8_t *ptr;
+    *lenp = 0;
+    if ( (ptr= OS_fileptr(&allocsize,fname)) != 0 )
+        *lenp = allocsize;
+    return(ptr);
+#endif
 }
 
-long komodo_indfile_update(FILE *indfp,uint32_t *prevpos100p,long lastfpos,long newfpos,uint8_t func,uint32_t *indcounterp)
+void komodo_unmapfile(uint8_t *ptr,long len)
 {
-    uint32_t tmp;
-    if ( indfp != 0 )
+#ifndef _WIN32
+    munmap(ptr,len);
+#else
+    free(ptr);
+#endif
+}
+
+long komodo_staterec_len(uint8_t *filedata,long fpos,long datalen)
+{
+    long len = 1 + sizeof(int32_t); uint16_t olen;
+    if ( fpos+len >= datalen )
+        return(-1);
+    switch ( filedata[fpos] )
+    {
+        case 'P':
+            if ( filedata[fpos+len] > 64 )
+                return(-1);
+            len += 1 + 33 * filedata[fpos+len];
+            break;
+        case 'N': len += sizeof(int32_t) + 2*sizeof(uint256); break;
+        case 'M': len += sizeof(int32_t) + 3*sizeof(uint256) + sizeof(int32_t); break;
+        case 'U': len += 2 + sizeof(uint64_t) + sizeof(uint256); break;
+        case 'K': len += sizeof(int32_t); break;
+        case 'T': len += 2*sizeof(int32_t); break;
+        case 'R':
+            len += sizeof(uint256) + sizeof(uint16_t) + sizeof(uint64_t);
+            if ( fpos+len+(long)sizeof(olen) > datalen )
+                return(-1);
+            memcpy(&olen,&filedata[fpos+len],sizeof(olen));
+            len += sizeof(olen) + olen;
+            break;
+        case 'V':
+            if ( filedata[fpos+len] > 128 )
+                return(-1);
+            len += 1 + sizeof(uint32_t) * filedata[fpos+len];
+            break;
+        default: return(-1);
+    }
+    return(fpos+len <= datalen ? len : -1);
+}
+
+void komodo_stateind_tailhash(bits256 *hashp,uint8_t *filedata,long statelen)
+{
+    long start = (statelen > KOMODO_STATEIND_TAILSIZE) ? statelen - KOMODO_STATEIND_TAILSIZE : 0;
+    vcalc_sha256(0,hashp->bytes,&filedata[start],(int32_t)(statelen - start));
+}
+
+int32_t komodo_stateind_hdrcmp(struct komodo_stateind_hdr *a,struct komodo_stateind_hdr *b)
+{
+    if ( a->version != b->version || a->statelen != b->statelen || a->numrecs != b->numrecs || memcmp(&a->tailhash,&b->tailhash,sizeof(a->tailhash)) != 0 )
+        return(-1);
+    return(0);
+}
+
+long komodo_stateind_validate(struct komodo_stateind_hdr *hdr,uint8_t *inddata,long indlen,uint8_t *filedata,long datalen)
+{
+    struct komodo_stateind_rec *recs; bits256 hash; uint64_t i; long len,fpos = 0; int32_t ht;
+    if ( indlen < (long)sizeof(*hdr) )
+        return(-1);
+    memcpy(hdr,inddata,sizeof(*hdr));
+    if ( hdr->magic != KOMODO_STATEIND_MAGIC || hdr->version != KOMODO_STATEIND_VERSION || hdr->statelen > (uint64_t)datalen || indlen != sizeof(*hdr) + hdr->numrecs*sizeof(*recs) )
+        return(-1);
+    komodo_stateind_tailhash(&hash,filedata,hdr->statelen);
+    if ( memcmp(&hash,&hdr->tailhash,sizeof(hash)) != 0 )
+        return(-1);
+    recs = (struct komodo_stateind_rec *)&inddata[sizeof(*hdr)];
+    for (i=0; i<hdr->numrecs; i++)
     {
-        tmp = ((uint32_t)(newfpos - *prevpos100p) << 8) | (func & 0xff);
-        if ( ftell(indfp)/sizeof(uint32_t) != *indcounterp )
-            printf("indfp fpos %ld -> ind.%ld vs counter.%u\n",ftell(indfp),ftell(indfp)/sizeof(uint32_t),*indcounterp);
-        //fprintf(stderr,"ftell.%ld indcounter.%u lastfpos.%ld newfpos.%ld func.%02x\n",ftell(indfp),*indcounterp,lastfpos,newfpos,func);
-        fwrite(&tmp,1,sizeof(tmp),indfp), (*indcounterp)++;
-        if ( (*indcounterp % 100) == 0 )
+        if ( recs[i].fpos != (uint64_t)fpos || (len= komodo_staterec_len(filedata,fpos,hdr->statelen)) < 0 || filedata[fpos] != recs[i].func )
+            break;
+        memcpy(&ht,&filedata[fpos+1],sizeof(ht));
+        if ( ht != recs[i].height )
+            break;
+        fpos += len;
+    }
+    if ( i != hdr->numrecs || fpos != hdr->statelen )
+    {
+        printf("stateind validate error rec.%llu of %llu fpos.%ld statelen.%llu\n",(long long)i,(long long)hdr->numrecs,fpos,(long long)hdr->statelen);
+        return(-1);
+    }
+    return(fpos);
+}
+
+// indexes the records from hdr->statelen onwards, parsing every record from fpos into sp when it is non-null
+long komodo_stateind_extend(struct komodo_state *sp,char *indfname,struct komodo_stateind_hdr *hdr,uint8_t *filedata,long fpos,long datalen,char *symbol,char *dest)
+{
+    FILE *indfp; struct komodo_stateind_rec rec; long len; int32_t indexing = 1;
+    if ( hdr->numrecs == 0 )
+    {
+        memset(hdr,0,sizeof(*hdr));
+        if ( (indfp= fopen(indfname,"wb")) != 0 )
+            fwrite(hdr,1,sizeof(*hdr),indfp);
+    }
+    else if ( (indfp= fopen(indfname,"rb+")) != 0 )
+        fseek(indfp,sizeof(*hdr) + hdr->numrecs*sizeof(rec),SEEK_SET);
+    while ( fpos < datalen )
+    {
+        if ( (len= komodo_staterec_len(filedata,fpos,datalen)) < 0 && indexing != 0 )
+        {
+            printf("stateind stops indexing at fpos.%ld func.%d datalen.%ld\n",fpos,filedata[fpos],datalen);
+            indexing = 0;
+        }
+        if ( indexing != 0 && indfp != 0 && fpos >= (long)hdr->statelen )
         {
-            *prevpos100p = (uint32_t)newfpos;
-            fwrite(prevpos100p,1,sizeof(*prevpos100p),indfp), (*indcounterp)++;
+            memset(&rec,0,sizeof(rec));
+            rec.fpos = fpos;
+            rec.func = filedata[fpos];
+            memcpy(&rec.height,&filedata[fpos+1],sizeof(rec.height));
+            if ( fwrite(&rec,1,sizeof(rec),indfp) != sizeof(rec) )
+                indexing = 0;
+            else
+            {
+                hdr->numrecs++;
+                hdr->statelen = fpos + len;
+            }
         }
+        if ( sp != 0 )
+        {
+            if ( komodo_parsestatefiledata(sp,filedata,&fpos,datalen,symbol,dest) < 0 )
+                break;
+        }
+        else if ( len < 0 )
+            break;
+        else fpos += len;
     }
-    return(newfpos);
+    if ( indfp != 0 )
+    {
+        hdr->magic = KOMODO_STATEIND_MAGIC;
+        hdr->version = KOMODO_STATEIND_VERSION;
+        komodo_stateind_tailhash(&hdr->tailhash,filedata,hdr->statelen);
+        fseek(indfp,0,SEEK_SET);
+        fwrite(hdr,1,sizeof(*hdr),indfp);
+        fclose(indfp);
+    }
+    return(hdr->statelen);
 }
 
-int32_t komodo_faststateinit(struct komodo_state *sp,char *fname,char *symbol,char *dest)
+// -statethreads=N decodes the komodostate records on N worker threads, in batches that are applied to komodo_state in file order on the calling thread
+
+#define KOMODO_STATEREPLAY_BATCH 4096
+
+struct komodo_staterec
 {
-    FILE *indfp; char indfname[1024]; uint8_t *filedata; long validated=-1,datalen,fpos,lastfpos; uint32_t tmp,prevpos100,indcounter,starttime; int32_t func,finished = 0;
-    starttime = (uint32_t)time(NULL);
-    safecopy(indfname,fname,sizeof(indfname)-4);
-    strcat(indfname,".ind");
-    if ( (filedata= OS_fileptr(&datalen,fname)) != 0 )
+    uint256 notarized_hash,notarized_desttxid,MoM,txid;
+    uint64_t ovalue;
+    uint8_t *data; // pubkeys, opret or pvals, inside the mapped statefile
+    int32_t func,ht,notarized_height,MoMdepth,kheight,ktimestamp,num;
+    uint16_t v,olen;
+};
+
+void komodo_staterec_decode(struct komodo_staterec *rp,uint8_t *filedata,long fpos,long datalen)
+{
+    rp->func = filedata[fpos++];
+    memread(&rp->ht,sizeof(rp->ht),filedata,&fpos,datalen);
+    switch ( rp->func )
     {
-        if ( 1 )//datalen >= (1LL << 32) || GetArg("-genind",0) != 0 || (validated= komodo_stateind_validate(0,indfname,filedata,datalen,&prevpos100,&indcounter,symbol,dest)) < 0 )
-        {
-            lastfpos = fpos = 0;
-            indcounter = prevpos100 = 0;
-            if ( (indfp= fopen(indfname,"wb")) != 0 )
-                fwrite(&prevpos100,1,sizeof(prevpos100),indfp), indcounter++;
-            fprintf(stderr,"processing %s %ldKB, validated.%ld\n",fname,datalen/1024,validated);
-            while ( (func= komodo_parsestatefiledata(sp,filedata,&fpos,datalen,symbol,dest)) >= 0 )
+        case 'P':
+            rp->num = filedata[fpos++];
+            rp->data = &filedata[fpos];
+            break;
+        case 'N': case 'M':
+            memread(&rp->notarized_height,sizeof(rp->notarized_height),filedata,&fpos,datalen);
+            memread(&rp->notarized_hash,sizeof(rp->notarized_hash),filedata,&fpos,datalen);
+            memread(&rp->notarized_desttxid,sizeof(rp->notarized_desttxid),filedata,&fpos,datalen);
+            if ( rp->func == 'M' )
             {
-                lastfpos = komodo_indfile_update(indfp,&prevpos100,lastfpos,fpos,func,&indcounter);
+                memread(&rp->MoM,sizeof(rp->MoM),filedata,&fpos,datalen);
+                memread(&rp->MoMdepth,sizeof(rp->MoMdepth),filedata,&fpos,datalen);
             }
-            if ( indfp != 0 )
+            else
             {
-                fclose(indfp);
-                if ( (fpos= komodo_stateind_validate(0,indfname,filedata,datalen,&prevpos100,&indcounter,symbol,dest)) < 0 )
-                    printf("unexpected komodostate.ind validate failure %s datalen.%ld\n",indfname,datalen);
-                else printf("%s validated fpos.%ld\n",indfname,fpos);
+                memset(&rp->MoM,0,sizeof(rp->MoM));
+                rp->MoMdepth = 0;
             }
-            finished = 1;
-            fprintf(stderr,"took %d seconds to process %s %ldKB\n",(int32_t)(time(NULL)-starttime),fname,datalen/1024);
+            break;
+        case 'K':
+            memread(&rp->kheight,sizeof(rp->kheight),filedata,&fpos,datalen);
+            rp->ktimestamp = 0;
+            break;
+        case 'T':
+            memread(&rp->kheight,sizeof(rp->kheight),filedata,&fpos,datalen);
+            memread(&rp->ktimestamp,sizeof(rp->ktimestamp),filedata,&fpos,datalen);
+            break;
+        case 'R':
+            memread(&rp->txid,sizeof(rp->txid),filedata,&fpos,datalen);
+            memread(&rp->v,sizeof(rp->v),filedata,&fpos,datalen);
+            memread(&rp->ovalue,sizeof(rp->ovalue),filedata,&fpos,datalen);
+            memread(&rp->olen,sizeof(rp->olen),filedata,&fpos,datalen);
+            rp->data = &filedata[fpos];
+            break;
+        case 'V':
+            rp->num = filedata[fpos++];
+            rp->data = &filedata[fpos];
+            break;
+    }
+}
+
+void komodo_eventadd_pubkeys(struct komodo_state *sp,char *symbol,int32_t height,uint8_t num,uint8_t pubkeys[64][33]);
+void komodo_eventadd_notarized(struct komodo_state *sp,char *symbol,int32_t height,char *dest,uint256 notarized_hash,uint256 notarized_desttxid,int32_t notarizedheight,uint256 MoM,int32_t MoMdepth);
+void komodo_eventadd_kmdheight(struct komodo_state *sp,char *symbol,int32_t height,int32_t kmdheight,uint32_t timestamp);
+void komodo_eventadd_opreturn(struct komodo_state *sp,char *symbol,int32_t height,uint256 txid,uint64_t value,uint16_t vout,uint8_t *buf,uint16_t opretlen);
+void komodo_eventadd_pricefeed(struct komodo_state *sp,char *symbol,int32_t height,uint32_t *prices,uint8_t num);
+
+// same effects as komodo_parsestatefiledata() for a complete record
+void komodo_staterec_apply(struct komodo_state *sp,struct komodo_staterec *rp,char *symbol,char *dest)
+{
+    int32_t matched; uint8_t pubkeys[64][33],opret[16384*4]; uint32_t pvals[128];
+    if ( ASSETCHAINS_SYMBOL[0] == 0 && strcmp(symbol,"KMD") == 0 )
+        matched = 1;
+    else matched = (strcmp(symbol,ASSETCHAINS_SYMBOL) == 0);
+    switch ( rp->func )
+    {
+        case 'P':
+            memcpy(pubkeys,rp->data,33 * rp->num);
+            if ( (KOMODO_EXTERNAL_NOTARIES != 0 && matched != 0) || (strcmp(symbol,"KMD") == 0 && KOMODO_EXTERNAL_NOTARIES == 0) )
+                komodo_eventadd_pubkeys(sp,symbol,rp->ht,rp->num,pubkeys);
+            break;
+        case 'N': case 'M':
+            komodo_eventadd_notarized(sp,symbol,rp->ht,dest,rp->notarized_hash,rp->notarized_desttxid,rp->notarized_height,rp->MoM,rp->MoMdepth);
+            break;
+        case 'K': case 'T':
+            komodo_eventadd_kmdheight(sp,symbol,rp->ht,rp->kheight,rp->ktimestamp);
+            break;
+        case 'R':
+            memcpy(opret,rp->data,rp->olen);
+            komodo_eventadd_opreturn(sp,symbol,rp->ht,rp->txid,rp->ovalue,rp->v,opret,rp->olen);
+            break;
+        case 'V':
+            memcpy(pvals,rp->data,sizeof(uint32_t) * rp->num);
+            komodo_eventadd_pricefeed(sp,symbol,rp->ht,pvals,rp->num);
+            break;
+    }
+}
+
+void komodo_staterec_decodebatch(struct komodo_staterec *recs,long *fposs,int32_t n,uint8_t *filedata,long datalen)
+{
+    int32_t i;
+    for (i=0; i<n; i++)
+        komodo_staterec_decode(&recs[i],filedata,fposs[i],datalen);
+}
+
+// the -statethreads decoders of one komodo_statereplay, handed a round of records at a time
+struct komodo_statepool
+{
+    std::mutex mutex; std::condition_variable work,done;
+    struct komodo_staterec *recs; long *fposs; uint8_t *filedata; long datalen;
+    size_t numrecs,nextrec; int32_t generation,busy; bool stop;
+};
+
+void komodo_statepool_worker(struct komodo_statepool *pool)
+{
+    struct komodo_staterec *recs; long *fposs; size_t i,n; int32_t mygen = 0;
+    std::unique_lock<std::mutex> lock(pool->mutex);
+    while ( 1 )
+    {
+        pool->work.wait(lock,[&]{ return(pool->stop || pool->generation != mygen); });
+        if ( pool->stop != 0 )
+            break;
+        mygen = pool->generation;
+        while ( pool->nextrec < pool->numrecs )
+        {
+            i = pool->nextrec;
+            n = std::min((size_t)KOMODO_STATEREPLAY_BATCH,pool->numrecs - i);
+            pool->nextrec += n;
+            recs = &pool->recs[i], fposs = &pool->fposs[i];
+            lock.unlock();
+            komodo_staterec_decodebatch(recs,fposs,(int32_t)n,pool->filedata,pool->datalen);
+            lock.lock();
+        }
+        if ( --pool->busy == 0 )
+            pool->done.notify_one();
+    }
+}
+
+// returns the fpos after the last complete record, anything past it is left to komodo_parsestatefiledata()
+long komodo_statereplay(struct komodo_state *sp,uint8_t *filedata,long fpos,long datalen,int32_t numthreads,char *symbol,char *dest)
+{
+    std::vector<long> fposs; std::vector<struct komodo_staterec> recs[2]; std::vector<std::thread> workers; struct komodo_statepool pool; long len; size_t j,n,round,numrounds,roundsize;
+    while ( fpos < datalen && (len= komodo_staterec_len(filedata,fpos,datalen)) > 0 ) { fposs.push_back(fpos); fpos += len; }
+    n = fposs.size();
+    roundsize = (size_t)numthreads * KOMODO_STATEREPLAY_BATCH;
+    numrounds = (n + roundsize - 1) / roundsize;
+    pool.recs = 0, pool.fposs = 0, pool.filedata = filedata, pool.datalen = datalen;
+    pool.numrecs = pool.nextrec = 0, pool.generation = pool.busy = 0, pool.stop = false;
+    // the workers live for the whole replay and are handed one round at a time
+    for (j=0; j<(size_t)numthreads; j++)
+        workers.push_back(std::thread(komodo_statepool_worker,&pool));
+    for (round=0; round<=numrounds; round++)
+    {
+        // workers decode this round while the previous one is applied
+        std::unique_lock<std::mutex> lock(pool.mutex);
+        pool.done.wait(lock,[&]{ return(pool.busy == 0); });
+        if ( round < numrounds )
+        {
+            std::vector<struct komodo_staterec> &next = recs[round & 1];
+            next.resize(std::min(roundsize,n - round*roundsize));
+            pool.recs = &next[0], pool.fposs = &fposs[round*roundsize];
+            pool.numrecs = next.size(), pool.nextrec = 0;
+            pool.busy = numthreads;
+            pool.generation++;
+            pool.work.notify_all();
         }
-        else if ( validated > 0 )
+        lock.unlock();
+        if ( round > 0 )
         {
-            if ( (indfp= fopen(indfname,"rb+")) != 0 )
+            std::vector<struct komodo_staterec> &cur = recs[(round-1) & 1];
+            for (j=0; j<cur.size(); j++) komodo_staterec_apply(sp,&cur[j],symbol,dest);
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        pool.stop = true;
+        pool.work.notify_all();
+    }
+    for (j=0; j<workers.size(); j++)
+        workers[j].join();
+    return(fpos);
+}
+
+// effects of P, R and V records on global state outside komodo_state, everything else in the snapshotted prefix comes from the snapshot
+void komodo_staterec_sideeffects(uint8_t *filedata,long fpos,long datalen,char *symbol)
+{
+    int32_t ht,num,matched; uint8_t func,pubkeys[64][33],opret[16384*4]; uint16_t olen,v; uint64_t ovalue; uint256 txid; uint32_t pvals[128];
+    func = filedata[fpos++];
+    if ( ASSETCHAINS_SYMBOL[0] == 0 && strcmp(symbol,"KMD") == 0 )
+        matched = 1;
+    else matched = (strcmp(symbol,ASSETCHAINS_SYMBOL) == 0);
+    memread(&ht,sizeof(ht),filedata,&fpos,datalen);
+    if ( func == 'P' )
+    {
+        num = filedata[fpos++];
+        if ( memread(pubkeys,33*num,filedata,&fpos,datalen) == 33*num && ((KOMODO_EXTERNAL_NOTARIES != 0 && matched != 0) || (strcmp(symbol,"KMD") == 0 && KOMODO_EXTERNAL_NOTARIES == 0)) )
+            komodo_notarysinit(ht,pubkeys,num);
+    }
+    else if ( func == 'R' )
+    {
+        memread(&txid,sizeof(txid),filedata,&fpos,datalen);
+        memread(&v,sizeof(v),filedata,&fpos,datalen);
+        memread(&ovalue,sizeof(ovalue),filedata,&fpos,datalen);
+        memread(&olen,sizeof(olen),filedata,&fpos,datalen);
+        if ( memread(opret,olen,filedata,&fpos,datalen) == olen && ASSETCHAINS_SYMBOL[0] != 0 )
+            komodo_opreturn(ht,ovalue,opret,olen,txid,v,symbol);
+    }
+    else if ( func == 'V' )
+    {
+        num = filedata[fpos++];
+        if ( num == 35 && memread(pvals,(int32_t)(sizeof(uint32_t)*num),filedata,&fpos,datalen) == num*sizeof(uint32_t) )
+            komodo_pvals(ht,pvals,num);
+    }
+}
+
+int32_t komodo_statesnap_save(struct komodo_state *sp,char *snapfname,struct komodo_stateind_hdr *hdr)
+{
+    FILE *fp; struct komodo_stateind_hdr snaphdr; int32_t i,errs = 0; uint32_t magic = KOMODO_STATESNAP_MAGIC;
+    if ( (fp= fopen(snapfname,"wb")) == 0 )
+        return(-1);
+    snaphdr = *hdr;
+    snaphdr.magic = KOMODO_STATESNAP_MAGIC;
+    portable_mutex_lock(&komodo_mutex);
+    if ( fwrite(&snaphdr,1,sizeof(snaphdr),fp) != sizeof(snaphdr) )
+        errs++;
+    if ( fwrite(&sp->NOTARIZED_HASH,1,sizeof(sp->NOTARIZED_HASH),fp) != sizeof(sp->NOTARIZED_HASH) )
+        errs++;
+    if ( fwrite(&sp->NOTARIZED_DESTTXID,1,sizeof(sp->NOTARIZED_DESTTXID),fp) != sizeof(sp->NOTARIZED_DESTTXID) )
+        errs++;
+    if ( fwrite(&sp->MoM,1,sizeof(sp->MoM),fp) != sizeof(sp->MoM) )
+        errs++;
+    if ( fwrite(&sp->SAVEDHEIGHT,1,sizeof(sp->SAVEDHEIGHT),fp) != sizeof(sp->SAVEDHEIGHT) )
+        errs++;
+    if ( fwrite(&sp->CURRENT_HEIGHT,1,sizeof(sp->CURRENT_HEIGHT),fp) != sizeof(sp->CURRENT_HEIGHT) )
+        errs++;
+    if ( fwrite(&sp->NOTARIZED_HEIGHT,1,sizeof(sp->NOTARIZED_HEIGHT),fp) != sizeof(sp->NOTARIZED_HEIGHT) )
+        errs++;
+    if ( fwrite(&sp->MoMdepth,1,sizeof(sp->MoMdepth),fp) != sizeof(sp->MoMdepth) )
+        errs++;
+    if ( fwrite(&sp->SAVEDTIMESTAMP,1,sizeof(sp->SAVEDTIMESTAMP),fp) != sizeof(sp->SAVEDTIMESTAMP) )
+        errs++;
+    if ( fwrite(&sp->NUM_NPOINTS,1,sizeof(sp->NUM_NPOINTS),fp) != sizeof(sp->NUM_NPOINTS) )
+        errs++;
+    if ( sp->NUM_NPOINTS > 0 && fwrite(sp->NPOINTS,sizeof(*sp->NPOINTS),sp->NUM_NPOINTS,fp) != sp->NUM_NPOINTS )
+        errs++;
+    if ( fwrite(&sp->Komodo_numevents,1,sizeof(sp->Komodo_numevents),fp) != sizeof(sp->Komodo_numevents) )
+        errs++;
+    for (i=0; i<sp->Komodo_numevents; i++)
+        if ( fwrite(sp->Komodo_events[i],1,sp->Komodo_events[i]->len,fp) != sp->Komodo_events[i]->len )
+            errs++;
+    portable_mutex_unlock(&komodo_mutex);
+    if ( fwrite(&magic,1,sizeof(magic),fp) != sizeof(magic) )
+        errs++;
+    fclose(fp);
+    if ( errs != 0 )
+    {
+        printf("error writing %s errs.%d\n",snapfname,errs);
+        remove(snapfname);
+        return(-1);
+    }
+    return(0);
+}
+
+int32_t komodo_statesnap_load(struct komodo_state *sp,char *snapfname,struct komodo_stateind_hdr *hdr)
+{
+    struct komodo_stateind_hdr snaphdr; struct komodo_event E,*ep,**events = 0; struct notarized_checkpoint *npoints = 0; uint8_t *data; long datalen,fpos = 0;
+    uint256 notarized_hash,notarized_desttxid,MoM; int32_t i,savedheight,currentheight,notarized_height,MoMdepth,numnpoints,numevents = 0,retval = -1; uint32_t savedtimestamp,magic = 0;
+    if ( (data= komodo_mapfile(snapfname,&datalen)) == 0 )
+        return(-1);
+    if ( memread(&snaphdr,sizeof(snaphdr),data,&fpos,datalen) != sizeof(snaphdr) || snaphdr.magic != KOMODO_STATESNAP_MAGIC || komodo_stateind_hdrcmp(&snaphdr,hdr) != 0 )
+    {
+        komodo_unmapfile(data,datalen);
+        return(-1);
+    }
+    if ( memread(&notarized_hash,sizeof(notarized_hash),data,&fpos,datalen) == sizeof(notarized_hash) &&
+         memread(&notarized_desttxid,sizeof(notarized_desttxid),data,&fpos,datalen) == sizeof(notarized_desttxid) &&
+         memread(&MoM,sizeof(MoM),data,&fpos,datalen) == sizeof(MoM) &&
+         memread(&savedheight,sizeof(savedheight),data,&fpos,datalen) == sizeof(savedheight) &&
+         memread(&currentheight,sizeof(currentheight),data,&fpos,datalen) == sizeof(currentheight) &&
+         memread(&notarized_height,sizeof(notarized_height),data,&fpos,datalen) == sizeof(notarized_height) &&
+         memread(&MoMdepth,sizeof(MoMdepth),data,&fpos,datalen) == sizeof(MoMdepth) &&
+         memread(&savedtimestamp,sizeof(savedtimestamp),data,&fpos,datalen) == sizeof(savedtimestamp) &&
+         memread(&numnpoints,sizeof(numnpoints),data,&fpos,datalen) == sizeof(numnpoints) &&
+         numnpoints >= 0 && fpos + (long)(numnpoints * sizeof(*npoints)) <= datalen )
+    {
+        if ( numnpoints > 0 )
+        {
+            npoints = (struct notarized_checkpoint *)malloc(numnpoints * sizeof(*npoints));
+            memread(npoints,(int32_t)(numnpoints * sizeof(*npoints)),data,&fpos,datalen);
+        }
+        if ( memread(&numevents,sizeof(numevents),data,&fpos,datalen) == sizeof(numevents) && numevents >= 0 )
+        {
+            events = (struct komodo_event **)calloc(numevents+1,sizeof(*events));
+            for (i=0; i<numevents; i++)
             {
-                lastfpos = fpos = validated;
-                fprintf(stderr,"datalen.%ld validated %ld -> indcounter %u, prevpos100 %u offset.%d\n",datalen,validated,indcounter,prevpos100,(int32_t)(indcounter * sizeof(uint32_t)));
-                if ( fpos < datalen )
-                {
-                    fseek(indfp,indcounter * sizeof(uint32_t),SEEK_SET);
-                    if ( ftell(indfp) == indcounter * sizeof(uint32_t) )
-                    {
-                        while ( (func= komodo_parsestatefiledata(sp,filedata,&fpos,datalen,symbol,dest)) >= 0 )
-                        {
-                            lastfpos = komodo_indfile_update(indfp,&prevpos100,lastfpos,fpos,func,&indcounter);
-                            if ( lastfpos != fpos )
-                                fprintf(stderr,"unexpected lastfpos.%ld != %ld\n",lastfpos,fpos);
-                        }
-                    }
-                    fclose(indfp);
-                }
-                if ( komodo_stateind_validate(sp,indfname,filedata,datalen,&prevpos100,&indcounter,symbol,dest) < 0 )
-                    printf("unexpected komodostate.ind validate failure %s datalen.%ld\n",indfname,datalen);
-                else
-                {
-                    printf("%s validated updated from validated.%ld to %ld new.[%ld] -> indcounter %u, prevpos100 %u offset.%ld | elapsed %d seconds\n",indfname,validated,fpos,fpos-validated,indcounter,prevpos100,indcounter * sizeof(uint32_t),(int32_t)(time(NULL) - starttime));
-                    finished = 1;
-                }
+                if ( fpos + (long)sizeof(E) > datalen )
+                    break;
+                memcpy(&E,&data[fpos],sizeof(E));
+                if ( E.len < sizeof(E) || fpos + E.len > datalen )
+                    break;
+                ep = (struct komodo_event *)calloc(1,E.len);
+                memread(ep,E.len,data,&fpos,datalen);
+                ep->related = 0;
+                events[i] = ep;
             }
-        } else printf("komodo_faststateinit unexpected case\n");
-        free(filedata);
-        return(finished == 1);
+            if ( i == numevents && memread(&magic,sizeof(magic),data,&fpos,datalen) == sizeof(magic) && magic == KOMODO_STATESNAP_MAGIC && fpos == datalen )
+                retval = 0;
+        }
     }
-    return(-1);
+    komodo_unmapfile(data,datalen);
+    if ( retval < 0 )
+    {
+        if ( events != 0 )
+        {
+            for (i=0; i<numevents; i++)
+                if ( events[i] != 0 )
+                    free(events[i]);
+            free(events);
+        }
+        if ( npoints != 0 )
+            free(npoints);
+        printf("error loading %s\n",snapfname);
+        return(-1);
+    }
+    portable_mutex_lock(&komodo_mutex);
+    sp->NOTARIZED_HASH = notarized_hash;
+    sp->NOTARIZED_DESTTXID = notarized_desttxid;
+    sp->MoM = MoM;
+    sp->SAVEDHEIGHT = savedheight;
+    sp->CURRENT_HEIGHT = currentheight;
+    sp->NOTARIZED_HEIGHT = notarized_height;
+    sp->MoMdepth = MoMdepth;
+    sp->SAVEDTIMESTAMP = savedtimestamp;
+    sp->NPOINTS = npoints;
+    sp->NUM_NPOINTS = numnpoints;
+    sp->last_NPOINTSi = 0;
+    for (i=0; i<numnpoints; i++)
+        komodo_npindex_add(sp,i);
+    sp->Komodo_events = events;
+    sp->Komodo_numevents = numevents;
+    portable_mutex_unlock(&komodo_mutex);
+    return(0);
+}
+
+void komodo_stateind_fnames(char *indfname,char *snapfname,char *fname)
+{
+    safecopy(indfname,fname,1024-4);
+    strcat(indfname,".ind");
+    safecopy(snapfname,fname,1024-5);
+    strcat(snapfname,".snap");
+}
+
+int32_t komodo_faststateinit(struct komodo_state *sp,char *fname,char *symbol,char *dest)
+{
+    char indfname[1024],snapfname[1024]; uint8_t *filedata,*inddata; long datalen,indlen,tailKB,fpos = 0; uint64_t i; uint32_t starttime; struct komodo_stateind_hdr hdr; struct komodo_stateind_rec *recs;
+    starttime = (uint32_t)time(NULL);
+    komodo_stateind_fnames(indfname,snapfname,fname);
+    if ( (filedata= komodo_mapfile(fname,&datalen)) == 0 )
+        return(-1);
+    memset(&hdr,0,sizeof(hdr));
+    if ( (inddata= komodo_mapfile(indfname,&indlen)) != 0 )
+    {
+        if ( komodo_stateind_validate(&hdr,inddata,indlen,filedata,datalen) < 0 )
+        {
+            printf("%s doesnt match %s, regenerating\n",indfname,fname);
+            memset(&hdr,0,sizeof(hdr));
+        }
+        else if ( komodo_statesnap_load(sp,snapfname,&hdr) == 0 )
+        {
+            recs = (struct komodo_stateind_rec *)&inddata[sizeof(hdr)];
+            for (i=0; i<hdr.numrecs; i++)
+                if ( recs[i].func == 'P' || recs[i].func == 'R' || recs[i].func == 'V' )
+                    komodo_staterec_sideeffects(filedata,recs[i].fpos,datalen,symbol);
+            fpos = hdr.statelen;
+            fprintf(stderr,"%s resumed from snapshot at %ldKB of %ldKB\n",fname,fpos/1024,datalen/1024);
+        }
+        komodo_unmapfile(inddata,indlen);
+    }
+    tailKB = (datalen - fpos) / 1024;
+    fprintf(stderr,"processing %s %ldKB\n",fname,tailKB);
+    if ( KOMODO_STATETHREADS > 1 )
+    {
+        fpos = komodo_statereplay(sp,filedata,fpos,datalen,KOMODO_STATETHREADS,symbol,dest);
+        while ( komodo_parsestatefiledata(sp,filedata,&fpos,datalen,symbol,dest) >= 0 )
+            ;
+        komodo_stateind_extend(0,indfname,&hdr,filedata,hdr.statelen,datalen,symbol,dest);
+    }
+    else komodo_stateind_extend(sp,indfname,&hdr,filedata,fpos,datalen,symbol,dest);
+    fprintf(stderr,"took %d seconds to process %s %ldKB\n",(int32_t)(time(NULL)-starttime),fname,tailKB);
+    komodo_unmapfile(filedata,datalen);
+    return(1);
+}
+
+void komodo_statesnapshot()
+{
+    char fname[512],indfname[1024],snapfname[1024],symbol[KOMODO_ASSETCHAIN_MAXLEN],dest[KOMODO_ASSETCHAIN_MAXLEN]; uint8_t *filedata,*inddata; long datalen,indlen; struct komodo_stateind_hdr hdr; struct komodo_state *sp;
+    if ( KOMODO_INITDONE == 0 || KOMODO_NSPV_SUPERLITE || (sp= komodo_stateptr(symbol,dest)) == 0 )
+        return;
+    komodo_statefname(fname,ASSETCHAINS_SYMBOL,(char *)"komodostate");
+    komodo_stateind_fnames(indfname,snapfname,fname);
+    remove(snapfname);
+    if ( (filedata= komodo_mapfile(fname,&datalen)) == 0 )
+        return;
+    memset(&hdr,0,sizeof(hdr));
+    if ( (inddata= komodo_mapfile(indfname,&indlen)) != 0 )
+    {
+        if ( komodo_stateind_validate(&hdr,inddata,indlen,filedata,datalen) < 0 )
+            memset(&hdr,0,sizeof(hdr));
+        komodo_unmapfile(inddata,indlen);
+    }
+    if ( komodo_stateind_extend(0,indfname,&hdr,filedata,hdr.statelen,datalen,symbol,dest) == datalen && hdr.magic == KOMODO_STATEIND_MAGIC )
+    {
+        if ( komodo_statesnap_save(sp,snapfname,&hdr) == 0 )
+            fprintf(stderr,"saved %s at %ldKB\n",snapfname,datalen/1024);
+    }
+    komodo_unmapfile(filedata,datalen);
 }
 
 uint64_t komodo_interestsum();
@@ -1493,6 +1870,9 @@ void komodo_passport_iteration()
                 {
                     fpos = 0;
                     fprintf(stderr,"%s processing %s %ldKB\n",ASSETCHAINS_SYMBOL,fname,datalen/1024);
+                    if ( KOMODO_STATETHREADS > 1 )
+                        fpos = komodo_statereplay(sp,filedata,fpos,datalen,KOMODO_STATETHREADS,symbol,dest);
+                    lastfpos = fpos;
                     while ( komodo_parsestatefiledata(sp,filedata,&fpos,datalen,symbol,dest) >= 0 )
                         lastfpos = fpos;
                     fprintf(stderr,"%s took %d seconds to process %s %ldKB\n",ASSETCHAINS_SYMBOL,(int32_t)(time(NULL)-starttime),fname,datalen/1024);
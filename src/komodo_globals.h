@@ -53,7 +53,7 @@ unsigned int WITNESS_CACHE_SIZE = _COINBASE_MATURITY+10;
 uint256 KOMODO_EARLYTXID;
 
 int32_t KOMODO_MININGTHREADS = -1,IS_KOMODO_NOTARY,IS_STAKED_NOTARY,USE_EXTERNAL_PUBKEY,KOMODO_CHOSEN_ONE,ASSETCHAINS_SEED,KOMODO_ON_DEMAND,KOMODO_EXTERNAL_NOTARIES,KOMODO_PASSPORT_INITDONE,KOMODO_PAX,KOMODO_EXCHANGEWALLET,KOMODO_REWIND,STAKED_ERA,KOMODO_CONNECTING = -1,KOMODO_DEALERNODE,KOMODO_EXTRASATOSHI,ASSETCHAINS_FOUNDERS,ASSETCHAINS_CBMATURITY,KOMODO_NSPV;
-int32_t KOMODO_INSYNC,KOMODO_LASTMINED,prevKOMODO_LASTMINED,KOMODO_CCACTIVATE,KOMODO_DEX_P2P,JUMBLR_PAUSE = 1;
+int32_t KOMODO_INSYNC,KOMODO_LASTMINED,prevKOMODO_LASTMINED,KOMODO_CCACTIVATE,KOMODO_DEX_P2P,KOMODO_DEX_VALIDATORS,KOMODO_DEX_STORE,KOMODO_DEX_RECON,KOMODO_DEX_POWTHREADS,KOMODO_DEX_RELAYBPS,KOMODO_DEX_RELAYTOTALBPS,KOMODO_STATETHREADS,KOMODO_CCPARALLEL,KOMODO_NSPV_CACHEMB,JUMBLR_PAUSE = 1;
 std::string NOTARY_PUBKEY,ASSETCHAINS_NOTARIES,ASSETCHAINS_OVERRIDE_PUBKEY,DONATION_PUBKEY,ASSETCHAINS_SCRIPTPUB,NOTARY_ADDRESS,ASSETCHAINS_SELFIMPORT,ASSETCHAINS_CCLIB;
 uint8_t NOTARY_PUBKEY33[33],ASSETCHAINS_OVERRIDE_PUBKEY33[33],ASSETCHAINS_OVERRIDE_PUBKEYHASH[20],ASSETCHAINS_PUBLIC,ASSETCHAINS_PRIVATE,ASSETCHAINS_TXPOW;
 int8_t ASSETCHAINS_ADAPTIVEPOW;
@@ -126,7 +126,11 @@ int32_t ASSETCHAINS_STAKED_SPLIT_PERCENTAGE;
 std::map <std::int8_t, int32_t> mapHeightEvalActivate;
 
 struct komodo_kv *KOMODO_KV;
-pthread_mutex_t KOMODO_KV_mutex,KOMODO_CC_mutex;
+std::map<std::string,struct komodo_kv *> KOMODO_KVSORTED; // same entries as KOMODO_KV, ordered by key for prefix scans
+std::map<std::string,struct komodo_kvitem> KOMODO_KVPENDING; // latest valid kvupdate per key still in the mempool
+unsigned int KOMODO_KVPENDING_UPDATED;
+pthread_rwlock_t KOMODO_KV_rwlock;
+pthread_mutex_t KOMODO_KVPENDING_mutex,KOMODO_CC_mutex;
 
 #define MAX_CURRENCIES 32
 char CURRENCIES[][8] = { "USD", "EUR", "JPY", "GBP", "AUD", "CAD", "CHF", "NZD", // major currencies
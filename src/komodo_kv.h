@@ -17,6 +17,9 @@
 #define H_KOMODOKV_H
 
 #include "komodo_defs.h"
+#include <map>
+#include <string>
+#include <vector>
 
 int32_t komodo_kvcmp(uint8_t *refvalue,uint16_t refvaluesize,uint8_t *value,uint16_t valuesize)
 {
@@ -53,149 +56,309 @@ uint64_t komodo_kvfee(uint32_t flags,int32_t opretlen,int32_t keylen)
     return(fee);
 }
 
+int32_t komodo_kvdecode(uint16_t *keylenp,uint16_t *valuesizep,int32_t *heightp,uint32_t *flagsp,uint8_t **keyp,uint8_t **valueptrp,uint256 *pubkeyp,uint256 *sigp,uint8_t *opretbuf,int32_t opretlen,uint64_t value)
+{
+    int32_t i,coresize;
+    iguana_rwnum(0,&opretbuf[1],sizeof(*keylenp),keylenp);
+    iguana_rwnum(0,&opretbuf[3],sizeof(*valuesizep),valuesizep);
+    iguana_rwnum(0,&opretbuf[5],sizeof(*heightp),heightp);
+    iguana_rwnum(0,&opretbuf[9],sizeof(*flagsp),flagsp);
+    *keyp = &opretbuf[13];
+    if ( *keylenp+13 > opretlen )
+        return(-1);
+    *valueptrp = &(*keyp)[*keylenp];
+    if ( value < komodo_kvfee(*flagsp,opretlen,*keylenp) )
+        return(-2);
+    coresize = (int32_t)(sizeof(*flagsp)+sizeof(*heightp)+sizeof(*keylenp)+sizeof(*valuesizep)+*keylenp+*valuesizep+1);
+    if ( opretlen != coresize && opretlen != coresize+sizeof(uint256) && opretlen != coresize+2*sizeof(uint256) )
+        return(-3);
+    memset(pubkeyp,0,sizeof(*pubkeyp));
+    memset(sigp,0,sizeof(*sigp));
+    if ( opretlen >= coresize+sizeof(uint256) )
+    {
+        for (i=0; i<32; i++)
+            ((uint8_t *)pubkeyp)[i] = opretbuf[coresize+i];
+    }
+    if ( opretlen == coresize+sizeof(uint256)*2 )
+    {
+        for (i=0; i<32; i++)
+            ((uint8_t *)sigp)[i] = opretbuf[coresize+sizeof(uint256)+i];
+    }
+    return(coresize);
+}
+
+// readers never modify the table, expired entries are skipped here and reclaimed by komodo_kvsweep
 int32_t komodo_kvsearch(uint256 *pubkeyp,int32_t current_height,uint32_t *flagsp,int32_t *heightp,uint8_t value[IGUANA_MAXSCRIPTSIZE],uint8_t *key,int32_t keylen)
 {
-    struct komodo_kv *ptr; int32_t duration,retval = -1;
+    struct komodo_kv *ptr; int32_t retval = -1;
     *heightp = -1;
     *flagsp = 0;
     memset(pubkeyp,0,sizeof(*pubkeyp));
-    portable_mutex_lock(&KOMODO_KV_mutex);
+    pthread_rwlock_rdlock(&KOMODO_KV_rwlock);
     HASH_FIND(hh,KOMODO_KV,key,keylen,ptr);
-    if ( ptr != 0 )
+    if ( ptr != 0 && current_height <= (ptr->height + komodo_kvduration(ptr->flags)) )
+    {
+        *heightp = ptr->height;
+        *flagsp = ptr->flags;
+        memcpy(pubkeyp,&ptr->pubkey,sizeof(*pubkeyp));
+        if ( (retval= ptr->valuesize) > 0 )
+            memcpy(value,ptr->value,retval);
+    } //else fprintf(stderr,"couldnt find (%s)\n",(char *)key);
+    pthread_rwlock_unlock(&KOMODO_KV_rwlock);
+    return(retval);
+}
+
+void komodo_kvfree(struct komodo_kv *ptr)
+{
+    if ( ptr->value != 0 )
+        free(ptr->value);
+    if ( ptr->key != 0 )
+        free(ptr->key);
+    free(ptr);
+}
+
+// frees entries that expired more than a day before height, at most once every KOMODO_KVSWEEP_INTERVAL blocks
+#define KOMODO_KVSWEEP_INTERVAL 60
+void komodo_kvsweep(int32_t height)
+{
+    static int32_t lastheight;
+    struct komodo_kv *ptr,*tmp; int32_t n = 0;
+    if ( KOMODO_INITDONE == 0 || height <= 0 || (lastheight != 0 && height < lastheight+KOMODO_KVSWEEP_INTERVAL && height >= lastheight) )
+        return;
+    lastheight = height;
+    pthread_rwlock_rdlock(&KOMODO_KV_rwlock);
+    HASH_ITER(hh,KOMODO_KV,ptr,tmp)
     {
-        duration = komodo_kvduration(ptr->flags);
-        //fprintf(stderr,"duration.%d flags.%d current.%d ht.%d keylen.%d valuesize.%d\n",duration,ptr->flags,current_height,ptr->height,ptr->keylen,ptr->valuesize);
-        if ( current_height > (ptr->height + duration) )
+        if ( height > ptr->height + komodo_kvduration(ptr->flags) + KOMODO_KVDURATION )
+            n++;
+    }
+    pthread_rwlock_unlock(&KOMODO_KV_rwlock);
+    if ( n == 0 )
+        return;
+    n = 0;
+    pthread_rwlock_wrlock(&KOMODO_KV_rwlock);
+    HASH_ITER(hh,KOMODO_KV,ptr,tmp)
+    {
+        if ( height > ptr->height + komodo_kvduration(ptr->flags) + KOMODO_KVDURATION )
         {
+            KOMODO_KVSORTED.erase(std::string((char *)ptr->key,ptr->keylen));
             HASH_DELETE(hh,KOMODO_KV,ptr);
-            if ( ptr->value != 0 )
-                free(ptr->value);
-            if ( ptr->key != 0 )
-                free(ptr->key);
-            free(ptr);
+            komodo_kvfree(ptr);
+            n++;
         }
-        else
+    }
+    pthread_rwlock_unlock(&KOMODO_KV_rwlock);
+    //fprintf(stderr,"komodo_kvsweep ht.%d freed %d expired keys\n",height,n);
+}
+
+// rebuilds the mempool overlay when the mempool changed, the caller holds KOMODO_KVPENDING_mutex
+void komodo_kvpending_update(int32_t current_height)
+{
+    static uint256 zeroes;
+    uint32_t flags,refflags; uint256 pubkey,refpubkey,sig; int32_t i,j,len,opretlen,height,refheight,refvaluesize; uint16_t keylen,valuesize; uint8_t *script,*key,*valueptr,keyvalue[IGUANA_MAXSCRIPTSIZE*8]; struct komodo_kvitem item;
+    if ( KOMODO_KVPENDING_UPDATED == mempool.GetTransactionsUpdated() )
+        return;
+    KOMODO_KVPENDING.clear();
+    LOCK(mempool.cs);
+    KOMODO_KVPENDING_UPDATED = mempool.GetTransactionsUpdated();
+    BOOST_FOREACH(const CTxMemPoolEntry &e,mempool.mapTx)
+    {
+        const CTransaction &tx = e.GetTx();
+        for (j=0; j<tx.vout.size(); j++)
         {
-            *heightp = ptr->height;
-            *flagsp = ptr->flags;
-            int32_t i; for (i=0; i<32; i++)
+            script = (uint8_t *)&tx.vout[j].scriptPubKey[0];
+            if ( (len= (int32_t)tx.vout[j].scriptPubKey.size()) < 3 || script[0] != 0x6a )
+                continue;
+            i = 1;
+            if ( (opretlen= script[i++]) == 0x4c )
+                opretlen = script[i++];
+            else if ( opretlen == 0x4d )
+            {
+                opretlen = script[i++];
+                opretlen += (script[i++] << 8);
+            }
+            if ( i+opretlen > len || opretlen == 40 || script[i] != 'K' )
+                continue;
+            if ( komodo_kvdecode(&keylen,&valuesize,&height,&flags,&key,&valueptr,&pubkey,&sig,&script[i],opretlen,tx.vout[j].nValue) < 0 )
+                continue;
+            memcpy(keyvalue,key,keylen);
+            if ( (refvaluesize= komodo_kvsearch(&refpubkey,current_height,&refflags,&refheight,&keyvalue[keylen],key,keylen)) >= 0 )
             {
-                //printf("%02x",((uint8_t *)&ptr->pubkey)[31-i]);
-                ((uint8_t *)pubkeyp)[i] = ((uint8_t *)&ptr->pubkey)[31-i];
+                if ( (refflags & KOMODO_KVPROTECTED) != 0 )
+                    continue;
+                if ( memcmp(&zeroes,&refpubkey,sizeof(refpubkey)) != 0 && komodo_kvsigverify(keyvalue,keylen+refvaluesize,refpubkey,sig) < 0 )
+                    continue;
             }
-            //printf(" ptr->pubkey\n");
-            memcpy(pubkeyp,&ptr->pubkey,sizeof(*pubkeyp));
-            if ( (retval= ptr->valuesize) > 0 )
-                memcpy(value,ptr->value,retval);
+            item.key.assign((char *)key,keylen);
+            std::map<std::string,struct komodo_kvitem>::iterator it = KOMODO_KVPENDING.find(item.key);
+            if ( it != KOMODO_KVPENDING.end() && it->second.height > height )
+                continue;
+            item.value.assign(valueptr,valueptr+valuesize);
+            memcpy(&item.pubkey,&pubkey,sizeof(item.pubkey));
+            item.txid = tx.GetHash();
+            item.height = height;
+            item.flags = flags;
+            item.pending = 1;
+            KOMODO_KVPENDING[item.key] = item;
         }
-    } //else fprintf(stderr,"couldnt find (%s)\n",(char *)key);
-    portable_mutex_unlock(&KOMODO_KV_mutex);
-    if ( retval < 0 )
+    }
+}
+
+// like komodo_kvsearch but a valid kvupdate waiting in the mempool overrides the confirmed value
+int32_t komodo_kvsearch_pending(uint256 *pubkeyp,int32_t current_height,uint32_t *flagsp,int32_t *heightp,uint8_t value[IGUANA_MAXSCRIPTSIZE],uint8_t *key,int32_t keylen,uint256 *txidp)
+{
+    int32_t retval = -1;
+    memset(txidp,0,sizeof(*txidp));
+    if ( ASSETCHAINS_SYMBOL[0] == 0 )
+        return(komodo_kvsearch(pubkeyp,current_height,flagsp,heightp,value,key,keylen));
+    portable_mutex_lock(&KOMODO_KVPENDING_mutex);
+    komodo_kvpending_update(current_height);
+    std::map<std::string,struct komodo_kvitem>::iterator it = KOMODO_KVPENDING.find(std::string((char *)key,keylen));
+    if ( it != KOMODO_KVPENDING.end() )
     {
-        // search rawmempool
+        *heightp = it->second.height;
+        *flagsp = it->second.flags;
+        memcpy(pubkeyp,&it->second.pubkey,sizeof(*pubkeyp));
+        *txidp = it->second.txid;
+        if ( (retval= (int32_t)it->second.value.size()) > 0 )
+            memcpy(value,&it->second.value[0],retval);
     }
+    portable_mutex_unlock(&KOMODO_KVPENDING_mutex);
+    if ( retval < 0 )
+        retval = komodo_kvsearch(pubkeyp,current_height,flagsp,heightp,value,key,keylen);
     return(retval);
 }
 
+// returns up to maxn live keys starting with prefix and sorting after afterkey, optionally overlaid with the mempool
+int32_t komodo_kvprefix(std::vector<struct komodo_kvitem> &items,int32_t current_height,std::string prefix,std::string afterkey,int32_t maxn,int32_t pendingflag)
+{
+    std::map<std::string,struct komodo_kvitem> merged; struct komodo_kvitem item; struct komodo_kv *ptr; int32_t n = 0;
+    std::string start = (afterkey.size() > 0 && afterkey > prefix) ? afterkey : prefix;
+    items.clear();
+    if ( maxn <= 0 )
+        return(0);
+    pthread_rwlock_rdlock(&KOMODO_KV_rwlock);
+    for (std::map<std::string,struct komodo_kv *>::iterator it=KOMODO_KVSORTED.lower_bound(start); it!=KOMODO_KVSORTED.end() && n < maxn; it++)
+    {
+        if ( it->first.compare(0,prefix.size(),prefix) != 0 )
+            break;
+        ptr = it->second;
+        if ( it->first == afterkey || current_height > ptr->height + komodo_kvduration(ptr->flags) )
+            continue;
+        item.key = it->first;
+        item.value.assign(ptr->value,ptr->value+ptr->valuesize);
+        memcpy(&item.pubkey,&ptr->pubkey,sizeof(item.pubkey));
+        item.txid.SetNull();
+        item.height = ptr->height;
+        item.flags = ptr->flags;
+        item.pending = 0;
+        merged[item.key] = item;
+        n++;
+    }
+    pthread_rwlock_unlock(&KOMODO_KV_rwlock);
+    if ( pendingflag != 0 && ASSETCHAINS_SYMBOL[0] != 0 )
+    {
+        n = 0;
+        portable_mutex_lock(&KOMODO_KVPENDING_mutex);
+        komodo_kvpending_update(current_height);
+        for (std::map<std::string,struct komodo_kvitem>::iterator it=KOMODO_KVPENDING.lower_bound(start); it!=KOMODO_KVPENDING.end() && n < maxn; it++)
+        {
+            if ( it->first.compare(0,prefix.size(),prefix) != 0 )
+                break;
+            if ( it->first == afterkey )
+                continue;
+            merged[it->first] = it->second;
+            n++;
+        }
+        portable_mutex_unlock(&KOMODO_KVPENDING_mutex);
+    }
+    for (std::map<std::string,struct komodo_kvitem>::iterator it=merged.begin(); it!=merged.end() && items.size() < maxn; it++)
+        items.push_back(it->second);
+    return((int32_t)items.size());
+}
+
 void komodo_kvupdate(uint8_t *opretbuf,int32_t opretlen,uint64_t value)
 {
     static uint256 zeroes;
-    uint32_t flags; uint256 pubkey,refpubkey,sig; int32_t i,refvaluesize,hassig,coresize,haspubkey,height,kvheight; uint16_t keylen,valuesize,newflag = 0; uint8_t *key,*valueptr,keyvalue[IGUANA_MAXSCRIPTSIZE*8]; struct komodo_kv *ptr; char *transferpubstr,*tstr; uint64_t fee;
+    uint32_t flags; uint256 pubkey,refpubkey,sig; int32_t i,refvaluesize,coresize,height,kvheight; uint16_t keylen,valuesize,newflag = 0; uint8_t *key,*valueptr,keyvalue[IGUANA_MAXSCRIPTSIZE*8]; struct komodo_kv *ptr; char *transferpubstr,*tstr;
     if ( ASSETCHAINS_SYMBOL[0] == 0 ) // disable KV for KMD
         return;
-    iguana_rwnum(0,&opretbuf[1],sizeof(keylen),&keylen);
-    iguana_rwnum(0,&opretbuf[3],sizeof(valuesize),&valuesize);
-    iguana_rwnum(0,&opretbuf[5],sizeof(height),&height);
-    iguana_rwnum(0,&opretbuf[9],sizeof(flags),&flags);
-    key = &opretbuf[13];
-    if ( keylen+13 > opretlen )
+    if ( (coresize= komodo_kvdecode(&keylen,&valuesize,&height,&flags,&key,&valueptr,&pubkey,&sig,opretbuf,opretlen,value)) < 0 )
     {
-        static uint32_t counter;
-        if ( ++counter < 1 )
-            fprintf(stderr,"komodo_kvupdate: keylen.%d + 13 > opretlen.%d, this can be ignored\n",keylen,opretlen);
+        if ( coresize == -1 )
+        {
+            static uint32_t counter;
+            if ( ++counter < 1 )
+                fprintf(stderr,"komodo_kvupdate: keylen.%d + 13 > opretlen.%d, this can be ignored\n",keylen,opretlen);
+        }
+        else if ( coresize == -2 )
+            fprintf(stderr,"not enough fee\n");
+        else fprintf(stderr,"KV update size mismatch %d vs %d\n",opretlen,(int32_t)(13+keylen+valuesize));
         return;
     }
-    valueptr = &key[keylen];
-    fee = komodo_kvfee(flags,opretlen,keylen);
-    //fprintf(stderr,"fee %.8f vs %.8f flags.%d keylen.%d valuesize.%d height.%d (%02x %02x %02x) (%02x %02x %02x)\n",(double)fee/COIN,(double)value/COIN,flags,keylen,valuesize,height,key[0],key[1],key[2],valueptr[0],valueptr[1],valueptr[2]);
-    if ( value >= fee )
+    //fprintf(stderr,"fee %.8f vs %.8f flags.%d keylen.%d valuesize.%d height.%d (%02x %02x %02x) (%02x %02x %02x)\n",(double)komodo_kvfee(flags,opretlen,keylen)/COIN,(double)value/COIN,flags,keylen,valuesize,height,key[0],key[1],key[2],valueptr[0],valueptr[1],valueptr[2]);
+    memcpy(keyvalue,key,keylen);
+    if ( (refvaluesize= komodo_kvsearch((uint256 *)&refpubkey,height,&flags,&kvheight,&keyvalue[keylen],key,keylen)) >= 0 )
     {
-        coresize = (int32_t)(sizeof(flags)+sizeof(height)+sizeof(keylen)+sizeof(valuesize)+keylen+valuesize+1);
-        if ( opretlen == coresize || opretlen == coresize+sizeof(uint256) || opretlen == coresize+2*sizeof(uint256) )
+        if ( memcmp(&zeroes,&refpubkey,sizeof(refpubkey)) != 0 )
         {
-            memset(&pubkey,0,sizeof(pubkey));
-            memset(&sig,0,sizeof(sig));
-            if ( (haspubkey= (opretlen >= coresize+sizeof(uint256))) != 0 )
+            if ( komodo_kvsigverify(keyvalue,keylen+refvaluesize,refpubkey,sig) < 0 )
             {
-                for (i=0; i<32; i++)
-                    ((uint8_t *)&pubkey)[i] = opretbuf[coresize+i];
+                //fprintf(stderr,"komodo_kvsigverify error [%d]\n",coresize-13);
+                return;
             }
-            if ( (hassig= (opretlen == coresize+sizeof(uint256)*2)) != 0 )
+        }
+    }
+    pthread_rwlock_wrlock(&KOMODO_KV_rwlock);
+    HASH_FIND(hh,KOMODO_KV,key,keylen,ptr);
+    if ( ptr != 0 && height > ptr->height + komodo_kvduration(ptr->flags) )
+        newflag = 1; // expired as of this update but not yet reclaimed by komodo_kvsweep, reuse it as a fresh key
+    else if ( ptr != 0 )
+    {
+        //fprintf(stderr,"(%s) already there\n",(char *)key);
+        //if ( (ptr->flags & KOMODO_KVPROTECTED) != 0 )
+        {
+            tstr = (char *)"transfer:";
+            transferpubstr = (char *)&valueptr[strlen(tstr)];
+            if ( strncmp(tstr,(char *)valueptr,strlen(tstr)) == 0 && is_hexstr(transferpubstr,0) == 64 )
             {
+                printf("transfer.(%s) to [%s]? ishex.%d\n",key,transferpubstr,is_hexstr(transferpubstr,0));
                 for (i=0; i<32; i++)
-                    ((uint8_t *)&sig)[i] = opretbuf[coresize+sizeof(uint256)+i];
-            }
-            memcpy(keyvalue,key,keylen);
-            if ( (refvaluesize= komodo_kvsearch((uint256 *)&refpubkey,height,&flags,&kvheight,&keyvalue[keylen],key,keylen)) >= 0 )
-            {
-                if ( memcmp(&zeroes,&refpubkey,sizeof(refpubkey)) != 0 )
-                {
-                    if ( komodo_kvsigverify(keyvalue,keylen+refvaluesize,refpubkey,sig) < 0 )
-                    {
-                        //fprintf(stderr,"komodo_kvsigverify error [%d]\n",coresize-13);
-                        return;
-                    }
-                }
-            }
-            portable_mutex_lock(&KOMODO_KV_mutex);
-            HASH_FIND(hh,KOMODO_KV,key,keylen,ptr);
-            if ( ptr != 0 )
-            {
-                //fprintf(stderr,"(%s) already there\n",(char *)key);
-                //if ( (ptr->flags & KOMODO_KVPROTECTED) != 0 )
-                {
-                    tstr = (char *)"transfer:";
-                    transferpubstr = (char *)&valueptr[strlen(tstr)];
-                    if ( strncmp(tstr,(char *)valueptr,strlen(tstr)) == 0 && is_hexstr(transferpubstr,0) == 64 )
-                    {
-                        printf("transfer.(%s) to [%s]? ishex.%d\n",key,transferpubstr,is_hexstr(transferpubstr,0));
-                        for (i=0; i<32; i++)
-                            ((uint8_t *)&pubkey)[31-i] = _decode_hex(&transferpubstr[i*2]);
-                    }
-                }
-            }
-            else if ( ptr == 0 )
-            {
-                ptr = (struct komodo_kv *)calloc(1,sizeof(*ptr));
-                ptr->key = (uint8_t *)calloc(1,keylen);
-                ptr->keylen = keylen;
-                memcpy(ptr->key,key,keylen);
-                newflag = 1;
-                HASH_ADD_KEYPTR(hh,KOMODO_KV,ptr->key,ptr->keylen,ptr);
-                //fprintf(stderr,"KV add.(%s) (%s)\n",ptr->key,valueptr);
+                    ((uint8_t *)&pubkey)[31-i] = _decode_hex(&transferpubstr[i*2]);
             }
-            if ( newflag != 0 || (ptr->flags & KOMODO_KVPROTECTED) == 0 )
-            {
-                if ( ptr->value != 0 )
-                    free(ptr->value), ptr->value = 0;
-                if ( (ptr->valuesize= valuesize) != 0 )
-                {
-                    ptr->value = (uint8_t *)calloc(1,valuesize);
-                    memcpy(ptr->value,valueptr,valuesize);
-                }
-            } else fprintf(stderr,"newflag.%d zero or protected %d\n",newflag,(ptr->flags & KOMODO_KVPROTECTED));
-            /*for (i=0; i<32; i++)
-                printf("%02x",((uint8_t *)&ptr->pubkey)[i]);
-            printf(" <- ");
-            for (i=0; i<32; i++)
-                printf("%02x",((uint8_t *)&pubkey)[i]);
-            printf(" new pubkey\n");*/
-            memcpy(&ptr->pubkey,&pubkey,sizeof(ptr->pubkey));
-            ptr->height = height;
-            ptr->flags = flags; // jl777 used to or in KVPROTECTED
-            portable_mutex_unlock(&KOMODO_KV_mutex);
-        } else fprintf(stderr,"KV update size mismatch %d vs %d\n",opretlen,coresize);
-    } else fprintf(stderr,"not enough fee\n");
+        }
+    }
+    else if ( ptr == 0 )
+    {
+        ptr = (struct komodo_kv *)calloc(1,sizeof(*ptr));
+        ptr->key = (uint8_t *)calloc(1,keylen);
+        ptr->keylen = keylen;
+        memcpy(ptr->key,key,keylen);
+        newflag = 1;
+        HASH_ADD_KEYPTR(hh,KOMODO_KV,ptr->key,ptr->keylen,ptr);
+        KOMODO_KVSORTED[std::string((char *)ptr->key,ptr->keylen)] = ptr;
+        //fprintf(stderr,"KV add.(%s) (%s)\n",ptr->key,valueptr);
+    }
+    if ( newflag != 0 || (ptr->flags & KOMODO_KVPROTECTED) == 0 )
+    {
+        if ( ptr->value != 0 )
+            free(ptr->value), ptr->value = 0;
+        if ( (ptr->valuesize= valuesize) != 0 )
+        {
+            ptr->value = (uint8_t *)calloc(1,valuesize);
+            memcpy(ptr->value,valueptr,valuesize);
+        }
+    } else fprintf(stderr,"newflag.%d zero or protected %d\n",newflag,(ptr->flags & KOMODO_KVPROTECTED));
+    /*for (i=0; i<32; i++)
+        printf("%02x",((uint8_t *)&ptr->pubkey)[i]);
+    printf(" <- ");
+    for (i=0; i<32; i++)
+        printf("%02x",((uint8_t *)&pubkey)[i]);
+    printf(" new pubkey\n");*/
+    memcpy(&ptr->pubkey,&pubkey,sizeof(ptr->pubkey));
+    ptr->height = height;
+    ptr->flags = flags; // jl777 used to or in KVPROTECTED
+    pthread_rwlock_unlock(&KOMODO_KV_rwlock);
 }
 
 #endif
@@ -17,7 +17,7 @@
 #ifndef KOMODO_NSPV_DEFSH
 #define KOMODO_NSPV_DEFSH
 
-#define NSPV_PROTOCOL_VERSION 0x00000004
+#define NSPV_PROTOCOL_VERSION 0x00000005
 #define NSPV_POLLITERS 200
 #define NSPV_POLLMICROS 50000
 #define NSPV_MAXVINS 64
@@ -54,6 +54,12 @@
 #define NSPV_CC_TXIDS 16
 #define NSPV_REMOTERPC 0x14
 #define NSPV_REMOTERPCRESP 0x15
+#define NSPV_BATCH 0x16 // funcid, numitems, then per item the body of a single UTXOS, TXIDS, TXPROOF or SPENTINFO request
+#define NSPV_BATCHRESP 0x17 // funcid, hash of the request, numitems, then per item the length and a full single response (a UTXOS one followed by the skipcount to continue at)
+#define NSPV_BATCH_MINVERSION 0x00000005 // peers with an older nSPV protocol version dont know NSPV_BATCH
+#define NSPV_MAXBATCH 1024
+#define NSPV_MAXBATCH_HEAVY 64 // TXPROOF and UTXOS items each cost a proof or an address index scan, one rate limited batch answers at most this many
+#define NSPV_BATCHMAX(funcid) (((funcid) == NSPV_TXPROOF || (funcid) == NSPV_UTXOS) ? NSPV_MAXBATCH_HEAVY : NSPV_MAXBATCH)
 
 int32_t NSPV_gettransaction(int32_t skipvalidation,int32_t vout,uint256 txid,int32_t height,CTransaction &tx,uint256 &hashblock,int32_t &txheight,int32_t &currentheight,int64_t extradata,uint32_t tiptime,int64_t &rewardsum);
 UniValue NSPV_spend(char *srcaddr,char *destaddr,int64_t satoshis);
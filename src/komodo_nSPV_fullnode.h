@@ -161,64 +161,86 @@ int32_t NSPV_getinfo(struct NSPV_inforesp *ptr,int32_t reqheight)
     } else return(-1);
 }
 
+struct NSPV_utxoresp *NSPV_utxosbuf; int32_t NSPV_utxosbufmax; // reused by every NSPV_UTXOS response, only touched from the message handler thread
+
+// drops outputs already spent in the mempool, caller holds mempool.cs
+void NSPV_utxos_mempoolfilter(std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs)
+{
+    int32_t i,n = 0;
+    for (i=0; i<unspentOutputs.size(); i++)
+    {
+        if ( mempool.mapNextTx.count(COutPoint(unspentOutputs[i].first.txhash,(uint32_t)unspentOutputs[i].first.index)) == 0 )
+            unspentOutputs[n++] = unspentOutputs[i];
+    }
+    unspentOutputs.resize(n);
+}
+
+// fills ptr->utxos (which is NSPV_utxosbuf) from a filtered page and adds up the totals, -1 if the buffer cant grow to the page
+int32_t NSPV_utxosresp_set(struct NSPV_utxosresp *ptr,std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs,int32_t tipheight)
+{
+    int64_t total = 0,interest=0; uint32_t locktime; int32_t i,txheight,ind = 0; struct NSPV_utxoresp *utxos;
+    if ( unspentOutputs.size() > (size_t)NSPV_utxosbufmax )
+    {
+        if ( (utxos= (struct NSPV_utxoresp *)realloc(NSPV_utxosbuf,unspentOutputs.size() * sizeof(*NSPV_utxosbuf))) == 0 )
+        {
+            fprintf(stderr,"NSPV_utxosresp_set couldnt allocate %d utxos\n",(int32_t)unspentOutputs.size());
+            ptr->utxos = 0, ptr->numutxos = 0;
+            return(-1);
+        }
+        NSPV_utxosbuf = utxos;
+        NSPV_utxosbufmax = (int32_t)unspentOutputs.size();
+    }
+    ptr->utxos = NSPV_utxosbuf;
+    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++)
+    {
+        ptr->utxos[ind].txid = it->first.txhash;
+        ptr->utxos[ind].vout = (int32_t)it->first.index;
+        ptr->utxos[ind].satoshis = it->second.satoshis;
+        ptr->utxos[ind].height = it->second.blockHeight;
+        ptr->utxos[ind].extradata = 0;
+        ind++;
+    }
+    for (i=0; i<ind; i++)
+    {
+        if ( ASSETCHAINS_SYMBOL[0] == 0 && ptr->utxos[i].satoshis >= 10*COIN )
+        {
+            ptr->utxos[i].extradata = komodo_accrued_interest(&txheight,&locktime,ptr->utxos[i].txid,ptr->utxos[i].vout,ptr->utxos[i].height,ptr->utxos[i].satoshis,tipheight);
+            interest += ptr->utxos[i].extradata;
+        }
+        total += ptr->utxos[i].satoshis;
+    }
+    ptr->numutxos = ind;
+    ptr->total = total;
+    ptr->interest = interest;
+    return((int32_t)(sizeof(*ptr) + sizeof(*ptr->utxos)*ptr->numutxos - sizeof(ptr->utxos)));
+}
+
+// streams at most one page of the address unspent index starting at skipcount, dropping outputs already spent in the mempool
 int32_t NSPV_getaddressutxos(struct NSPV_utxosresp *ptr,char *coinaddr,bool isCC,int32_t skipcount,uint32_t filter)
 {
-    int64_t total = 0,interest=0; uint32_t locktime; int32_t ind=0,tipheight,maxlen,txheight,n = 0,len = 0;
+    int32_t type=0,tipheight,maxlen; uint160 hashBytes;
     std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
-    SetCCunspents(unspentOutputs,coinaddr,isCC);
+    tipheight = chainActive.LastTip()->GetHeight();
     maxlen = MAX_BLOCK_SIZE(tipheight) - 512;
     maxlen /= sizeof(*ptr->utxos);
+    if ( maxlen > 0xffff ) // numutxos is uint16_t
+        maxlen = 0xffff;
     strncpy(ptr->coinaddr,coinaddr,sizeof(ptr->coinaddr)-1);
     ptr->CCflag = isCC;
     ptr->filter = filter;
+    ptr->nodeheight = tipheight;
     if ( skipcount < 0 )
         skipcount = 0;
-    if ( (ptr->numutxos= (int32_t)unspentOutputs.size()) >= 0 && ptr->numutxos < maxlen )
+    CBitcoinAddress address(coinaddr);
+    if ( address.GetIndexKey(hashBytes,type,isCC) != 0 )
+        GetAddressUnspentPage(hashBytes,type,skipcount,maxlen,unspentOutputs);
+    ptr->skipcount = skipcount;
     {
-        tipheight = chainActive.LastTip()->GetHeight();
-        ptr->nodeheight = tipheight;
-        if ( skipcount >= ptr->numutxos )
-            skipcount = ptr->numutxos-1;
-        ptr->skipcount = skipcount;
-        if ( ptr->numutxos-skipcount > 0 )
-        {
-            ptr->utxos = (struct NSPV_utxoresp *)calloc(ptr->numutxos-skipcount,sizeof(*ptr->utxos));
-            for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++)
-            {
-                // if gettxout is != null to handle mempool
-                {
-                    if ( n >= skipcount && myIsutxo_spentinmempool(ignoretxid,ignorevin,it->first.txhash,(int32_t)it->first.index) == 0  )
-                    {
-                        ptr->utxos[ind].txid = it->first.txhash;
-                        ptr->utxos[ind].vout = (int32_t)it->first.index;
-                        ptr->utxos[ind].satoshis = it->second.satoshis;
-                        ptr->utxos[ind].height = it->second.blockHeight;
-                        if ( ASSETCHAINS_SYMBOL[0] == 0 && it->second.satoshis >= 10*COIN )
-                        {
-                            ptr->utxos[n].extradata = komodo_accrued_interest(&txheight,&locktime,ptr->utxos[ind].txid,ptr->utxos[ind].vout,ptr->utxos[ind].height,ptr->utxos[ind].satoshis,tipheight);
-                            interest += ptr->utxos[ind].extradata;
-                        }
-                        ind++;
-                        total += it->second.satoshis;
-                    }
-                    n++;
-                }
-            }
-        }
-        ptr->numutxos = ind;
-        if ( len < maxlen )
-        {
-            len = (int32_t)(sizeof(*ptr) + sizeof(*ptr->utxos)*ptr->numutxos - sizeof(ptr->utxos));
-            //fprintf(stderr,"getaddressutxos for %s -> n.%d:%d total %.8f interest %.8f len.%d\n",coinaddr,n,ptr->numutxos,dstr(total),dstr(interest),len);
-            ptr->total = total;
-            ptr->interest = interest;
-            return(len);
-        }
+        LOCK(mempool.cs);
+        NSPV_utxos_mempoolfilter(unspentOutputs);
     }
-    if ( ptr->utxos != 0 )
-        free(ptr->utxos);
-    memset(ptr,0,sizeof(*ptr));
-    return(0);
+    //fprintf(stderr,"getaddressutxos for %s -> skip.%d:%d\n",coinaddr,skipcount,(int32_t)unspentOutputs.size());
+    return(NSPV_utxosresp_set(ptr,unspentOutputs,tipheight));
 }
 
 class BaseCCChecker {
@@ -876,15 +898,293 @@ int32_t NSPV_getspentinfo(struct NSPV_spentinfo *ptr,uint256 txid,int32_t vout)
     return(len);
 }
 
+// reserves room for one batch item of slen bytes after its length prefix, returns the offset to serialize it at or -1 once the batch is full
+int32_t NSPV_batch_item(std::vector<uint8_t> &response,uint8_t respid,int32_t slen,int32_t maxlen)
+{
+    int32_t offset = (int32_t)response.size(); uint32_t itemlen = (slen > 0) ? 1 + slen : 0;
+    if ( offset + sizeof(itemlen) + itemlen > maxlen )
+        return(-1);
+    response.resize(offset + sizeof(itemlen) + itemlen);
+    offset += iguana_rwnum(1,&response[offset],sizeof(itemlen),&itemlen);
+    if ( itemlen > 0 )
+        response[offset++] = respid;
+    return(offset);
+}
+
+// drops a partly written item and replaces it with an empty one, so the client sees which item failed
+void NSPV_batch_itemerror(std::vector<uint8_t> &response,int32_t itemstart)
+{
+    response.resize(itemstart);
+    NSPV_batch_item(response,0,0,itemstart + sizeof(uint32_t));
+}
+
+// executes a NSPV_BATCH request. address pages are read with one index iterator and filtered against one mempool snapshot.
+// items that dont fit into one message or are past NSPV_BATCHMAX(funcid) are left out, numitems in the response tells the client where to continue.
+// when not even the first item fits it is answered as an error item, so the client always gets a response and moves on.
+// each UTXOS item is followed by the skipcount its address continues at, -1 when the page has all of it
+int32_t NSPV_batchexec(std::vector<uint8_t> &response,std::vector<uint8_t> &request)
+{
+    int32_t i,len,slen,offset,pos,itemstart,maxlen,tipheight,skipcount,height,vout,type,limit; uint32_t filter; uint16_t num,answered = 0; uint8_t funcid,isCC; uint256 reqhash,txid; uint160 hashBytes; char coinaddr[64];
+    if ( (len= (int32_t)request.size()) < 1+1+sizeof(num) )
+        return(-1);
+    funcid = request[1];
+    offset = 2 + iguana_rwnum(0,&request[2],sizeof(num),&num);
+    if ( num == 0 || num > NSPV_MAXBATCH )
+        return(-1);
+    limit = std::min((int32_t)num,(int32_t)NSPV_BATCHMAX(funcid));
+    tipheight = chainActive.LastTip()->GetHeight();
+    maxlen = MAX_BLOCK_SIZE(tipheight) - 512;
+    reqhash = Hash(request.begin(),request.end());
+    response.resize(1 + 1 + sizeof(reqhash) + sizeof(num));
+    response[0] = NSPV_BATCHRESP;
+    response[1] = funcid;
+    iguana_rwbignum(1,&response[2],sizeof(reqhash),(uint8_t *)&reqhash);
+    if ( funcid == NSPV_UTXOS || funcid == NSPV_TXIDS )
+    {
+        std::vector<std::string> coinaddrs; std::vector<uint8_t> isCCs; std::vector<uint32_t> filters; std::vector<int> skips; std::vector<std::pair<uint160,int> > keys;
+        for (i=0; i<num; i++)
+        {
+            if ( offset >= len || (slen= request[offset]) >= sizeof(coinaddr) || offset+1+slen+1+sizeof(skipcount)+sizeof(filter) > len )
+                return(-1);
+            memcpy(coinaddr,&request[offset+1],slen), offset += 1 + slen;
+            coinaddr[slen] = 0;
+            isCC = (request[offset++] != 0);
+            offset += iguana_rwnum(0,&request[offset],sizeof(skipcount),&skipcount);
+            offset += iguana_rwnum(0,&request[offset],sizeof(filter),&filter);
+            coinaddrs.push_back(coinaddr);
+            isCCs.push_back(isCC);
+            skips.push_back(skipcount < 0 ? 0 : skipcount);
+            filters.push_back(filter);
+            hashBytes.SetNull(), type = 0;
+            CBitcoinAddress address(coinaddr);
+            if ( address.GetIndexKey(hashBytes,type,isCC) == 0 )
+                hashBytes.SetNull(), type = 0; // matches nothing in the index
+            keys.push_back(std::make_pair(hashBytes,type));
+        }
+        keys.resize(limit), skips.resize(limit);
+        if ( funcid == NSPV_UTXOS )
+        {
+            struct NSPV_utxosresp U; std::vector<std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > > pages; std::vector<int> nextskips; int32_t nextskip;
+            GetAddressUnspentPages(keys,skips,std::min(maxlen / (int32_t)sizeof(*U.utxos),0xffff),pages,nextskips);
+            {
+                LOCK(mempool.cs);
+                for (i=0; i<pages.size(); i++)
+                    NSPV_utxos_mempoolfilter(pages[i]);
+            }
+            for (i=0; i<pages.size(); i++)
+            {
+                memset(&U,0,sizeof(U));
+                strncpy(U.coinaddr,coinaddrs[i].c_str(),sizeof(U.coinaddr)-1);
+                U.CCflag = isCCs[i];
+                U.filter = filters[i];
+                U.nodeheight = tipheight;
+                U.skipcount = skips[i];
+                slen = NSPV_utxosresp_set(&U,pages[i],tipheight);
+                nextskip = nextskips[i];
+                itemstart = (int32_t)response.size();
+                if ( (pos= NSPV_batch_item(response,NSPV_UTXOSRESP,slen + sizeof(nextskip),maxlen)) < 0 )
+                    break;
+                if ( slen < 0 || NSPV_rwutxosresp(1,&response[pos],&U) != slen )
+                    NSPV_batch_itemerror(response,itemstart);
+                else iguana_rwnum(1,&response[pos+slen],sizeof(nextskip),&nextskip);
+                memset(&U,0,sizeof(U)); // U.utxos is NSPV_utxosbuf, dont purge
+                answered++;
+            }
+        }
+        else
+        {
+            struct NSPV_txidsresp T;
+            for (i=0; i<limit; i++)
+            {
+                memset(&T,0,sizeof(T));
+                slen = NSPV_getaddresstxids(&T,(char *)coinaddrs[i].c_str(),isCCs[i],skips[i],filters[i]);
+                itemstart = (int32_t)response.size();
+                if ( (pos= NSPV_batch_item(response,NSPV_TXIDSRESP,slen,maxlen)) < 0 )
+                {
+                    NSPV_txidsresp_purge(&T);
+                    break;
+                }
+                if ( slen > 0 && NSPV_rwtxidsresp(1,&response[pos],&T) != slen )
+                    NSPV_batch_itemerror(response,itemstart);
+                NSPV_txidsresp_purge(&T);
+                answered++;
+            }
+        }
+    }
+    else if ( funcid == NSPV_TXPROOF )
+    {
+        struct NSPV_txproof P;
+        if ( len != 2 + sizeof(num) + num*(sizeof(height)+sizeof(vout)+sizeof(txid)) )
+            return(-1);
+        for (i=0; i<limit; i++)
+        {
+            offset += iguana_rwnum(0,&request[offset],sizeof(height),&height);
+            offset += iguana_rwnum(0,&request[offset],sizeof(vout),&vout);
+            offset += iguana_rwbignum(0,&request[offset],sizeof(txid),(uint8_t *)&txid);
+            memset(&P,0,sizeof(P));
+            slen = NSPV_gettxproof(&P,vout,txid,height);
+            itemstart = (int32_t)response.size();
+            if ( (pos= NSPV_batch_item(response,NSPV_TXPROOFRESP,slen,maxlen)) < 0 )
+            {
+                NSPV_txproof_purge(&P);
+                break;
+            }
+            if ( slen > 0 && NSPV_rwtxproof(1,&response[pos],&P) != slen )
+                NSPV_batch_itemerror(response,itemstart);
+            NSPV_txproof_purge(&P);
+            answered++;
+        }
+    }
+    else if ( funcid == NSPV_SPENTINFO )
+    {
+        struct NSPV_spentinfo S;
+        if ( len != 2 + sizeof(num) + num*(sizeof(vout)+sizeof(txid)) )
+            return(-1);
+        for (i=0; i<limit; i++)
+        {
+            offset += iguana_rwnum(0,&request[offset],sizeof(vout),&vout);
+            offset += iguana_rwbignum(0,&request[offset],sizeof(txid),(uint8_t *)&txid);
+            memset(&S,0,sizeof(S));
+            slen = NSPV_getspentinfo(&S,txid,vout);
+            itemstart = (int32_t)response.size();
+            if ( (pos= NSPV_batch_item(response,NSPV_SPENTINFORESP,slen,maxlen)) < 0 )
+            {
+                NSPV_spentinfo_purge(&S);
+                break;
+            }
+            if ( slen > 0 && NSPV_rwspentinfo(1,&response[pos],&S) != slen )
+                NSPV_batch_itemerror(response,itemstart);
+            NSPV_spentinfo_purge(&S);
+            answered++;
+        }
+    }
+    else return(-1);
+    if ( answered == 0 )
+    {
+        NSPV_batch_itemerror(response,1 + 1 + sizeof(reqhash) + sizeof(num));
+        answered = 1;
+    }
+    iguana_rwnum(1,&response[2+sizeof(reqhash)],sizeof(answered),&answered);
+    return(answered);
+}
+
+// LRU cache of encoded responses keyed by the request bytes, entries are stale once the tip (or for txproofs the mempool) changes
+struct NSPV_respcache_entry { std::vector<uint8_t> response; std::list<std::vector<uint8_t> >::iterator lru; uint256 tiphash; uint32_t mempoolgen; };
+std::map<std::vector<uint8_t>,struct NSPV_respcache_entry> NSPV_respcache;
+std::list<std::vector<uint8_t> > NSPV_respcache_lru; // most recently used at the front
+int64_t NSPV_respcache_bytes;
+uint64_t NSPV_respcache_hits,NSPV_respcache_misses,NSPV_respcache_stale,NSPV_respcache_evictions;
+pthread_mutex_t NSPV_respcache_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+int32_t NSPV_respcache_cacheable(uint8_t funcid)
+{
+    if ( KOMODO_NSPV_CACHEMB <= 0 )
+        return(0);
+    switch ( funcid )
+    {
+        case NSPV_INFO: case NSPV_NTZS: case NSPV_NTZSPROOF: case NSPV_TXPROOF: case NSPV_TXIDS: return(1);
+        default: return(0);
+    }
+}
+
+int64_t NSPV_respcache_size(const std::vector<uint8_t> &request,const std::vector<uint8_t> &response)
+{
+    return(2*request.size() + response.size() + sizeof(struct NSPV_respcache_entry) + 64);
+}
+
+void NSPV_respcache_erase(std::map<std::vector<uint8_t>,struct NSPV_respcache_entry>::iterator it)
+{
+    NSPV_respcache_bytes -= NSPV_respcache_size(it->first,it->second.response);
+    NSPV_respcache_lru.erase(it->second.lru);
+    NSPV_respcache.erase(it);
+}
+
+int32_t NSPV_respcache_get(std::vector<uint8_t> &response,const std::vector<uint8_t> &request)
+{
+    CBlockIndex *pindex; int32_t retval = 0;
+    if ( (pindex= chainActive.LastTip()) == 0 )
+        return(0);
+    pthread_mutex_lock(&NSPV_respcache_mutex);
+    std::map<std::vector<uint8_t>,struct NSPV_respcache_entry>::iterator it = NSPV_respcache.find(request);
+    if ( it == NSPV_respcache.end() )
+        NSPV_respcache_misses++;
+    else if ( it->second.tiphash != pindex->GetBlockHash() || (request[0] == NSPV_TXPROOF && it->second.mempoolgen != mempool.GetTransactionsUpdated()) )
+    {
+        NSPV_respcache_erase(it);
+        NSPV_respcache_stale++;
+        NSPV_respcache_misses++;
+    }
+    else
+    {
+        response = it->second.response;
+        NSPV_respcache_lru.splice(NSPV_respcache_lru.begin(),NSPV_respcache_lru,it->second.lru);
+        NSPV_respcache_hits++;
+        retval = 1;
+    }
+    pthread_mutex_unlock(&NSPV_respcache_mutex);
+    return(retval);
+}
+
+void NSPV_respcache_put(const std::vector<uint8_t> &request,const std::vector<uint8_t> &response,uint256 tiphash,uint32_t mempoolgen)
+{
+    int64_t maxbytes = (int64_t)KOMODO_NSPV_CACHEMB * 1024 * 1024;
+    if ( NSPV_respcache_size(request,response) > maxbytes/8 ) // dont let one big txproof flush the cache
+        return;
+    pthread_mutex_lock(&NSPV_respcache_mutex);
+    std::map<std::vector<uint8_t>,struct NSPV_respcache_entry>::iterator it = NSPV_respcache.find(request);
+    if ( it != NSPV_respcache.end() )
+        NSPV_respcache_erase(it);
+    NSPV_respcache_lru.push_front(request);
+    struct NSPV_respcache_entry &entry = NSPV_respcache[request];
+    entry.response = response;
+    entry.lru = NSPV_respcache_lru.begin();
+    entry.tiphash = tiphash;
+    entry.mempoolgen = mempoolgen;
+    NSPV_respcache_bytes += NSPV_respcache_size(request,response);
+    while ( NSPV_respcache_bytes > maxbytes && NSPV_respcache_lru.size() > 0 )
+    {
+        NSPV_respcache_erase(NSPV_respcache.find(NSPV_respcache_lru.back()));
+        NSPV_respcache_evictions++;
+    }
+    pthread_mutex_unlock(&NSPV_respcache_mutex);
+}
+
+UniValue NSPV_respcache_stats()
+{
+    UniValue result(UniValue::VOBJ);
+    pthread_mutex_lock(&NSPV_respcache_mutex);
+    result.push_back(Pair("result","success"));
+    result.push_back(Pair("maxbytes",(int64_t)KOMODO_NSPV_CACHEMB * 1024 * 1024));
+    result.push_back(Pair("bytes",(int64_t)NSPV_respcache_bytes));
+    result.push_back(Pair("entries",(int64_t)NSPV_respcache.size()));
+    result.push_back(Pair("hits",(int64_t)NSPV_respcache_hits));
+    result.push_back(Pair("misses",(int64_t)NSPV_respcache_misses));
+    result.push_back(Pair("stale",(int64_t)NSPV_respcache_stale));
+    result.push_back(Pair("evictions",(int64_t)NSPV_respcache_evictions));
+    pthread_mutex_unlock(&NSPV_respcache_mutex);
+    return(result);
+}
+
 void komodo_nSPVreq(CNode *pfrom,std::vector<uint8_t> request) // received a request
 {
-    int32_t len,slen,ind,reqheight,n; std::vector<uint8_t> response; uint32_t timestamp = (uint32_t)time(NULL);
+    int32_t len,slen,ind,reqheight,n,cacheable; std::vector<uint8_t> response; uint32_t mempoolgen = 0,timestamp = (uint32_t)time(NULL); uint256 tiphash;
     if ( (len= request.size()) > 0 )
     {
         if ( (ind= request[0]>>1) >= sizeof(pfrom->prevtimes)/sizeof(*pfrom->prevtimes) )
             ind = (int32_t)(sizeof(pfrom->prevtimes)/sizeof(*pfrom->prevtimes)) - 1;
         if ( pfrom->prevtimes[ind] > timestamp )
             pfrom->prevtimes[ind] = 0;
+        if ( (cacheable= NSPV_respcache_cacheable(request[0])) != 0 && timestamp > pfrom->prevtimes[ind] )
+        {
+            if ( NSPV_respcache_get(response,request) != 0 )
+            {
+                pfrom->PushMessage("nSPV",response);
+                pfrom->prevtimes[ind] = timestamp;
+                return;
+            }
+            tiphash = chainActive.LastTip()->GetBlockHash(); // sample before computing so a racing block makes the entry stale, not wrong
+            mempoolgen = mempool.GetTransactionsUpdated();
+        }
         if ( request[0] == NSPV_INFO ) // info
         {
             //fprintf(stderr,"check info %u vs %u, ind.%d\n",timestamp,pfrom->prevtimes[ind],ind);
@@ -940,14 +1240,15 @@ void komodo_nSPVreq(CNode *pfrom,std::vector<uint8_t> request) // received a req
                     memset(&U,0,sizeof(U));
                     if ( (slen= NSPV_getaddressutxos(&U,coinaddr,isCC,skipcount,filter)) > 0 )
                     {
-                        response.resize(1 + slen);
-                        response[0] = NSPV_UTXOSRESP;
-                        if ( NSPV_rwutxosresp(1,&response[1],&U) == slen )
+                        static std::vector<uint8_t> utxosresponse; // keeps its capacity between requests
+                        utxosresponse.resize(1 + slen);
+                        utxosresponse[0] = NSPV_UTXOSRESP;
+                        if ( NSPV_rwutxosresp(1,&utxosresponse[1],&U) == slen )
                         {
-                            pfrom->PushMessage("nSPV",response);
+                            pfrom->PushMessage("nSPV",utxosresponse);
                             pfrom->prevtimes[ind] = timestamp;
                         }
-                        NSPV_utxosresp_purge(&U);
+                        memset(&U,0,sizeof(U)); // U.utxos is NSPV_utxosbuf, dont purge
                     }
                 }
             }
@@ -1130,6 +1431,17 @@ void komodo_nSPVreq(CNode *pfrom,std::vector<uint8_t> request) // received a req
                 }
             }
         }
+        else if ( request[0] == NSPV_BATCH )
+        {
+            if ( timestamp > pfrom->prevtimes[ind] )
+            {
+                if ( NSPV_batchexec(response,request) > 0 )
+                {
+                    pfrom->PushMessage("nSPV",response);
+                    pfrom->prevtimes[ind] = timestamp;
+                } else fprintf(stderr,"batch reqlen.%d funcid.%d rejected\n",len,len > 1 ? request[1] : -1);
+            }
+        }
         else if ( request[0] == NSPV_BROADCAST )
         {
             if ( timestamp > pfrom->prevtimes[ind] )
@@ -1236,6 +1548,8 @@ void komodo_nSPVreq(CNode *pfrom,std::vector<uint8_t> request) // received a req
                 }
             }
         }
+        if ( cacheable != 0 && tiphash.IsNull() == 0 && pfrom->prevtimes[ind] == timestamp && response.size() > 0 )
+            NSPV_respcache_put(request,response,tiphash,mempoolgen);
     }
 }
 
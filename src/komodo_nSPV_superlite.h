@@ -37,97 +37,611 @@ struct NSPV_txidsresp NSPV_txidsresult;
 struct NSPV_mempoolresp NSPV_mempoolresult;
 struct NSPV_spentinfo NSPV_spentresult;
 struct NSPV_ntzsresp NSPV_ntzsresult;
-struct NSPV_ntzsproofresp NSPV_ntzsproofresult;
+struct NSPV_ntzsproofresp NSPV_ntzsproofresult; // only the response NSPV_ntzsproofwait names goes here, background NSPV_hdrstore_extend proofs dont
+std::pair<uint256,uint256> NSPV_ntzsproofwait; // prevtxid,nexttxid a NSPV_txidhdrsproof caller is waiting for
+pthread_mutex_t NSPV_ntzsproof_mutex = PTHREAD_MUTEX_INITIALIZER;
 struct NSPV_txproof NSPV_txproofresult;
 struct NSPV_broadcastresp NSPV_broadcastresult;
+std::vector<std::vector<uint8_t> > NSPV_batchitems; uint256 NSPV_batchhash; // last NSPV_BATCHRESP, matched by the hash of its request
+pthread_mutex_t NSPV_batch_mutex = PTHREAD_MUTEX_INITIALIZER;
 
-struct NSPV_ntzsresp NSPV_ntzsresp_cache[NSPV_MAXVINS];
-struct NSPV_ntzsproofresp NSPV_ntzsproofresp_cache[NSPV_MAXVINS * 2];
-struct NSPV_txproof NSPV_txproof_cache[NSPV_MAXVINS * 4];
+// keyed LRU cache of validated responses, entries are zeroed on insert and released with purge on eviction
+// entries never leave the mutex: find copies into caller storage, which the caller releases with purge
+template <typename K,typename V> class NSPV_lrucache
+{
+public:
+    typedef std::pair<V,typename std::list<K>::iterator> entry;
+    std::map<K,entry> M;
+    std::list<K> L; // most recently used at the front
+    int32_t maxentries;
+    void (*copy)(V *,V *);
+    void (*purge)(V *);
+    pthread_mutex_t mutex;
 
-struct NSPV_ntzsresp *NSPV_ntzsresp_find(int32_t reqheight)
+    NSPV_lrucache(int32_t _maxentries,void (*_copy)(V *,V *),void (*_purge)(V *)) : maxentries(_maxentries),copy(_copy),purge(_purge) { pthread_mutex_init(&mutex,NULL); }
+    bool find(const K &key,V *dest) // dest == 0 only checks presence
+    {
+        bool found = false;
+        pthread_mutex_lock(&mutex);
+        typename std::map<K,entry>::iterator it = M.find(key);
+        if ( it != M.end() )
+        {
+            L.splice(L.begin(),L,it->second.second);
+            if ( dest != 0 )
+                (*copy)(dest,&it->second.first);
+            found = true;
+        }
+        pthread_mutex_unlock(&mutex);
+        return(found);
+    }
+    void clear()
+    {
+        pthread_mutex_lock(&mutex);
+        for (typename std::map<K,entry>::iterator it=M.begin(); it!=M.end(); it++)
+            (*purge)(&it->second.first);
+        M.clear();
+        L.clear();
+        pthread_mutex_unlock(&mutex);
+    }
+    bool add(const K &key,V *src,bool (*replace)(V *cached,V *src) = 0)
+    {
+        V *ptr;
+        pthread_mutex_lock(&mutex);
+        typename std::map<K,entry>::iterator it = M.find(key);
+        if ( it != M.end() )
+        {
+            L.splice(L.begin(),L,it->second.second);
+            if ( replace != 0 && (*replace)(&it->second.first,src) == 0 )
+            {
+                pthread_mutex_unlock(&mutex);
+                return(false);
+            }
+            (*purge)(&it->second.first);
+            ptr = &it->second.first;
+        }
+        else
+        {
+            while ( M.size() >= maxentries && L.size() > 0 )
+            {
+                it = M.find(L.back());
+                (*purge)(&it->second.first);
+                M.erase(it);
+                L.pop_back();
+            }
+            L.push_front(key);
+            entry &e = M[key];
+            e.second = L.begin();
+            ptr = &e.first;
+        }
+        (*copy)(ptr,src);
+        pthread_mutex_unlock(&mutex);
+        return(true);
+    }
+};
+
+NSPV_lrucache<int32_t,struct NSPV_ntzsresp> NSPV_ntzsresp_cache(NSPV_MAXVINS,NSPV_ntzsresp_copy,NSPV_ntzsresp_purge);
+NSPV_lrucache<std::pair<uint256,uint256>,struct NSPV_ntzsproofresp> NSPV_ntzsproofresp_cache(NSPV_MAXVINS * 2,NSPV_ntzsproofresp_copy,NSPV_ntzsproofresp_purge);
+NSPV_lrucache<uint256,struct NSPV_txproof> NSPV_txproof_cache(NSPV_MAXVINS * 4,NSPV_txproof_copy,NSPV_txproof_purge);
+
+// the find functions copy the cached entry into *dest (if not null), release it with the matching purge
+bool NSPV_ntzsresp_find(struct NSPV_ntzsresp *dest,int32_t reqheight)
 {
-    int32_t i;
-    for (i=0; i<sizeof(NSPV_ntzsresp_cache)/sizeof(*NSPV_ntzsresp_cache); i++)
-        if ( NSPV_ntzsresp_cache[i].reqheight == reqheight )
-            return(&NSPV_ntzsresp_cache[i]);
-    return(0);
+    return(NSPV_ntzsresp_cache.find(reqheight,dest));
 }
 
-struct NSPV_ntzsresp *NSPV_ntzsresp_add(struct NSPV_ntzsresp *ptr)
+void NSPV_ntzsresp_add(struct NSPV_ntzsresp *ptr)
 {
-    int32_t i;
-    for (i=0; i<sizeof(NSPV_ntzsresp_cache)/sizeof(*NSPV_ntzsresp_cache); i++)
-        if ( NSPV_ntzsresp_cache[i].reqheight == 0 )
-            break;
-    if ( i == sizeof(NSPV_ntzsresp_cache)/sizeof(*NSPV_ntzsresp_cache) )
-        i = (rand() % (sizeof(NSPV_ntzsresp_cache)/sizeof(*NSPV_ntzsresp_cache)));
-    NSPV_ntzsresp_purge(&NSPV_ntzsresp_cache[i]);
-    NSPV_ntzsresp_copy(&NSPV_ntzsresp_cache[i],ptr);
     fprintf(stderr,"ADD CACHE ntzsresp req.%d\n",ptr->reqheight);
-    return(&NSPV_ntzsresp_cache[i]);
+    NSPV_ntzsresp_cache.add(ptr->reqheight,ptr);
+}
+
+bool NSPV_txproof_find(struct NSPV_txproof *dest,uint256 txid)
+{
+    return(NSPV_txproof_cache.find(txid,dest));
+}
+
+static bool NSPV_txproof_upgrade(struct NSPV_txproof *cached,struct NSPV_txproof *ptr)
+{
+    return(cached->txprooflen == 0 && ptr->txprooflen != 0); // only replace an entry to upgrade it with a proof
+}
+
+void NSPV_txproof_add(struct NSPV_txproof *ptr)
+{
+    if ( NSPV_txproof_cache.add(ptr->txid,ptr,NSPV_txproof_upgrade) != 0 )
+        fprintf(stderr,"ADD CACHE txproof %s\n",ptr->txid.GetHex().c_str());
 }
 
-struct NSPV_txproof *NSPV_txproof_find(uint256 txid)
+bool NSPV_ntzsproof_find(struct NSPV_ntzsproofresp *dest,uint256 prevtxid,uint256 nexttxid)
 {
-    int32_t i; struct NSPV_txproof *backup = 0;
-    for (i=0; i<sizeof(NSPV_txproof_cache)/sizeof(*NSPV_txproof_cache); i++)
-        if ( NSPV_txproof_cache[i].txid == txid )
+    return(NSPV_ntzsproofresp_cache.find(std::make_pair(prevtxid,nexttxid),dest));
+}
+
+void NSPV_ntzsproof_add(struct NSPV_ntzsproofresp *ptr)
+{
+    fprintf(stderr,"ADD CACHE ntzsproof %s %s\n",ptr->prevtxid.GetHex().c_str(),ptr->nexttxid.GetHex().c_str());
+    NSPV_ntzsproofresp_cache.add(std::make_pair(ptr->prevtxid,ptr->nexttxid),ptr);
+}
+
+// -nspvcachefile=1 keeps the caches in nspvcache.dat across restarts: magic, version, records of (funcid, len, NSPV_rw* encoding), then a Hash() of all of it
+#define NSPV_CACHEFILE_MAGIC 0x4350534e
+#define NSPV_CACHEFILE_VERSION 1
+
+void NSPV_cache_init()
+{
+    int32_t n = GetArg("-nspvlitecache",NSPV_MAXVINS);
+    if ( n < 1 )
+        n = 1;
+    NSPV_ntzsresp_cache.maxentries = n;
+    NSPV_ntzsproofresp_cache.maxentries = n * 2;
+    NSPV_txproof_cache.maxentries = n * 4;
+}
+
+void NSPV_cachefile_record(std::vector<uint8_t> &buf,uint8_t funcid,std::vector<uint8_t> &tmp,int32_t len)
+{
+    int32_t offset = (int32_t)buf.size();
+    buf.resize(offset + 1 + sizeof(len) + len);
+    buf[offset] = funcid;
+    iguana_rwnum(1,&buf[offset+1],sizeof(len),&len);
+    memcpy(&buf[offset+1+sizeof(len)],&tmp[0],len);
+}
+
+// writes buf plus its Hash() to fname through a temporary file, so a crash never leaves a half written file
+int32_t NSPV_file_save(const char *name,std::vector<uint8_t> &buf)
+{
+    FILE *fp; uint256 hash = Hash(buf.begin(),buf.end());
+    boost::filesystem::path fname = GetDataDir() / name;
+    boost::filesystem::path tmpname = GetDataDir() / (std::string(name) + ".tmp");
+    if ( (fp= fopen(tmpname.string().c_str(),"wb")) == 0 )
+    {
+        fprintf(stderr,"NSPV_file_save: cant create %s\n",tmpname.string().c_str());
+        return(-1);
+    }
+    if ( fwrite(&buf[0],1,buf.size(),fp) != buf.size() || fwrite(&hash,1,sizeof(hash),fp) != sizeof(hash) )
+    {
+        fprintf(stderr,"NSPV_file_save: error writing %s\n",tmpname.string().c_str());
+        fclose(fp);
+        return(-1);
+    }
+    fclose(fp);
+    RenameOver(tmpname,fname);
+    return((int32_t)(buf.size() + sizeof(hash)));
+}
+
+// reads a file written by NSPV_file_save, returns the offset of the first record or -1 if missing, corrupted or of another magic/version
+int32_t NSPV_file_load(const char *name,std::vector<uint8_t> &buf,uint32_t filemagic,uint32_t fileversion)
+{
+    FILE *fp; long fsize; uint32_t magic,version; uint256 hash;
+    boost::filesystem::path fname = GetDataDir() / name;
+    if ( (fp= fopen(fname.string().c_str(),"rb")) == 0 )
+        return(-1);
+    fseek(fp,0,SEEK_END);
+    fsize = ftell(fp);
+    rewind(fp);
+    if ( fsize < 2*sizeof(uint32_t) + sizeof(hash) )
+    {
+        fclose(fp);
+        return(-1);
+    }
+    buf.resize(fsize);
+    if ( fread(&buf[0],1,fsize,fp) != fsize )
+    {
+        fprintf(stderr,"NSPV_file_load: error reading %s\n",fname.string().c_str());
+        fclose(fp);
+        return(-1);
+    }
+    fclose(fp);
+    memcpy(&hash,&buf[fsize - sizeof(hash)],sizeof(hash));
+    buf.resize(fsize - sizeof(hash));
+    if ( Hash(buf.begin(),buf.end()) != hash )
+    {
+        fprintf(stderr,"NSPV_file_load: ignoring corrupted %s\n",fname.string().c_str());
+        return(-1);
+    }
+    iguana_rwnum(0,&buf[0],sizeof(magic),&magic);
+    iguana_rwnum(0,&buf[sizeof(magic)],sizeof(version),&version);
+    if ( magic != filemagic || version != fileversion )
+    {
+        fprintf(stderr,"NSPV_file_load: ignoring %s magic.%08x version.%u\n",fname.string().c_str(),magic,version);
+        return(-1);
+    }
+    return(2 * sizeof(uint32_t));
+}
+
+// compact store of headers that NSPV_validatehdrs already checked between two notarizations. a txproof at a stored height only needs its merkle branch.
+// anchors are the notarization pairs the stored ranges were validated against, the highest one is extended as new notarizations arrive.
+// -nspvhdrs=0 disables it, otherwise it is kept in nspvhdrs.dat: magic, version, numanchors, anchors, then (height, blockhash, merkleroot, nTime) records
+#define NSPV_HDRSFILE_MAGIC 0x4844534e
+#define NSPV_HDRSFILE_VERSION 1
+#define NSPV_HDRS_MAXRANGE 1440 // NSPV_getntzsproofresp refuses longer ranges
+#define NSPV_HDRS_MAXSTORE 100000 // beyond this many heights the lowest ones and the anchors left without heights are dropped
+
+struct NSPV_hdrentry { uint256 blockhash,merkleroot; uint32_t nTime; };
+struct NSPV_hdranchor { uint256 prevtxid,nexttxid; int32_t prevht,nextht; };
+
+std::map<int32_t,struct NSPV_hdrentry> NSPV_hdrstore;
+std::vector<struct NSPV_hdranchor> NSPV_hdranchors;
+struct NSPV_hdranchor NSPV_hdrtip; // anchor with the highest nextht
+uint32_t NSPV_hdrsync;
+pthread_mutex_t NSPV_hdrstore_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+int32_t NSPV_validatehdrs(struct NSPV_ntzsproofresp *ptr);
+
+// copies the stored header at height into *hdr, returns 0 if the height was never validated
+int32_t NSPV_hdrstore_find(struct NSPV_hdrentry *hdr,int32_t height)
+{
+    int32_t retval = 0;
+    pthread_mutex_lock(&NSPV_hdrstore_mutex);
+    std::map<int32_t,struct NSPV_hdrentry>::iterator it = NSPV_hdrstore.find(height);
+    if ( it != NSPV_hdrstore.end() )
+    {
+        *hdr = it->second;
+        retval = 1;
+    }
+    pthread_mutex_unlock(&NSPV_hdrstore_mutex);
+    return(retval);
+}
+
+void NSPV_hdrstore_anchor(struct NSPV_hdranchor *anchor)
+{
+    NSPV_hdranchors.push_back(*anchor);
+    if ( anchor->nextht > NSPV_hdrtip.nextht )
+        NSPV_hdrtip = *anchor;
+}
+
+// keeps the store to NSPV_HDRS_MAXSTORE heights, the lowest go first as the tip is what gets extended. caller holds NSPV_hdrstore_mutex
+void NSPV_hdrstore_trim()
+{
+    int32_t i,n = 0,minht;
+    if ( NSPV_hdrstore.size() <= NSPV_HDRS_MAXSTORE )
+        return;
+    while ( NSPV_hdrstore.size() > NSPV_HDRS_MAXSTORE )
+        NSPV_hdrstore.erase(NSPV_hdrstore.begin());
+    minht = NSPV_hdrstore.begin()->first;
+    for (i=0; i<NSPV_hdranchors.size(); i++)
+        if ( NSPV_hdranchors[i].nextht >= minht || NSPV_hdranchors[i].nextht == NSPV_hdrtip.nextht )
+            NSPV_hdranchors[n++] = NSPV_hdranchors[i];
+    NSPV_hdranchors.resize(n);
+}
+
+// adds the headers of a ntzsproof response once they validate, returns the number of new heights
+int32_t NSPV_hdrstore_add(struct NSPV_ntzsproofresp *ptr)
+{
+    struct NSPV_hdrentry hdr; struct NSPV_hdranchor anchor; int32_t i,n = 0;
+    if ( GetBoolArg("-nspvhdrs",true) == 0 || ptr->common.hdrs == 0 || ptr->common.numhdrs <= 0 )
+        return(0);
+    if ( NSPV_validatehdrs(ptr) != 0 )
+        return(0);
+    pthread_mutex_lock(&NSPV_hdrstore_mutex);
+    for (i=0; i<ptr->common.numhdrs; i++)
+    {
+        if ( NSPV_hdrstore.count(ptr->common.prevht+i) != 0 )
+            continue;
+        hdr.blockhash = NSPV_hdrhash(&ptr->common.hdrs[i]);
+        hdr.merkleroot = ptr->common.hdrs[i].hashMerkleRoot;
+        hdr.nTime = ptr->common.hdrs[i].nTime;
+        NSPV_hdrstore[ptr->common.prevht+i] = hdr;
+        n++;
+    }
+    if ( n > 0 )
+    {
+        anchor.prevtxid = ptr->prevtxid;
+        anchor.nexttxid = ptr->nexttxid;
+        anchor.prevht = ptr->common.prevht;
+        anchor.nextht = ptr->common.nextht;
+        NSPV_hdrstore_anchor(&anchor);
+        NSPV_hdrstore_trim();
+    }
+    pthread_mutex_unlock(&NSPV_hdrstore_mutex);
+    return(n);
+}
+
+void NSPV_hdrstore_save()
+{
+    std::vector<uint8_t> buf; uint32_t val; int32_t i,len,offset,numhdrs;
+    if ( GetBoolArg("-nspvhdrs",true) == 0 )
+        return;
+    pthread_mutex_lock(&NSPV_hdrstore_mutex);
+    if ( NSPV_hdrstore.size() == 0 )
+    {
+        pthread_mutex_unlock(&NSPV_hdrstore_mutex);
+        return;
+    }
+    buf.resize(3*sizeof(val) + NSPV_hdranchors.size()*(2*sizeof(uint256) + 2*sizeof(int32_t)) + NSPV_hdrstore.size()*(sizeof(int32_t) + 2*sizeof(uint256) + sizeof(uint32_t)));
+    offset = 0;
+    val = NSPV_HDRSFILE_MAGIC, offset += iguana_rwnum(1,&buf[offset],sizeof(val),&val);
+    val = NSPV_HDRSFILE_VERSION, offset += iguana_rwnum(1,&buf[offset],sizeof(val),&val);
+    val = (uint32_t)NSPV_hdranchors.size(), offset += iguana_rwnum(1,&buf[offset],sizeof(val),&val);
+    for (i=0; i<NSPV_hdranchors.size(); i++)
+    {
+        offset += iguana_rwbignum(1,&buf[offset],sizeof(NSPV_hdranchors[i].prevtxid),(uint8_t *)&NSPV_hdranchors[i].prevtxid);
+        offset += iguana_rwbignum(1,&buf[offset],sizeof(NSPV_hdranchors[i].nexttxid),(uint8_t *)&NSPV_hdranchors[i].nexttxid);
+        offset += iguana_rwnum(1,&buf[offset],sizeof(NSPV_hdranchors[i].prevht),&NSPV_hdranchors[i].prevht);
+        offset += iguana_rwnum(1,&buf[offset],sizeof(NSPV_hdranchors[i].nextht),&NSPV_hdranchors[i].nextht);
+    }
+    for (std::map<int32_t,struct NSPV_hdrentry>::iterator it=NSPV_hdrstore.begin(); it!=NSPV_hdrstore.end(); it++)
+    {
+        int32_t height = it->first;
+        offset += iguana_rwnum(1,&buf[offset],sizeof(height),&height);
+        offset += iguana_rwbignum(1,&buf[offset],sizeof(it->second.blockhash),(uint8_t *)&it->second.blockhash);
+        offset += iguana_rwbignum(1,&buf[offset],sizeof(it->second.merkleroot),(uint8_t *)&it->second.merkleroot);
+        offset += iguana_rwnum(1,&buf[offset],sizeof(it->second.nTime),&it->second.nTime);
+    }
+    numhdrs = (int32_t)NSPV_hdrstore.size();
+    pthread_mutex_unlock(&NSPV_hdrstore_mutex);
+    if ( (len= NSPV_file_save("nspvhdrs.dat",buf)) > 0 )
+        fprintf(stderr,"NSPV_hdrstore_save: saved %d headers %d bytes\n",numhdrs,len);
+}
+
+void NSPV_hdrstore_load()
+{
+    std::vector<uint8_t> buf; struct NSPV_hdranchor anchor; struct NSPV_hdrentry hdr; uint32_t i,numanchors; int32_t height,offset,fsize,recsize = sizeof(int32_t) + 2*sizeof(uint256) + sizeof(uint32_t);
+    if ( GetBoolArg("-nspvhdrs",true) == 0 || (offset= NSPV_file_load("nspvhdrs.dat",buf,NSPV_HDRSFILE_MAGIC,NSPV_HDRSFILE_VERSION)) < 0 )
+        return;
+    fsize = (int32_t)buf.size();
+    if ( offset + sizeof(numanchors) > fsize )
+        return;
+    offset += iguana_rwnum(0,&buf[offset],sizeof(numanchors),&numanchors);
+    if ( numanchors > (fsize - offset) / (2*sizeof(uint256) + 2*sizeof(int32_t)) )
+        return;
+    pthread_mutex_lock(&NSPV_hdrstore_mutex);
+    for (i=0; i<numanchors; i++)
+    {
+        offset += iguana_rwbignum(0,&buf[offset],sizeof(anchor.prevtxid),(uint8_t *)&anchor.prevtxid);
+        offset += iguana_rwbignum(0,&buf[offset],sizeof(anchor.nexttxid),(uint8_t *)&anchor.nexttxid);
+        offset += iguana_rwnum(0,&buf[offset],sizeof(anchor.prevht),&anchor.prevht);
+        offset += iguana_rwnum(0,&buf[offset],sizeof(anchor.nextht),&anchor.nextht);
+        NSPV_hdrstore_anchor(&anchor);
+    }
+    while ( offset + recsize <= fsize )
+    {
+        offset += iguana_rwnum(0,&buf[offset],sizeof(height),&height);
+        offset += iguana_rwbignum(0,&buf[offset],sizeof(hdr.blockhash),(uint8_t *)&hdr.blockhash);
+        offset += iguana_rwbignum(0,&buf[offset],sizeof(hdr.merkleroot),(uint8_t *)&hdr.merkleroot);
+        offset += iguana_rwnum(0,&buf[offset],sizeof(hdr.nTime),&hdr.nTime);
+        NSPV_hdrstore[height] = hdr;
+    }
+    NSPV_hdrstore_trim();
+    pthread_mutex_unlock(&NSPV_hdrstore_mutex);
+    fprintf(stderr,"NSPV_hdrstore_load: loaded %d headers in %d ranges, tip.%d\n",(int32_t)NSPV_hdrstore.size(),(int32_t)NSPV_hdranchors.size(),NSPV_hdrtip.nextht);
+}
+
+void NSPV_cache_save()
+{
+    std::vector<uint8_t> buf,tmp; uint32_t val; int32_t len,n = 0;
+    NSPV_hdrstore_save();
+    if ( GetBoolArg("-nspvcachefile",false) == 0 )
+        return;
+    buf.resize(2 * sizeof(val));
+    val = NSPV_CACHEFILE_MAGIC, iguana_rwnum(1,&buf[0],sizeof(val),&val);
+    val = NSPV_CACHEFILE_VERSION, iguana_rwnum(1,&buf[sizeof(val)],sizeof(val),&val);
+    pthread_mutex_lock(&NSPV_ntzsresp_cache.mutex);
+    for (std::map<int32_t,NSPV_lrucache<int32_t,struct NSPV_ntzsresp>::entry>::iterator it=NSPV_ntzsresp_cache.M.begin(); it!=NSPV_ntzsresp_cache.M.end(); it++)
+    {
+        if ( it->second.first.nextntz.height == 0 ) // a later notarization may still arrive
+            continue;
+        tmp.resize(sizeof(it->second.first));
+        len = NSPV_rwntzsresp(1,&tmp[0],&it->second.first);
+        NSPV_cachefile_record(buf,NSPV_NTZSRESP,tmp,len), n++;
+    }
+    pthread_mutex_unlock(&NSPV_ntzsresp_cache.mutex);
+    pthread_mutex_lock(&NSPV_ntzsproofresp_cache.mutex);
+    for (std::map<std::pair<uint256,uint256>,NSPV_lrucache<std::pair<uint256,uint256>,struct NSPV_ntzsproofresp>::entry>::iterator it=NSPV_ntzsproofresp_cache.M.begin(); it!=NSPV_ntzsproofresp_cache.M.end(); it++)
+    {
+        struct NSPV_ntzsproofresp *ptr = &it->second.first;
+        tmp.resize(sizeof(*ptr) + ptr->common.numhdrs*sizeof(*ptr->common.hdrs) + ptr->prevtxlen + ptr->nexttxlen);
+        len = NSPV_rwntzsproofresp(1,&tmp[0],ptr);
+        NSPV_cachefile_record(buf,NSPV_NTZSPROOFRESP,tmp,len), n++;
+    }
+    pthread_mutex_unlock(&NSPV_ntzsproofresp_cache.mutex);
+    pthread_mutex_lock(&NSPV_txproof_cache.mutex);
+    for (std::map<uint256,NSPV_lrucache<uint256,struct NSPV_txproof>::entry>::iterator it=NSPV_txproof_cache.M.begin(); it!=NSPV_txproof_cache.M.end(); it++)
+    {
+        struct NSPV_txproof *ptr = &it->second.first;
+        if ( ptr->txprooflen == 0 ) // unconfirmed, refetch
+            continue;
+        tmp.resize(sizeof(*ptr) + ptr->txlen + ptr->txprooflen);
+        len = NSPV_rwtxproof(1,&tmp[0],ptr);
+        NSPV_cachefile_record(buf,NSPV_TXPROOFRESP,tmp,len), n++;
+    }
+    pthread_mutex_unlock(&NSPV_txproof_cache.mutex);
+    if ( (len= NSPV_file_save("nspvcache.dat",buf)) > 0 )
+        fprintf(stderr,"NSPV_cache_save: saved %d entries %d bytes\n",n,len);
+}
+
+void NSPV_cache_load()
+{
+    std::vector<uint8_t> buf; uint8_t funcid; int32_t len,offset,fsize,n = 0;
+    NSPV_cache_init();
+    NSPV_hdrstore_load();
+    if ( GetBoolArg("-nspvcachefile",false) == 0 )
+        return;
+    if ( (offset= NSPV_file_load("nspvcache.dat",buf,NSPV_CACHEFILE_MAGIC,NSPV_CACHEFILE_VERSION)) < 0 )
+        return;
+    fsize = (int32_t)buf.size();
+    while ( offset + 1 + sizeof(len) <= fsize )
+    {
+        funcid = buf[offset];
+        iguana_rwnum(0,&buf[offset+1],sizeof(len),&len);
+        offset += 1 + sizeof(len);
+        if ( len <= 0 || offset + len > fsize )
+            break;
+        if ( funcid == NSPV_NTZSRESP )
         {
-            if ( NSPV_txproof_cache[i].txprooflen != 0 )
-                return(&NSPV_txproof_cache[i]);
-            else backup = &NSPV_txproof_cache[i];
+            struct NSPV_ntzsresp N;
+            memset(&N,0,sizeof(N));
+            if ( NSPV_rwntzsresp(0,&buf[offset],&N) == len )
+                NSPV_ntzsresp_cache.add(N.reqheight,&N), n++;
         }
-    return(backup);
+        else if ( funcid == NSPV_NTZSPROOFRESP )
+        {
+            struct NSPV_ntzsproofresp P;
+            memset(&P,0,sizeof(P));
+            if ( NSPV_rwntzsproofresp(0,&buf[offset],&P) == len )
+                NSPV_ntzsproofresp_cache.add(std::make_pair(P.prevtxid,P.nexttxid),&P), n++;
+            NSPV_ntzsproofresp_purge(&P);
+        }
+        else if ( funcid == NSPV_TXPROOFRESP )
+        {
+            struct NSPV_txproof T;
+            memset(&T,0,sizeof(T));
+            if ( NSPV_rwtxproof(0,&buf[offset],&T) == len )
+                NSPV_txproof_cache.add(T.txid,&T), n++;
+            NSPV_txproof_purge(&T);
+        }
+        offset += len;
+    }
+    fprintf(stderr,"NSPV_cache_load: loaded %d cached responses\n",n);
 }
 
-struct NSPV_txproof *NSPV_txproof_add(struct NSPV_txproof *ptr)
+// pipelined requests: keeps several requests outstanding across NODE_NSPV peers, the fastest available peer first.
+// responses carry no request id, so a request is matched by its funcid and the txid/height/notarization pair that the response echoes back
+
+#define NSPV_PIPELINE_TIMEOUT 3000 // millis before an outstanding request is resent to another peer
+#define NSPV_PIPELINE_MAXTRIES 4
+#define NSPV_PIPELINE_DEFAULTRTT 500.
+
+struct NSPV_inflight { std::vector<uint8_t> msg; NodeId peer; int64_t sentms; int32_t tries; uint8_t done; };
+struct NSPV_peerstat { double rttms; int32_t answered,timeouts; };
+
+std::map<std::pair<uint8_t,uint256>,struct NSPV_inflight> NSPV_inflights;
+std::map<NodeId,struct NSPV_peerstat> NSPV_peerstats;
+pthread_mutex_t NSPV_pipeline_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+std::pair<uint8_t,uint256> NSPV_reqkey_txproof(uint256 txid) { return(std::make_pair((uint8_t)NSPV_TXPROOF,txid)); }
+std::pair<uint8_t,uint256> NSPV_reqkey_ntzs(int32_t reqheight) { return(std::make_pair((uint8_t)NSPV_NTZS,ArithToUint256(arith_uint256((uint32_t)reqheight)))); }
+std::pair<uint8_t,uint256> NSPV_reqkey_ntzsproof(uint256 prevtxid,uint256 nexttxid) { return(std::make_pair((uint8_t)NSPV_NTZSPROOF,Hash(BEGIN(prevtxid),END(prevtxid),BEGIN(nexttxid),END(nexttxid)))); }
+
+int32_t NSPV_txproof_msg(uint8_t *msg,int32_t vout,uint256 txid,int32_t height)
 {
-    int32_t i;
-    for (i=0; i<sizeof(NSPV_txproof_cache)/sizeof(*NSPV_txproof_cache); i++)
-        if ( NSPV_txproof_cache[i].txid == ptr->txid )
+    int32_t len = 0;
+    msg[len++] = NSPV_TXPROOF;
+    len += iguana_rwnum(1,&msg[len],sizeof(height),&height);
+    len += iguana_rwnum(1,&msg[len],sizeof(vout),&vout);
+    len += iguana_rwbignum(1,&msg[len],sizeof(txid),(uint8_t *)&txid);
+    return(len);
+}
+
+int32_t NSPV_ntzs_msg(uint8_t *msg,int32_t reqheight)
+{
+    int32_t len = 0;
+    msg[len++] = NSPV_NTZS;
+    len += iguana_rwnum(1,&msg[len],sizeof(reqheight),&reqheight);
+    return(len);
+}
+
+int32_t NSPV_ntzsproof_msg(uint8_t *msg,uint256 prevtxid,uint256 nexttxid)
+{
+    int32_t len = 0;
+    msg[len++] = NSPV_NTZSPROOF;
+    len += iguana_rwbignum(1,&msg[len],sizeof(prevtxid),(uint8_t *)&prevtxid);
+    len += iguana_rwbignum(1,&msg[len],sizeof(nexttxid),(uint8_t *)&nexttxid);
+    return(len);
+}
+
+// lowest latency peer that the per message type rate limit lets us use now, avoid is only used as a last resort. caller holds NSPV_pipeline_mutex
+CNode *NSPV_pipeline_peer(int32_t ind,NodeId avoid)
+{
+    CNode *best = 0,*fallback = 0; double rtt,bestrtt = 0.; uint32_t timestamp = (uint32_t)time(NULL);
+    BOOST_FOREACH(CNode *ptr,vNodes)
+    {
+        if ( ptr->prevtimes[ind] > timestamp )
+            ptr->prevtimes[ind] = 0;
+        if ( ptr->hSocket == INVALID_SOCKET || (ptr->nServices & NODE_NSPV) != NODE_NSPV || timestamp <= ptr->prevtimes[ind] )
+            continue;
+        if ( ptr->id == avoid )
         {
-            if ( NSPV_txproof_cache[i].txprooflen == 0 && ptr->txprooflen != 0 )
-            {
-                NSPV_txproof_purge(&NSPV_txproof_cache[i]);
-                NSPV_txproof_copy(&NSPV_txproof_cache[i],ptr);
-                return(&NSPV_txproof_cache[i]);
-            }
-            else if ( NSPV_txproof_cache[i].txprooflen != 0 || ptr->txprooflen == 0 )
-                return(&NSPV_txproof_cache[i]);
+            fallback = ptr;
+            continue;
         }
-    for (i=0; i<sizeof(NSPV_txproof_cache)/sizeof(*NSPV_txproof_cache); i++)
-        if ( NSPV_txproof_cache[i].txlen == 0 )
-            break;
-    if ( i == sizeof(NSPV_txproof_cache)/sizeof(*NSPV_txproof_cache) )
-        i = (rand() % (sizeof(NSPV_txproof_cache)/sizeof(*NSPV_txproof_cache)));
-    NSPV_txproof_purge(&NSPV_txproof_cache[i]);
-    NSPV_txproof_copy(&NSPV_txproof_cache[i],ptr);
-    fprintf(stderr,"ADD CACHE txproof %s\n",ptr->txid.GetHex().c_str());
-    return(&NSPV_txproof_cache[i]);
+        std::map<NodeId,struct NSPV_peerstat>::iterator it = NSPV_peerstats.find(ptr->id);
+        rtt = (it != NSPV_peerstats.end() && it->second.answered > 0) ? it->second.rttms : NSPV_PIPELINE_DEFAULTRTT;
+        if ( it != NSPV_peerstats.end() )
+            rtt += it->second.timeouts * NSPV_PIPELINE_TIMEOUT;
+        if ( best == 0 || rtt < bestrtt )
+            best = ptr, bestrtt = rtt;
+    }
+    return(best != 0 ? best : fallback);
 }
 
-struct NSPV_ntzsproofresp *NSPV_ntzsproof_find(uint256 prevtxid,uint256 nexttxid)
+// called from komodo_nSPVresp for every response that can complete a pipelined request
+void NSPV_pipeline_done(std::pair<uint8_t,uint256> key,CNode *pfrom)
 {
-    int32_t i;
-    for (i=0; i<sizeof(NSPV_ntzsproofresp_cache)/sizeof(*NSPV_ntzsproofresp_cache); i++)
-        if ( NSPV_ntzsproofresp_cache[i].prevtxid == prevtxid && NSPV_ntzsproofresp_cache[i].nexttxid == nexttxid )
-            return(&NSPV_ntzsproofresp_cache[i]);
-    return(0);
+    double sample;
+    pthread_mutex_lock(&NSPV_pipeline_mutex);
+    std::map<std::pair<uint8_t,uint256>,struct NSPV_inflight>::iterator it = NSPV_inflights.find(key);
+    if ( it != NSPV_inflights.end() && it->second.done == 0 && it->second.tries > 0 )
+    {
+        it->second.done = 1;
+        if ( it->second.peer == pfrom->id )
+        {
+            struct NSPV_peerstat &stat = NSPV_peerstats[pfrom->id];
+            sample = (double)(GetTimeMillis() - it->second.sentms);
+            stat.rttms = (stat.answered == 0) ? sample : (0.8 * stat.rttms + 0.2 * sample);
+            stat.answered++;
+            if ( stat.timeouts > 0 )
+                stat.timeouts--;
+        }
+    }
+    pthread_mutex_unlock(&NSPV_pipeline_mutex);
 }
 
-struct NSPV_ntzsproofresp *NSPV_ntzsproof_add(struct NSPV_ntzsproofresp *ptr)
+// sends all requests, resends the ones that time out to another peer and returns how many were answered
+int32_t NSPV_pipeline(std::vector<std::pair<std::pair<uint8_t,uint256>,std::vector<uint8_t> > > &reqs)
 {
-    int32_t i;
-    for (i=0; i<sizeof(NSPV_ntzsproofresp_cache)/sizeof(*NSPV_ntzsproofresp_cache); i++)
-        if ( NSPV_ntzsproofresp_cache[i].common.hdrs == 0 )
+    CNode *pnode; int32_t i,pending,n = 0; int64_t now,deadline = GetTimeMillis() + (int64_t)NSPV_POLLITERS*NSPV_POLLMICROS/1000;
+    if ( KOMODO_NSPV_FULLNODE || reqs.size() == 0 )
+        return(0);
+    pthread_mutex_lock(&NSPV_pipeline_mutex);
+    for (i=0; i<reqs.size(); i++)
+    {
+        struct NSPV_inflight &entry = NSPV_inflights[reqs[i].first];
+        if ( entry.tries == 0 )
+        {
+            entry.msg = reqs[i].second;
+            entry.peer = -1;
+            entry.done = 0;
+        }
+    }
+    pthread_mutex_unlock(&NSPV_pipeline_mutex);
+    while ( (now= GetTimeMillis()) < deadline )
+    {
+        pending = 0;
+        pthread_mutex_lock(&NSPV_pipeline_mutex);
+        for (i=0; i<reqs.size(); i++)
+        {
+            struct NSPV_inflight &entry = NSPV_inflights[reqs[i].first];
+            if ( entry.done != 0 )
+                continue;
+            pending++;
+            if ( entry.tries > 0 && (now - entry.sentms < NSPV_PIPELINE_TIMEOUT || entry.tries >= NSPV_PIPELINE_MAXTRIES) )
+                continue;
+            if ( (pnode= NSPV_pipeline_peer(entry.msg[0]>>1,entry.peer)) == 0 )
+                continue;
+            if ( entry.tries > 0 )
+                NSPV_peerstats[entry.peer].timeouts++;
+            pnode->PushMessage("getnSPV",entry.msg);
+            pnode->prevtimes[entry.msg[0]>>1] = (uint32_t)time(NULL);
+            entry.peer = pnode->id;
+            entry.sentms = now;
+            entry.tries++;
+        }
+        pthread_mutex_unlock(&NSPV_pipeline_mutex);
+        if ( pending == 0 )
             break;
-    if ( i == sizeof(NSPV_ntzsproofresp_cache)/sizeof(*NSPV_ntzsproofresp_cache) )
-        i = (rand() % (sizeof(NSPV_ntzsproofresp_cache)/sizeof(*NSPV_ntzsproofresp_cache)));
-    NSPV_ntzsproofresp_purge(&NSPV_ntzsproofresp_cache[i]);
-    NSPV_ntzsproofresp_copy(&NSPV_ntzsproofresp_cache[i],ptr);
-    fprintf(stderr,"ADD CACHE ntzsproof %s %s\n",ptr->prevtxid.GetHex().c_str(),ptr->nexttxid.GetHex().c_str());
-    return(&NSPV_ntzsproofresp_cache[i]);
+        usleep(NSPV_POLLMICROS / 5);
+    }
+    pthread_mutex_lock(&NSPV_pipeline_mutex);
+    for (i=0; i<reqs.size(); i++)
+    {
+        std::map<std::pair<uint8_t,uint256>,struct NSPV_inflight>::iterator it = NSPV_inflights.find(reqs[i].first);
+        if ( it != NSPV_inflights.end() )
+        {
+            n += it->second.done;
+            NSPV_inflights.erase(it);
+        }
+    }
+    pthread_mutex_unlock(&NSPV_pipeline_mutex);
+    return(n);
 }
 
 // komodo_nSPVresp is called from async message processing
@@ -145,6 +659,7 @@ void komodo_nSPVresp(CNode *pfrom,std::vector<uint8_t> response) // received a r
                 I = NSPV_inforesult;
                 NSPV_inforesp_purge(&NSPV_inforesult);
                 NSPV_rwinforesp(0,&response[1],&NSPV_inforesult);
+                pfrom->nspvversion = NSPV_inforesult.version;
                 if ( NSPV_inforesult.height < I.height )
                 {
                     //fprintf(stderr,"got old info response %u size.%d height.%d\n",timestamp,(int32_t)response.size(),NSPV_inforesult.height); // update current height and ntrz status
@@ -177,22 +692,38 @@ void komodo_nSPVresp(CNode *pfrom,std::vector<uint8_t> response) // received a r
            case NSPV_NTZSRESP:
                 NSPV_ntzsresp_purge(&NSPV_ntzsresult);
                 NSPV_rwntzsresp(0,&response[1],&NSPV_ntzsresult);
-                if ( NSPV_ntzsresp_find(NSPV_ntzsresult.reqheight) == 0 )
+                if ( NSPV_ntzsresp_find(0,NSPV_ntzsresult.reqheight) == 0 )
                     NSPV_ntzsresp_add(&NSPV_ntzsresult);
+                NSPV_pipeline_done(NSPV_reqkey_ntzs(NSPV_ntzsresult.reqheight),pfrom);
                 fprintf(stderr,"got ntzs response %u size.%d %s prev.%d, %s next.%d\n",timestamp,(int32_t)response.size(),NSPV_ntzsresult.prevntz.txid.GetHex().c_str(),NSPV_ntzsresult.prevntz.height,NSPV_ntzsresult.nextntz.txid.GetHex().c_str(),NSPV_ntzsresult.nextntz.height);
                 break;
             case NSPV_NTZSPROOFRESP:
-                NSPV_ntzsproofresp_purge(&NSPV_ntzsproofresult);
-                NSPV_rwntzsproofresp(0,&response[1],&NSPV_ntzsproofresult);
-                if ( NSPV_ntzsproof_find(NSPV_ntzsproofresult.prevtxid,NSPV_ntzsproofresult.nexttxid) == 0 )
-                    NSPV_ntzsproof_add(&NSPV_ntzsproofresult);
-                fprintf(stderr,"got ntzproof response %u size.%d prev.%d next.%d\n",timestamp,(int32_t)response.size(),NSPV_ntzsproofresult.common.prevht,NSPV_ntzsproofresult.common.nextht);
+                {
+                    struct NSPV_ntzsproofresp P; uint256 prevtxid,nexttxid; int32_t prevht,nextht;
+                    memset(&P,0,sizeof(P));
+                    NSPV_rwntzsproofresp(0,&response[1],&P);
+                    prevtxid = P.prevtxid, nexttxid = P.nexttxid, prevht = P.common.prevht, nextht = P.common.nextht;
+                    if ( NSPV_ntzsproof_find(0,prevtxid,nexttxid) == 0 )
+                        NSPV_ntzsproof_add(&P);
+                    NSPV_hdrstore_add(&P);
+                    pthread_mutex_lock(&NSPV_ntzsproof_mutex);
+                    if ( NSPV_ntzsproofwait.first.IsNull() == 0 && NSPV_ntzsproofwait == std::make_pair(prevtxid,nexttxid) )
+                    {
+                        NSPV_ntzsproofresp_purge(&NSPV_ntzsproofresult);
+                        NSPV_ntzsproofresult = P; // hands over the allocations
+                        memset(&P,0,sizeof(P));
+                    }
+                    pthread_mutex_unlock(&NSPV_ntzsproof_mutex);
+                    NSPV_ntzsproofresp_purge(&P);
+                    NSPV_pipeline_done(NSPV_reqkey_ntzsproof(prevtxid,nexttxid),pfrom);
+                    fprintf(stderr,"got ntzproof response %u size.%d prev.%d next.%d\n",timestamp,(int32_t)response.size(),prevht,nextht);
+                }
                 break;
             case NSPV_TXPROOFRESP:
                 NSPV_txproof_purge(&NSPV_txproofresult);
                 NSPV_rwtxproof(0,&response[1],&NSPV_txproofresult);
-                if ( NSPV_txproof_find(NSPV_txproofresult.txid) == 0 )
-                    NSPV_txproof_add(&NSPV_txproofresult);
+                NSPV_txproof_add(&NSPV_txproofresult);
+                NSPV_pipeline_done(NSPV_reqkey_txproof(NSPV_txproofresult.txid),pfrom);
                 fprintf(stderr,"got txproof response %u size.%d %s ht.%d\n",timestamp,(int32_t)response.size(),NSPV_txproofresult.txid.GetHex().c_str(),NSPV_txproofresult.height);
                 break;
             case NSPV_SPENTINFORESP:
@@ -205,6 +736,30 @@ void komodo_nSPVresp(CNode *pfrom,std::vector<uint8_t> response) // received a r
                 NSPV_rwbroadcastresp(0,&response[1],&NSPV_broadcastresult);
                 fprintf(stderr,"got broadcast response %u size.%d %s retcode.%d\n",timestamp,(int32_t)response.size(),NSPV_broadcastresult.txid.GetHex().c_str(),NSPV_broadcastresult.retcode);
                 break;
+            case NSPV_BATCHRESP:
+                if ( len >= 1+1+sizeof(uint256)+sizeof(uint16_t) )
+                {
+                    std::vector<std::vector<uint8_t> > items; uint256 reqhash; uint32_t itemlen; uint16_t i,num; int32_t offset = 2;
+                    offset += iguana_rwbignum(0,&response[offset],sizeof(reqhash),(uint8_t *)&reqhash);
+                    offset += iguana_rwnum(0,&response[offset],sizeof(num),&num);
+                    for (i=0; i<num && offset+sizeof(itemlen)<=len; i++)
+                    {
+                        offset += iguana_rwnum(0,&response[offset],sizeof(itemlen),&itemlen);
+                        if ( itemlen > len-offset )
+                            break;
+                        items.push_back(std::vector<uint8_t>(response.begin()+offset,response.begin()+offset+itemlen));
+                        offset += itemlen;
+                    }
+                    if ( i == num )
+                    {
+                        pthread_mutex_lock(&NSPV_batch_mutex);
+                        NSPV_batchitems.swap(items);
+                        NSPV_batchhash = reqhash;
+                        pthread_mutex_unlock(&NSPV_batch_mutex);
+                    }
+                    fprintf(stderr,"got batch response %u size.%d funcid.%d num.%d\n",timestamp,(int32_t)response.size(),response[1],num);
+                }
+                break;
             case NSPV_CCMODULEUTXOSRESP:
                 NSPV_utxosresp_purge(&NSPV_utxosresult);
                 NSPV_rwutxosresp(0, &response[1], &NSPV_utxosresult);
@@ -219,7 +774,8 @@ void komodo_nSPVresp(CNode *pfrom,std::vector<uint8_t> response) // received a r
 
 // superlite message issuing
 
-CNode *NSPV_req(CNode *pnode,uint8_t *msg,int32_t len,uint64_t mask,int32_t ind)
+// sends msg to pnode or to a random peer with the mask services, minversion skips peers not known to speak that nSPV protocol version
+CNode *NSPV_req(CNode *pnode,uint8_t *msg,int32_t len,uint64_t mask,int32_t ind,uint32_t minversion=0)
 {
     int32_t n,flag = 0; CNode *pnodes[64]; uint32_t timestamp = (uint32_t)time(NULL);
     if ( KOMODO_NSPV_FULLNODE )
@@ -235,7 +791,7 @@ CNode *NSPV_req(CNode *pnode,uint8_t *msg,int32_t len,uint64_t mask,int32_t ind)
                 ptr->prevtimes[ind] = 0;
             if ( ptr->hSocket == INVALID_SOCKET )
                 continue;
-            if ( (ptr->nServices & mask) == mask && timestamp > ptr->prevtimes[ind] )
+            if ( (ptr->nServices & mask) == mask && timestamp > ptr->prevtimes[ind] && ptr->nspvversion >= minversion )
             {
                 flag = 1;
                 pnodes[n++] = ptr;
@@ -267,9 +823,9 @@ UniValue NSPV_logout()
     if ( NSPV_logintime != 0 )
         fprintf(stderr,"scrub wif and privkey from NSPV memory\n");
     else result.push_back(Pair("status","wasnt logged in"));
-    memset(NSPV_ntzsproofresp_cache,0,sizeof(NSPV_ntzsproofresp_cache));
-    memset(NSPV_txproof_cache,0,sizeof(NSPV_txproof_cache));
-    memset(NSPV_ntzsresp_cache,0,sizeof(NSPV_ntzsresp_cache));
+    NSPV_ntzsproofresp_cache.clear();
+    NSPV_txproof_cache.clear();
+    NSPV_ntzsresp_cache.clear();
     memset(NSPV_wifstr,0,sizeof(NSPV_wifstr));
     memset(&NSPV_key,0,sizeof(NSPV_key));
     NSPV_logintime = 0;
@@ -278,6 +834,23 @@ UniValue NSPV_logout()
 
 // komodo_nSPV from main polling loop (really this belongs in its own file, but it is so small, it ended up here)
 
+// called from the polling loop, asks pto for the headers between the highest anchor and the latest notarization. the response goes through NSPV_hdrstore_add
+void NSPV_hdrstore_extend(CNode *pto,uint32_t timestamp)
+{
+    uint8_t msg[128]; int32_t len = 0; uint256 prevtxid,nexttxid; int32_t prevht,nextht;
+    if ( GetBoolArg("-nspvhdrs",true) == 0 || timestamp < NSPV_hdrsync + ASSETCHAINS_BLOCKTIME || timestamp <= pto->prevtimes[NSPV_NTZSPROOF>>1] )
+        return;
+    pthread_mutex_lock(&NSPV_hdrstore_mutex);
+    prevtxid = NSPV_hdrtip.nexttxid, prevht = NSPV_hdrtip.nextht;
+    pthread_mutex_unlock(&NSPV_hdrstore_mutex);
+    nexttxid = NSPV_inforesult.notarization.txid, nextht = NSPV_inforesult.notarization.height;
+    if ( prevht == 0 || nexttxid.IsNull() || nextht <= prevht || nextht - prevht > NSPV_HDRS_MAXRANGE ) // an on demand proof reseeds the store after a long gap
+        return;
+    NSPV_hdrsync = timestamp;
+    len = NSPV_ntzsproof_msg(msg,prevtxid,nexttxid);
+    NSPV_req(pto,msg,len,NODE_NSPV,NSPV_NTZSPROOF>>1);
+}
+
 void komodo_nSPV(CNode *pto) // polling loop from SendMessages
 {
     uint8_t msg[256]; int32_t i,len=0; uint32_t timestamp = (uint32_t)time(NULL);
@@ -289,7 +862,8 @@ void komodo_nSPV(CNode *pto) // polling loop from SendMessages
         pto->prevtimes[NSPV_INFO>>1] = 0;
     if ( KOMODO_NSPV_SUPERLITE )
     {
-        if ( timestamp > NSPV_lastinfo + ASSETCHAINS_BLOCKTIME/2 && timestamp > pto->prevtimes[NSPV_INFO>>1] + 2*ASSETCHAINS_BLOCKTIME/3 )
+        // a peer whose protocol version is not known yet is asked right away, NSPV_batch only goes to peers that can serve it
+        if ( (timestamp > NSPV_lastinfo + ASSETCHAINS_BLOCKTIME/2 || pto->nspvversion == 0) && timestamp > pto->prevtimes[NSPV_INFO>>1] + 2*ASSETCHAINS_BLOCKTIME/3 )
         {
             int32_t reqht;
             reqht = 0;
@@ -299,6 +873,7 @@ void komodo_nSPV(CNode *pto) // polling loop from SendMessages
             //fprintf(stderr,"issue getinfo\n");
             NSPV_req(pto,msg,len,NODE_NSPV,NSPV_INFO>>1);
         }
+        else NSPV_hdrstore_extend(pto,timestamp);
     }
 }
 
@@ -575,7 +1150,9 @@ UniValue NSPV_getinfo_req(int32_t reqht)
 
 uint32_t NSPV_blocktime(int32_t hdrheight)
 {
-    uint32_t timestamp; struct NSPV_inforesp old = NSPV_inforesult;
+    uint32_t timestamp; struct NSPV_hdrentry hdr; struct NSPV_inforesp old = NSPV_inforesult;
+    if ( hdrheight > 0 && NSPV_hdrstore_find(&hdr,hdrheight) != 0 )
+        return(hdr.nTime);
     if ( hdrheight > 0 )
     {
         NSPV_getinfo_req(hdrheight);
@@ -785,16 +1362,16 @@ bool NSPV_evalcode_inmempool(uint8_t evalcode,uint8_t funcid)
 
 UniValue NSPV_notarizations(int32_t reqheight)
 {
-    uint8_t msg[512]; int32_t i,iter,len = 0; struct NSPV_ntzsresp N,*ptr;
-    if ( (ptr= NSPV_ntzsresp_find(reqheight)) != 0 )
+    uint8_t msg[512]; int32_t i,iter,len = 0; struct NSPV_ntzsresp N;
+    memset(&N,0,sizeof(N));
+    if ( NSPV_ntzsresp_find(&N,reqheight) != 0 )
     {
         fprintf(stderr,"FROM CACHE NSPV_notarizations.%d\n",reqheight);
         NSPV_ntzsresp_purge(&NSPV_ntzsresult);
-        NSPV_ntzsresp_copy(&NSPV_ntzsresult,ptr);
-        return(NSPV_ntzsresp_json(ptr));
+        NSPV_ntzsresp_copy(&NSPV_ntzsresult,&N);
+        return(NSPV_ntzsresp_json(&N));
     }
-    msg[len++] = NSPV_NTZS;
-    len += iguana_rwnum(1,&msg[len],sizeof(reqheight),&reqheight);
+    len = NSPV_ntzs_msg(msg,reqheight);
     for (iter=0; iter<3; iter++)
     if ( NSPV_req(0,msg,len,NODE_NSPV,msg[0]>>1) != 0 )
     {
@@ -809,31 +1386,46 @@ UniValue NSPV_notarizations(int32_t reqheight)
     return(NSPV_ntzsresp_json(&N));
 }
 
+// the response lands in NSPV_ntzsproofresult only while NSPV_ntzsproofwait names it, so a background NSPV_hdrstore_extend proof cant replace it under the caller
 UniValue NSPV_txidhdrsproof(uint256 prevtxid,uint256 nexttxid)
 {
-    uint8_t msg[512]; int32_t i,iter,len = 0; struct NSPV_ntzsproofresp P,*ptr;
-    if ( (ptr= NSPV_ntzsproof_find(prevtxid,nexttxid)) != 0 )
+    uint8_t msg[512]; int32_t i,iter,len = 0,found = 0; struct NSPV_ntzsproofresp P; UniValue result;
+    memset(&P,0,sizeof(P));
+    if ( NSPV_ntzsproof_find(&P,prevtxid,nexttxid) != 0 )
     {
-        fprintf(stderr,"FROM CACHE NSPV_txidhdrsproof %s %s\n",ptr->prevtxid.GetHex().c_str(),ptr->nexttxid.GetHex().c_str());
+        fprintf(stderr,"FROM CACHE NSPV_txidhdrsproof %s %s\n",P.prevtxid.GetHex().c_str(),P.nexttxid.GetHex().c_str());
+        pthread_mutex_lock(&NSPV_ntzsproof_mutex);
         NSPV_ntzsproofresp_purge(&NSPV_ntzsproofresult);
-        NSPV_ntzsproofresp_copy(&NSPV_ntzsproofresult,ptr);
-        return(NSPV_ntzsproof_json(ptr));
+        NSPV_ntzsproofresult = P;
+        result = NSPV_ntzsproof_json(&NSPV_ntzsproofresult);
+        pthread_mutex_unlock(&NSPV_ntzsproof_mutex);
+        return(result);
     }
+    pthread_mutex_lock(&NSPV_ntzsproof_mutex);
     NSPV_ntzsproofresp_purge(&NSPV_ntzsproofresult);
-    msg[len++] = NSPV_NTZSPROOF;
-    len += iguana_rwbignum(1,&msg[len],sizeof(prevtxid),(uint8_t *)&prevtxid);
-    len += iguana_rwbignum(1,&msg[len],sizeof(nexttxid),(uint8_t *)&nexttxid);
-    for (iter=0; iter<3; iter++)
+    NSPV_ntzsproofwait = std::make_pair(prevtxid,nexttxid);
+    pthread_mutex_unlock(&NSPV_ntzsproof_mutex);
+    len = NSPV_ntzsproof_msg(msg,prevtxid,nexttxid);
+    for (iter=0; iter<3 && found == 0; iter++)
     if ( NSPV_req(0,msg,len,NODE_NSPV,msg[0]>>1) != 0 )
     {
-        for (i=0; i<NSPV_POLLITERS; i++)
+        for (i=0; i<NSPV_POLLITERS && found == 0; i++)
         {
             usleep(NSPV_POLLMICROS);
+            pthread_mutex_lock(&NSPV_ntzsproof_mutex);
             if ( NSPV_ntzsproofresult.prevtxid == prevtxid && NSPV_ntzsproofresult.nexttxid == nexttxid )
-                return(NSPV_ntzsproof_json(&NSPV_ntzsproofresult));
+            {
+                result = NSPV_ntzsproof_json(&NSPV_ntzsproofresult);
+                found = 1;
+            }
+            pthread_mutex_unlock(&NSPV_ntzsproof_mutex);
         }
     } else sleep(1);
-    memset(&P,0,sizeof(P));
+    pthread_mutex_lock(&NSPV_ntzsproof_mutex);
+    NSPV_ntzsproofwait = std::make_pair(zeroid,zeroid);
+    pthread_mutex_unlock(&NSPV_ntzsproof_mutex);
+    if ( found != 0 )
+        return(result);
     return(NSPV_ntzsproof_json(&P));
 }
 
@@ -849,19 +1441,19 @@ UniValue NSPV_hdrsproof(int32_t prevht,int32_t nextht)
 
 UniValue NSPV_txproof(int32_t vout,uint256 txid,int32_t height)
 {
-    uint8_t msg[512]; int32_t i,iter,len = 0; struct NSPV_txproof P,*ptr;
-    if ( (ptr= NSPV_txproof_find(txid)) != 0 )
+    uint8_t msg[512]; int32_t i,iter,len = 0; struct NSPV_txproof P; UniValue result;
+    memset(&P,0,sizeof(P));
+    if ( NSPV_txproof_find(&P,txid) != 0 )
     {
         fprintf(stderr,"FROM CACHE NSPV_txproof %s\n",txid.GetHex().c_str());
         NSPV_txproof_purge(&NSPV_txproofresult);
-        NSPV_txproof_copy(&NSPV_txproofresult,ptr);
-        return(NSPV_txproof_json(ptr));
+        NSPV_txproof_copy(&NSPV_txproofresult,&P);
+        result = NSPV_txproof_json(&P);
+        NSPV_txproof_purge(&P);
+        return(result);
     }
     NSPV_txproof_purge(&NSPV_txproofresult);
-    msg[len++] = NSPV_TXPROOF;
-    len += iguana_rwnum(1,&msg[len],sizeof(height),&height);
-    len += iguana_rwnum(1,&msg[len],sizeof(vout),&vout);
-    len += iguana_rwbignum(1,&msg[len],sizeof(txid),(uint8_t *)&txid);
+    len = NSPV_txproof_msg(msg,vout,txid,height);
     fprintf(stderr,"req txproof %s/v%d at height.%d\n",txid.GetHex().c_str(),vout,height);
     for (iter=0; iter<3; iter++)
     if ( NSPV_req(0,msg,len,NODE_NSPV,msg[0]>>1) != 0 )
@@ -899,6 +1491,148 @@ UniValue NSPV_spentinfo(uint256 txid,int32_t vout)
     return(NSPV_spentinfo_json(&I));
 }
 
+// sends the items in chunks of NSPV_BATCHMAX(funcid), a chunk that didnt fit into one response continues from the first unanswered item.
+// only peers which reported at least NSPV_BATCH_MINVERSION are asked. a listunspent address with more utxos than fit into one response
+// gets "nextskip", the skipcount to continue it at with nspv_listunspent
+UniValue NSPV_batch(std::string method,UniValue items,int32_t CCflag)
+{
+    UniValue result(UniValue::VOBJ),array(UniValue::VARR); std::vector<std::vector<uint8_t> > encoded,answers; std::vector<uint8_t> msg; uint8_t funcid,buf[128]; uint256 reqhash,txid; uint64_t mask; uint16_t num; int32_t i,j,iter,n,slen,height,vout,nextskip,skipcount = 0,done = 0,sent = 0; uint32_t filter = 0;
+    if ( method == "listunspent" )
+        funcid = NSPV_UTXOS;
+    else if ( method == "listtransactions" )
+        funcid = NSPV_TXIDS;
+    else if ( method == "txproof" )
+        funcid = NSPV_TXPROOF;
+    else if ( method == "spentinfo" )
+        funcid = NSPV_SPENTINFO;
+    else throw runtime_error("unsupported batch method " + method + "\n");
+    if ( funcid == NSPV_UTXOS || funcid == NSPV_TXIDS )
+        mask = NODE_ADDRINDEX;
+    else if ( funcid == NSPV_SPENTINFO )
+        mask = NODE_SPENTINDEX;
+    else mask = NODE_NSPV;
+    for (i=0; i<items.size(); i++)
+    {
+        n = 0;
+        if ( funcid == NSPV_UTXOS || funcid == NSPV_TXIDS )
+        {
+            std::string coinaddr = items[i].get_str();
+            if ( coinaddr.size() >= 64 || bitcoin_base58decode(buf,(char *)coinaddr.c_str()) != 25 )
+                throw runtime_error("invalid address " + coinaddr + "\n");
+            slen = (int32_t)coinaddr.size();
+            buf[n++] = slen;
+            memcpy(&buf[n],coinaddr.c_str(),slen), n += slen;
+            buf[n++] = (CCflag != 0);
+            n += iguana_rwnum(1,&buf[n],sizeof(skipcount),&skipcount);
+            n += iguana_rwnum(1,&buf[n],sizeof(filter),&filter);
+        }
+        else
+        {
+            txid = Parseuint256((char *)find_value(items[i],"txid").get_str().c_str());
+            vout = find_value(items[i],"vout").isNull() ? 0 : find_value(items[i],"vout").get_int();
+            if ( funcid == NSPV_TXPROOF )
+            {
+                height = find_value(items[i],"height").isNull() ? 0 : find_value(items[i],"height").get_int();
+                n += iguana_rwnum(1,&buf[n],sizeof(height),&height);
+            }
+            n += iguana_rwnum(1,&buf[n],sizeof(vout),&vout);
+            n += iguana_rwbignum(1,&buf[n],sizeof(txid),(uint8_t *)&txid);
+        }
+        encoded.push_back(std::vector<uint8_t>(buf,buf+n));
+    }
+    while ( done < encoded.size() )
+    {
+        num = (uint16_t)std::min((int32_t)encoded.size() - done,(int32_t)NSPV_BATCHMAX(funcid));
+        msg.resize(1 + 1 + sizeof(num));
+        msg[0] = NSPV_BATCH;
+        msg[1] = funcid;
+        iguana_rwnum(1,&msg[2],sizeof(num),&num);
+        for (i=0; i<num; i++)
+            msg.insert(msg.end(),encoded[done+i].begin(),encoded[done+i].end());
+        reqhash = Hash(msg.begin(),msg.end());
+        answers.clear();
+        for (iter=0; iter<3 && answers.size() == 0; iter++)
+        if ( NSPV_req(0,&msg[0],(int32_t)msg.size(),mask,msg[0]>>1,NSPV_BATCH_MINVERSION) != 0 )
+        {
+            sent++;
+            for (i=0; i<NSPV_POLLITERS; i++)
+            {
+                usleep(NSPV_POLLMICROS);
+                pthread_mutex_lock(&NSPV_batch_mutex);
+                if ( NSPV_batchhash == reqhash )
+                {
+                    answers.swap(NSPV_batchitems);
+                    NSPV_batchhash.SetNull();
+                }
+                pthread_mutex_unlock(&NSPV_batch_mutex);
+                if ( answers.size() != 0 )
+                    break;
+            }
+        } else sleep(1);
+        if ( answers.size() == 0 )
+            break;
+        for (j=0; j<answers.size(); j++)
+        {
+            std::vector<uint8_t> &item = answers[j];
+            if ( item.size() == 0 )
+            {
+                UniValue obj(UniValue::VOBJ);
+                obj.push_back(Pair("result","error"));
+                obj.push_back(Pair("error","no result"));
+                array.push_back(obj);
+            }
+            else if ( item[0] == NSPV_UTXOSRESP )
+            {
+                struct NSPV_utxosresp U; UniValue obj;
+                memset(&U,0,sizeof(U));
+                slen = NSPV_rwutxosresp(0,&item[1],&U);
+                obj = NSPV_utxosresp_json(&U);
+                if ( 1 + slen + sizeof(nextskip) <= item.size() )
+                {
+                    iguana_rwnum(0,&item[1+slen],sizeof(nextskip),&nextskip);
+                    if ( nextskip >= 0 )
+                        obj.push_back(Pair("nextskip",(int64_t)nextskip));
+                }
+                array.push_back(obj);
+                NSPV_utxosresp_purge(&U);
+            }
+            else if ( item[0] == NSPV_TXIDSRESP )
+            {
+                struct NSPV_txidsresp T;
+                memset(&T,0,sizeof(T));
+                NSPV_rwtxidsresp(0,&item[1],&T);
+                array.push_back(NSPV_txidsresp_json(&T));
+                NSPV_txidsresp_purge(&T);
+            }
+            else if ( item[0] == NSPV_TXPROOFRESP )
+            {
+                struct NSPV_txproof P;
+                memset(&P,0,sizeof(P));
+                NSPV_rwtxproof(0,&item[1],&P);
+                NSPV_txproof_add(&P);
+                array.push_back(NSPV_txproof_json(&P));
+                NSPV_txproof_purge(&P);
+            }
+            else if ( item[0] == NSPV_SPENTINFORESP )
+            {
+                struct NSPV_spentinfo S;
+                memset(&S,0,sizeof(S));
+                NSPV_rwspentinfo(0,&item[1],&S);
+                array.push_back(NSPV_spentinfo_json(&S));
+                NSPV_spentinfo_purge(&S);
+            }
+        }
+        done += (int32_t)answers.size();
+    }
+    result.push_back(Pair("result",done == encoded.size() ? "success" : "error"));
+    if ( done != encoded.size() )
+        result.push_back(Pair("error",sent == 0 ? "no peer with nSPV protocol version for batches" : "no batch result"));
+    result.push_back(Pair("items",array));
+    result.push_back(Pair("numitems",(int64_t)done));
+    result.push_back(Pair("lastpeer",NSPV_lastpeer));
+    return(result);
+}
+
 UniValue NSPV_broadcast(char *hex)
 {
     uint8_t *msg,*data; uint256 txid; int32_t i,n,iter,len = 0; struct NSPV_broadcastresp B;
@@ -44,7 +44,6 @@ int32_t NSPV_validatehdrs(struct NSPV_ntzsproofresp *ptr)
         if ( blockhash != ptr->common.hdrs[i].hashPrevBlock )
             return(-i-13);
     }
-    sleep(1); // need this to get past the once per second rate limiter per message
     if ( NSPV_txextract(tx,ptr->prevntz,ptr->prevtxlen) < 0 )
         return(-8);
     else if ( tx.GetHash() != ptr->prevtxid )
@@ -58,17 +57,11 @@ int32_t NSPV_validatehdrs(struct NSPV_ntzsproofresp *ptr)
     return(0);
 }
 
-int32_t NSPV_gettransaction(int32_t skipvalidation,int32_t vout,uint256 txid,int32_t height,CTransaction &tx,uint256 &hashblock,int32_t &txheight,int32_t &currentheight,int64_t extradata,uint32_t tiptime,int64_t &rewardsum)
+static int32_t NSPV_gettransaction_proof(struct NSPV_txproof *ptr,int32_t skipvalidation,int32_t vout,uint256 txid,int32_t height,CTransaction &tx,uint256 &hashblock,int32_t &txheight,int32_t &currentheight,int64_t extradata,uint32_t tiptime,int64_t &rewardsum)
 {
-    struct NSPV_txproof *ptr; int32_t i,offset,retval; int64_t rewards = 0; uint32_t nLockTime; std::vector<uint8_t> proof;
+    struct NSPV_hdrentry hdr; int32_t i,offset,retval; int64_t rewards = 0; uint32_t nLockTime; std::vector<uint8_t> proof;
     retval = skipvalidation != 0 ? 0 : -1;
 
-    //fprintf(stderr,"NSPV_gettx %s/v%d ht.%d\n",txid.GetHex().c_str(),vout,height);
-    if ( (ptr= NSPV_txproof_find(txid)) == 0 )
-    {
-        NSPV_txproof(vout,txid,height);
-        ptr = &NSPV_txproofresult;
-    }
     hashblock=ptr->hashblock;
     txheight=ptr->height;
     currentheight=NSPV_inforesult.height;
@@ -101,6 +94,17 @@ int32_t NSPV_gettransaction(int32_t skipvalidation,int32_t vout,uint256 txid,int
             proof.resize(ptr->txprooflen);
             memcpy(&proof[0],ptr->txproof,ptr->txprooflen);
         }
+        if ( NSPV_hdrstore_find(&hdr,height) != 0 ) // header already validated, only the merkle branch is left to check
+        {
+            std::vector<uint256> txids; uint256 proofroot;
+            proofroot = BitcoinGetProofMerkleRoot(proof,txids);
+            if ( hdr.blockhash != hashblock || proofroot != hdr.merkleroot || txids.size() == 0 || txids[0] != txid )
+            {
+                fprintf(stderr,"stored hdr.%d mismatch txid.%s prooflen.%d\n",height,txid.GetHex().c_str(),(int32_t)proof.size());
+                return(-2006);
+            }
+            return(0);
+        }
         NSPV_notarizations(height); // gets the prev and next notarizations
         if ( NSPV_inforesult.notarization.height >= height && (NSPV_ntzsresult.prevntz.height == 0 || NSPV_ntzsresult.prevntz.height >= NSPV_ntzsresult.nextntz.height) )
         {
@@ -135,6 +139,21 @@ int32_t NSPV_gettransaction(int32_t skipvalidation,int32_t vout,uint256 txid,int
     return(retval);
 }
 
+int32_t NSPV_gettransaction(int32_t skipvalidation,int32_t vout,uint256 txid,int32_t height,CTransaction &tx,uint256 &hashblock,int32_t &txheight,int32_t &currentheight,int64_t extradata,uint32_t tiptime,int64_t &rewardsum)
+{
+    struct NSPV_txproof P; int32_t retval;
+    //fprintf(stderr,"NSPV_gettx %s/v%d ht.%d\n",txid.GetHex().c_str(),vout,height);
+    memset(&P,0,sizeof(P));
+    if ( NSPV_txproof_find(&P,txid) == 0 ) // works on a private copy, the message thread may evict the cached entry
+    {
+        NSPV_txproof(vout,txid,height);
+        NSPV_txproof_copy(&P,&NSPV_txproofresult);
+    }
+    retval = NSPV_gettransaction_proof(&P,skipvalidation,vout,txid,height,tx,hashblock,txheight,currentheight,extradata,tiptime,rewardsum);
+    NSPV_txproof_purge(&P);
+    return(retval);
+}
+
 int32_t NSPV_vinselect(int32_t *aboveip,int64_t *abovep,int32_t *belowip,int64_t *belowp,struct NSPV_utxoresp utxos[],int32_t numunspents,int64_t value)
 {
     int32_t i,abovei,belowi; int64_t above,below,gap,atx_value;
@@ -259,6 +278,46 @@ bool NSPV_SignTx(CMutableTransaction &mtx,int32_t vini,int64_t utxovalue,const C
     return(false);
 }
 
+// fills the txproof, ntzs and ntzsproof caches for all vins with pipelined requests, so the sequential validation in NSPV_signtx is served from cache
+void NSPV_prefetch(CMutableTransaction &mtx,struct NSPV_utxoresp used[])
+{
+    std::vector<std::pair<std::pair<uint8_t,uint256>,std::vector<uint8_t> > > reqs; std::set<std::pair<uint8_t,uint256> > seen; std::pair<uint8_t,uint256> key; struct NSPV_ntzsresp N; struct NSPV_hdrentry hdr; uint8_t msg[512]; int32_t i,len,n = mtx.vin.size();
+    for (i=0; i<n; i++)
+    {
+        key = NSPV_reqkey_txproof(mtx.vin[i].prevout.hash);
+        if ( NSPV_txproof_find(0,mtx.vin[i].prevout.hash) == 0 && seen.insert(key).second != 0 )
+        {
+            len = NSPV_txproof_msg(msg,mtx.vin[i].prevout.n,mtx.vin[i].prevout.hash,used[i].height);
+            reqs.push_back(std::make_pair(key,std::vector<uint8_t>(msg,msg+len)));
+        }
+    }
+    NSPV_pipeline(reqs);
+    reqs.clear();
+    for (i=0; i<n; i++)
+    {
+        key = NSPV_reqkey_ntzs(used[i].height);
+        if ( NSPV_hdrstore_find(&hdr,used[i].height) == 0 && NSPV_ntzsresp_find(0,used[i].height) == 0 && seen.insert(key).second != 0 )
+        {
+            len = NSPV_ntzs_msg(msg,used[i].height);
+            reqs.push_back(std::make_pair(key,std::vector<uint8_t>(msg,msg+len)));
+        }
+    }
+    NSPV_pipeline(reqs);
+    reqs.clear();
+    for (i=0; i<n; i++)
+    {
+        if ( NSPV_hdrstore_find(&hdr,used[i].height) != 0 || NSPV_ntzsresp_find(&N,used[i].height) == 0 || N.prevntz.height == 0 || N.prevntz.height > N.nextntz.height )
+            continue;
+        key = NSPV_reqkey_ntzsproof(N.prevntz.txid,N.nextntz.txid);
+        if ( NSPV_ntzsproof_find(0,N.prevntz.txid,N.nextntz.txid) == 0 && seen.insert(key).second != 0 )
+        {
+            len = NSPV_ntzsproof_msg(msg,N.prevntz.txid,N.nextntz.txid);
+            reqs.push_back(std::make_pair(key,std::vector<uint8_t>(msg,msg+len)));
+        }
+    }
+    NSPV_pipeline(reqs);
+}
+
 std::string NSPV_signtx(int64_t &rewardsum,int64_t &interestsum,UniValue &retcodes,CMutableTransaction &mtx,uint64_t txfee,CScript opret,struct NSPV_utxoresp used[])
 {
     CTransaction vintx; std::string hex; uint256 hashBlock; int64_t interest=0,change,totaloutputs=0,totalinputs=0; int32_t i,utxovout,n,validation,txheight,currentheight;
@@ -279,11 +338,10 @@ std::string NSPV_signtx(int64_t &rewardsum,int64_t &interestsum,UniValue &retcod
     }
     if ( opret.size() > 0 )
         mtx.vout.push_back(CTxOut(0,opret));
+    NSPV_prefetch(mtx,used);
     for (i=0; i<n; i++)
     {
         utxovout = mtx.vin[i].prevout.n;
-        if ( i > 0 )
-            sleep(1);
         validation = NSPV_gettransaction(0,utxovout,mtx.vin[i].prevout.hash,used[i].height,vintx,hashBlock,txheight,currentheight,used[i].extradata,NSPV_tiptime,rewardsum);
         retcodes.push_back(validation);
         if ( validation != -1 ) // most others are degraded security
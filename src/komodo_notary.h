@@ -288,15 +288,76 @@ int32_t komodo_chosennotary(int32_t *notaryidp,int32_t height,uint8_t *pubkey33,
 
 //struct komodo_state *komodo_stateptr(char *symbol,char *dest);
 
+// NPOINTS are indexed by the heights they cover, (notarized_height-MoMdepth,notarized_height], in buckets of KOMODO_NPOINTS_BUCKETSIZE heights
+// each bucket lists the overlapping NPOINTS indices in ascending order, so scanning it backwards finds the latest checkpoint first
+
+int32_t komodo_npbucket_range(struct notarized_checkpoint *np,int32_t *firstp,int32_t *lastp)
+{
+    int32_t lo;
+    if ( np->MoMdepth == 0 || np->notarized_height < 0 )
+        return(-1);
+    if ( (lo= np->notarized_height - (np->MoMdepth & 0xffff) + 1) < 0 )
+        lo = 0;
+    *firstp = lo / KOMODO_NPOINTS_BUCKETSIZE;
+    *lastp = np->notarized_height / KOMODO_NPOINTS_BUCKETSIZE;
+    return(*lastp >= *firstp ? 0 : -1);
+}
+
+void komodo_npindex_add(struct komodo_state *sp,int32_t i)
+{
+    static uint256 zero; int32_t b,first,last; struct notarized_bucket *bp; struct notarized_checkpoint *np = &sp->NPOINTS[i];
+    if ( komodo_npbucket_range(np,&first,&last) == 0 )
+    {
+        if ( last >= sp->NUM_NPBUCKETS )
+        {
+            sp->NPBUCKETS = (struct notarized_bucket *)realloc(sp->NPBUCKETS,(last+1) * sizeof(*sp->NPBUCKETS));
+            memset(&sp->NPBUCKETS[sp->NUM_NPBUCKETS],0,(last+1 - sp->NUM_NPBUCKETS) * sizeof(*sp->NPBUCKETS));
+            sp->NUM_NPBUCKETS = last+1;
+        }
+        for (b=first; b<=last; b++)
+        {
+            bp = &sp->NPBUCKETS[b];
+            if ( bp->num >= bp->max )
+            {
+                bp->max = (bp->max == 0) ? 16 : (bp->max << 1);
+                bp->inds = (int32_t *)realloc(bp->inds,bp->max * sizeof(*bp->inds));
+            }
+            bp->inds[bp->num++] = i;
+        }
+    }
+    if ( np->MoM != zero )
+    {
+        sp->MoMinds = (int32_t *)realloc(sp->MoMinds,(sp->NUM_MoMinds+1) * sizeof(*sp->MoMinds));
+        sp->MoMinds[sp->NUM_MoMinds++] = i;
+    }
+}
+
+void komodo_npindex_remove(struct komodo_state *sp,int32_t i)
+{
+    int32_t b,first,last; struct notarized_bucket *bp;
+    if ( komodo_npbucket_range(&sp->NPOINTS[i],&first,&last) == 0 )
+    {
+        for (b=first; b<=last && b<sp->NUM_NPBUCKETS; b++)
+        {
+            bp = &sp->NPBUCKETS[b];
+            if ( bp->num > 0 && bp->inds[bp->num-1] == i )
+                bp->num--;
+        }
+    }
+    if ( sp->NUM_MoMinds > 0 && sp->MoMinds[sp->NUM_MoMinds-1] == i )
+        sp->NUM_MoMinds--;
+}
+
 struct notarized_checkpoint *komodo_npptr_for_height(int32_t height, int *idx)
 {
-    char symbol[KOMODO_ASSETCHAIN_MAXLEN],dest[KOMODO_ASSETCHAIN_MAXLEN]; int32_t i; struct komodo_state *sp; struct notarized_checkpoint *np = 0;
-    if ( (sp= komodo_stateptr(symbol,dest)) != 0 )
+    char symbol[KOMODO_ASSETCHAIN_MAXLEN],dest[KOMODO_ASSETCHAIN_MAXLEN]; int32_t j,b; struct komodo_state *sp; struct notarized_bucket *bp; struct notarized_checkpoint *np = 0;
+    if ( (sp= komodo_stateptr(symbol,dest)) != 0 && height >= 0 && (b= height / KOMODO_NPOINTS_BUCKETSIZE) < sp->NUM_NPBUCKETS )
     {
-        for (i=sp->NUM_NPOINTS-1; i>=0; i--)
+        bp = &sp->NPBUCKETS[b];
+        for (j=bp->num-1; j>=0; j--)
         {
-            *idx = i;
-            np = &sp->NPOINTS[i];
+            *idx = bp->inds[j];
+            np = &sp->NPOINTS[*idx];
             if ( np->MoMdepth != 0 && height > np->notarized_height-(np->MoMdepth&0xffff) && height <= np->notarized_height )
                 return(np);
         }
@@ -322,17 +383,9 @@ struct notarized_checkpoint *komodo_npptr_at(int idx)
 
 int32_t komodo_prevMoMheight()
 {
-    static uint256 zero;
-    char symbol[KOMODO_ASSETCHAIN_MAXLEN],dest[KOMODO_ASSETCHAIN_MAXLEN]; int32_t i; struct komodo_state *sp; struct notarized_checkpoint *np = 0;
-    if ( (sp= komodo_stateptr(symbol,dest)) != 0 )
-    {
-        for (i=sp->NUM_NPOINTS-1; i>=0; i--)
-        {
-            np = &sp->NPOINTS[i];
-            if ( np->MoM != zero )
-                return(np->notarized_height);
-        }
-    }
+    char symbol[KOMODO_ASSETCHAIN_MAXLEN],dest[KOMODO_ASSETCHAIN_MAXLEN]; struct komodo_state *sp;
+    if ( (sp= komodo_stateptr(symbol,dest)) != 0 && sp->NUM_MoMinds > 0 )
+        return(sp->NPOINTS[sp->MoMinds[sp->NUM_MoMinds-1]].notarized_height);
     return(0);
 }
 
@@ -479,6 +532,25 @@ void komodo_notarized_update(struct komodo_state *sp,int32_t nHeight,int32_t not
     sp->NOTARIZED_DESTTXID = np->notarized_desttxid = notarized_desttxid;
     sp->MoM = np->MoM = MoM;
     sp->MoMdepth = np->MoMdepth = MoMdepth;
+    komodo_npindex_add(sp,sp->NUM_NPOINTS-1);
+    portable_mutex_unlock(&komodo_mutex);
+}
+
+void komodo_notarized_undo(struct komodo_state *sp,int32_t nHeight,int32_t notarized_height)
+{
+    struct notarized_checkpoint *np;
+    portable_mutex_lock(&komodo_mutex);
+    if ( sp->NUM_NPOINTS > 0 )
+    {
+        np = &sp->NPOINTS[sp->NUM_NPOINTS-1];
+        if ( np->nHeight == nHeight && np->notarized_height == notarized_height )
+        {
+            komodo_npindex_remove(sp,sp->NUM_NPOINTS-1);
+            sp->NUM_NPOINTS--;
+            if ( sp->last_NPOINTSi >= sp->NUM_NPOINTS )
+                sp->last_NPOINTSi = 0;
+        }
+    }
     portable_mutex_unlock(&komodo_mutex);
 }
 
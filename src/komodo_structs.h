@@ -47,6 +47,7 @@
 #define KOMODO_KVBINARY 2
 #define KOMODO_KVDURATION 1440
 #define KOMODO_ASSETCHAIN_MAXLEN 65
+#define KOMODO_NPOINTS_BUCKETSIZE 1024 // heights per bucket of the notarized checkpoint index
 
 #ifndef _BITS256
 #define _BITS256
@@ -58,6 +59,7 @@ union _bits320 { uint8_t bytes[40]; uint16_t ushorts[20]; uint32_t uints[10]; ui
 typedef union _bits320 bits320;
 
 struct komodo_kv { UT_hash_handle hh; bits256 pubkey; uint8_t *key,*value; int32_t height; uint32_t flags; uint16_t keylen,valuesize; };
+struct komodo_kvitem { std::string key; std::vector<uint8_t> value; bits256 pubkey; uint256 txid; int32_t height; uint32_t flags; uint8_t pending; };
 
 struct komodo_event_notarized { uint256 blockhash,desttxid,MoM; int32_t notarizedheight,MoMdepth; char dest[16]; };
 struct komodo_event_pubkeys { uint8_t num; uint8_t pubkeys[64][33]; };
@@ -92,6 +94,8 @@ struct notarized_checkpoint
     int32_t nHeight,notarized_height,MoMdepth,MoMoMdepth,MoMoMoffset,kmdstarti,kmdendi;
 };
 
+struct notarized_bucket { int32_t num,max; int32_t *inds; }; // NPOINTS indices overlapping this height range, ascending
+
 struct komodo_ccdataMoM
 {
     uint256 MoM;
@@ -123,6 +127,8 @@ struct komodo_state
     uint32_t SAVEDTIMESTAMP;
     uint64_t deposited,issued,withdrawn,approved,redeemed,shorted;
     struct notarized_checkpoint *NPOINTS; int32_t NUM_NPOINTS,last_NPOINTSi;
+    struct notarized_bucket *NPBUCKETS; int32_t NUM_NPBUCKETS;
+    int32_t *MoMinds,NUM_MoMinds;
     struct komodo_event **Komodo_events; int32_t Komodo_numevents;
     uint32_t RTbufs[64][3]; uint64_t RTmask;
 };
@@ -1724,6 +1724,9 @@ void komodo_args(char *argv0)
     NOTARY_PUBKEY = GetArg("-pubkey", "");
     KOMODO_DEALERNODE = GetArg("-dealer",0);
     KOMODO_TESTNODE = GetArg("-testnode",0);
+    KOMODO_STATETHREADS = GetArg("-statethreads",0);
+    KOMODO_CCPARALLEL = GetArg("-ccparallel",1);
+    KOMODO_NSPV_CACHEMB = GetArg("-nspvcache",64);
     ASSETCHAINS_STAKED_SPLIT_PERCENTAGE = GetArg("-splitperc",0);
     if ( strlen(NOTARY_PUBKEY.c_str()) == 66 )
     {
@@ -1895,6 +1898,12 @@ void komodo_args(char *argv0)
         fprintf(stderr,"ASSETCHAINS_SUPPLY %llu\n",(long long)ASSETCHAINS_SUPPLY);
         
         KOMODO_DEX_P2P = GetArg("-dexp2p",0); // 1 normal node, 2 full node
+        KOMODO_DEX_VALIDATORS = GetArg("-dexvalidators",2); // 0 processes DEX packets inline on the net thread
+        KOMODO_DEX_STORE = GetArg("-dexstore",0); // 1 keeps accepted datablobs on disk for a warm restart
+        KOMODO_DEX_RECON = GetArg("-dexrecon",1); // 0 never offers or answers 'S' set sketches
+        KOMODO_DEX_POWTHREADS = GetArg("-dexpowthreads",2); // nonce search threads for higher priority DEX broadcasts
+        KOMODO_DEX_RELAYBPS = GetArg("-dexrelaybps",0); // 0 is unlimited, caps the push relay per peer
+        KOMODO_DEX_RELAYTOTALBPS = GetArg("-dexrelaytotalbps",0); // 0 is unlimited, caps the push relay over all peers
         ASSETCHAINS_COMMISSION = GetArg("-ac_perc",0);
         ASSETCHAINS_OVERRIDE_PUBKEY = GetArg("-ac_pubkey","");
         ASSETCHAINS_SCRIPTPUB = GetArg("-ac_script","");
@@ -30,6 +30,7 @@
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "checkqueue.h"
+#include "core_memusage.h"
 #include "consensus/upgrades.h"
 #include "consensus/validation.h"
 #include "deprecation.h"
@@ -110,9 +111,11 @@ bool fCheckBlockIndex = false;
 bool fCheckpointsEnabled = true;
 bool fCoinbaseEnforcedProtectionEnabled = true;
 size_t nCoinCacheUsage = 5000 * 300;
+size_t nTxCacheUsage = DEFAULT_TXCACHE << 20;
 uint64_t nPruneTarget = 0;
 bool fAlerts = DEFAULT_ALERTS;
 bool fUnspentCCIndex = false;
+bool fTokensIndex = false;
 
 /* If the tip is older than this (in seconds), the node is considered to be in initial block download.
  */
@@ -2065,6 +2068,7 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
         // This is done last to help prevent CPU exhaustion denial-of-service attacks.
         PrecomputedTransactionData txdata(tx);
         std::shared_ptr<CCheckCCEvalCodes> evalcodeChecker(new CCheckCCEvalCodes());
+        evalcodeChecker->snapshot.Set(chainActive.Tip());  // context of the CC eval cache entries stored here
         if (!ContextualCheckInputs(tx, state, view, true, STANDARD_SCRIPT_VERIFY_FLAGS, true, txdata, Params().GetConsensus(), consensusBranchId, evalcodeChecker))
         {
             //fprintf(stderr,"accept failure.9\n");
@@ -2119,6 +2123,10 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
                 if (fUnspentCCIndex) {
                     pool.addUnspentCCIndex(entry, view);  // add mempool unspent cc index for cc vin/vouts
                 }
+
+                if (fTokensIndex) {
+                    pool.addTokensIndex(entry, view);
+                }
             }
         }
     }
@@ -2186,6 +2194,31 @@ bool GetAddressUnspent(uint160 addressHash, int type,
     return true;
 }
 
+bool GetAddressUnspentPage(uint160 addressHash, int type, int &skip, int maxOutputs,
+                           std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs)
+{
+    if (!fAddressIndex)
+        return error("address index not enabled");
+
+    if (!pblocktree->ReadAddressUnspentIndexPage(addressHash, type, skip, maxOutputs, unspentOutputs))
+        return error("unable to get txids for address");
+
+    return true;
+}
+
+bool GetAddressUnspentPages(const std::vector<std::pair<uint160, int> > &addresses, std::vector<int> &skips, int maxOutputs,
+                            std::vector<std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > > &pages,
+                            std::vector<int> &nextSkips)
+{
+    if (!fAddressIndex)
+        return error("address index not enabled");
+
+    if (!pblocktree->ReadAddressUnspentIndexPages(addresses, skips, maxOutputs, pages, nextSkips))
+        return error("unable to get txids for addresses");
+
+    return true;
+}
+
 bool GetUnspentCCIndex(uint160 addressHash, uint256 creationId,
                        std::vector<std::pair<CUnspentCCIndexKey, CUnspentCCIndexValue> > &unspentOutputs, int32_t beginHeight, int32_t endHeight, int64_t maxOutputs)
 {
@@ -2198,6 +2231,42 @@ bool GetUnspentCCIndex(uint160 addressHash, uint256 creationId,
     return true;
 }
 
+bool GetTokensIndex(uint256 tokenid, uint160 addressHash,
+                    std::vector<std::pair<CTokensIndexKey, CTokensIndexValue> > &unspentOutputs, bool fMempool)
+{
+    if (!fTokensIndex)
+        return error("tokens index not enabled");
+
+    if (!pblocktree->ReadTokensIndex(tokenid, addressHash, unspentOutputs))
+        return error("unable to get outputs for tokenid from tokens index");
+
+    if (fMempool) {
+        std::vector<std::pair<CTokensIndexKey, CTokensIndexValue> > memOutputs;
+        std::vector<CTokensIndexKey> memSpent;
+        mempool.getTokensIndex(tokenid, addressHash, memOutputs, memSpent);
+        unspentOutputs.insert(unspentOutputs.end(), memOutputs.begin(), memOutputs.end());
+        if (memSpent.size() > 0) {
+            std::set<CTokensIndexKey, CTokensIndexKeyCompare> spent(memSpent.begin(), memSpent.end());
+            std::vector<std::pair<CTokensIndexKey, CTokensIndexValue> >::iterator it;
+            it = std::remove_if(unspentOutputs.begin(), unspentOutputs.end(),
+                [&spent](const std::pair<CTokensIndexKey, CTokensIndexValue> &o) { return spent.count(o.first) != 0; });
+            unspentOutputs.erase(it, unspentOutputs.end());
+        }
+    }
+    return true;
+}
+
+bool GetTokensCreate(uint256 tokenid, std::vector<std::pair<uint256, CTokensIndexValue> > &creates)
+{
+    if (!fTokensIndex)
+        return error("tokens index not enabled");
+
+    if (!pblocktree->ReadTokensCreate(tokenid, creates))
+        return error("unable to get token creations from tokens index");
+
+    return true;
+}
+
 struct CompareBlocksByHeightMain
 {
     bool operator()(const CBlockIndex* a, const CBlockIndex* b) const
@@ -2240,6 +2309,136 @@ bool myAddtomempool(const CTransaction &tx, CValidationState *pstate, bool fSkip
     else return(true);
 }
 
+/**
+ * Decoded confirmed transactions, so that the cc modules looking up the same creation txids,
+ * batons and funding txids over and over dont go to ReadTxIndex/OpenBlockFile every time.
+ * Sharded by txid, each shard is an LRU bounded to its part of -txcache.
+ */
+static const int TXCACHE_SHARDS = 16;
+
+struct CTxCacheEntry
+{
+    std::shared_ptr<const CTransaction> tx;
+    uint256 hashBlock;
+    int nHeight; // -1 when it was read back from disk rather than seen connecting
+    size_t nBytes;
+    std::list<uint256>::iterator itLRU;
+};
+
+struct CTxCacheShard
+{
+    CCriticalSection cs;
+    std::map<uint256, CTxCacheEntry> mapEntries;
+    std::list<uint256> listLRU; // most recently used first
+    size_t nBytes;
+    CTxCacheShard() : nBytes(0) {}
+};
+
+static CTxCacheShard txCacheShards[TXCACHE_SHARDS];
+static std::atomic<int64_t> nTxCacheHits(0), nTxCacheMisses(0), nTxCacheInserts(0), nTxCacheEvictions(0), nTxCacheInvalidations(0);
+
+static CTxCacheShard& TxCacheShard(const uint256 &hash)
+{
+    return txCacheShards[hash.GetCheapHash() % TXCACHE_SHARDS];
+}
+
+static bool TxCacheLookup(const uint256 &hash, CTransaction &txOut, uint256 &hashBlock)
+{
+    if (nTxCacheUsage == 0)
+        return false;
+    CTxCacheShard &shard = TxCacheShard(hash);
+    LOCK(shard.cs);
+    std::map<uint256, CTxCacheEntry>::iterator it = shard.mapEntries.find(hash);
+    if (it == shard.mapEntries.end()) {
+        nTxCacheMisses++;
+        return false;
+    }
+    shard.listLRU.splice(shard.listLRU.begin(), shard.listLRU, it->second.itLRU);
+    txOut = *it->second.tx;
+    hashBlock = it->second.hashBlock;
+    nTxCacheHits++;
+    return true;
+}
+
+static void TxCacheInsert(const CTransaction &tx, const uint256 &hashBlock, int nHeight)
+{
+    size_t nShardMax = nTxCacheUsage / TXCACHE_SHARDS;
+    size_t nBytes = sizeof(CTxCacheEntry) + RecursiveDynamicUsage(tx) + sizeof(tx);
+    if (nBytes > nShardMax / 8)
+        return;
+    const uint256 &hash = tx.GetHash();
+    CTxCacheShard &shard = TxCacheShard(hash);
+    LOCK(shard.cs);
+    std::map<uint256, CTxCacheEntry>::iterator it = shard.mapEntries.find(hash);
+    if (it != shard.mapEntries.end()) {
+        it->second.hashBlock = hashBlock;
+        if (nHeight >= 0)
+            it->second.nHeight = nHeight;
+        return;
+    }
+    CTxCacheEntry &entry = shard.mapEntries[hash];
+    entry.tx = std::make_shared<const CTransaction>(tx);
+    entry.hashBlock = hashBlock;
+    entry.nHeight = nHeight;
+    entry.nBytes = nBytes;
+    entry.itLRU = shard.listLRU.insert(shard.listLRU.begin(), hash);
+    shard.nBytes += nBytes;
+    nTxCacheInserts++;
+    while (shard.nBytes > nShardMax && !shard.listLRU.empty()) {
+        it = shard.mapEntries.find(shard.listLRU.back());
+        shard.nBytes -= it->second.nBytes;
+        shard.mapEntries.erase(it);
+        shard.listLRU.pop_back();
+        nTxCacheEvictions++;
+    }
+}
+
+/** Cache the cc transactions of a newly connected block, those are the ones validation looks up again */
+static void TxCacheConnectBlock(const CBlock &block, const CBlockIndex *pindex)
+{
+    if (nTxCacheUsage == 0)
+        return;
+    BOOST_FOREACH(const CTransaction &tx, block.vtx) {
+        BOOST_FOREACH(const CTxOut &txout, tx.vout) {
+            if (txout.scriptPubKey.IsPayToCryptoCondition()) {
+                TxCacheInsert(tx, pindex->GetBlockHash(), pindex->GetHeight());
+                break;
+            }
+        }
+    }
+}
+
+static void TxCacheDisconnectBlock(const CBlock &block)
+{
+    BOOST_FOREACH(const CTransaction &tx, block.vtx) {
+        CTxCacheShard &shard = TxCacheShard(tx.GetHash());
+        LOCK(shard.cs);
+        std::map<uint256, CTxCacheEntry>::iterator it = shard.mapEntries.find(tx.GetHash());
+        if (it != shard.mapEntries.end()) {
+            shard.nBytes -= it->second.nBytes;
+            shard.listLRU.erase(it->second.itLRU);
+            shard.mapEntries.erase(it);
+            nTxCacheInvalidations++;
+        }
+    }
+}
+
+void GetTxCacheStats(CTxCacheStats &stats)
+{
+    stats.nEntries = stats.nBytes = 0;
+    for (int i = 0; i < TXCACHE_SHARDS; i++) {
+        LOCK(txCacheShards[i].cs);
+        stats.nEntries += txCacheShards[i].mapEntries.size();
+        stats.nBytes += txCacheShards[i].nBytes;
+    }
+    stats.nMaxBytes = nTxCacheUsage;
+    stats.nHits = nTxCacheHits;
+    stats.nMisses = nTxCacheMisses;
+    stats.nInserts = nTxCacheInserts;
+    stats.nEvictions = nTxCacheEvictions;
+    stats.nInvalidations = nTxCacheInvalidations;
+}
+
 bool myGetTransaction(const uint256 &hash, CTransaction &txOut, uint256 &hashBlock)
 {
     memset(&hashBlock,0,sizeof(hashBlock));
@@ -2264,6 +2463,8 @@ bool myGetTransaction(const uint256 &hash, CTransaction &txOut, uint256 &hashBlo
             return true;
         }
     }
+    if ( TxCacheLookup(hash, txOut, hashBlock) )
+        return true;
     //fprintf(stderr,"check disk %s\n",hash.GetHex().c_str());
 
     if (fTxIndex) {
@@ -2288,6 +2489,8 @@ bool myGetTransaction(const uint256 &hash, CTransaction &txOut, uint256 &hashBlo
                 //return error("%s: txid mismatch", __func__);
                 return error("%s: txid mismatch on disk=%s param=%s", __func__, txOut.GetHash().GetHex().c_str(), hash.GetHex().c_str());   //dimxy added
             //fprintf(stderr,"found on disk %s\n",hash.GetHex().c_str());
+            if ( nTxCacheUsage != 0 )
+                TxCacheInsert(txOut, hashBlock, -1);
             return true;
         }
     }
@@ -3231,6 +3434,70 @@ int8_t GetAddressType(const CScript &scriptPubKey, CTxDestination &vDest, txnout
     return keyType;
 }
 
+// tokens index address of a cc output, the first vSol as the unspent cc index uses
+bool GetTokensIndexAddress(const CScript &scriptPubKey, uint160 &addrHash)
+{
+    vector<vector<unsigned char>> vSols;
+    CTxDestination vDest;
+    txnouttype txType = TX_PUBKEYHASH;
+    if (GetAddressType(scriptPubKey, vDest, txType, vSols) != 3 || vSols.size() == 0)
+        return false;
+    addrHash = vSols[0].size() == 20 ? uint160(vSols[0]) : Hash160(vSols[0]);
+    return true;
+}
+
+// adds (erases if fUndo) the token outputs of a token tx and its creation entry to the tokens index batch.
+// Markers and other cc outputs of the tx (like assets coin outputs) are not token outputs and are skipped
+void TokensIndexOutputs(const CTransaction &tx, int32_t height, bool fUndo,
+                        std::vector<std::pair<CTokensIndexKey, CTokensIndexValue> > &tokensIndex,
+                        std::vector<std::pair<uint256, CTokensIndexValue> > &tokensCreate,
+                        std::map<uint256, const CTransaction*> *blockTokens)
+{
+    uint256 tokenid, txhash = tx.GetHash();
+    uint8_t evalcode, funcid;
+    uint160 addrHash;
+
+    if ((evalcode = DecodeTokensIndexTx(tx, tokenid, funcid)) == 0)
+        return;
+    if (blockTokens != NULL)
+        (*blockTokens)[txhash] = &tx;
+    for (uint32_t k = 0; k < tx.vout.size(); k++) {
+        if (GetTokensIndexAddress(tx.vout[k].scriptPubKey, addrHash) && TokensIndexVoutAmount(tx, k, tokenid, evalcode) > 0)
+            tokensIndex.push_back(make_pair(CTokensIndexKey(tokenid, addrHash, txhash, k),
+                fUndo ? CTokensIndexValue() : CTokensIndexValue(tx.vout[k].nValue, height, evalcode)));
+    }
+    // full supply is in vout[1] as CCfullsupply reads it
+    if (funcid == 'c' && tx.vout.size() > 1)
+        tokensCreate.push_back(make_pair(tokenid,
+            fUndo ? CTokensIndexValue() : CTokensIndexValue(tx.vout[1].nValue, height, evalcode)));
+}
+
+// erases (restores if fUndo) a spent token output in the tokens index batch.
+// Txns of the block being connected are not in the tx index yet so they are looked up in blockTokens first.
+// Like TokensIndexOutputs only real token outputs are taken, spent markers and assets coin outputs never were in the index
+void TokensIndexInput(const COutPoint &prevout, const CTxOut &out, int32_t height, bool fUndo,
+                      const std::map<uint256, const CTransaction*> *blockTokens,
+                      std::vector<std::pair<CTokensIndexKey, CTokensIndexValue> > &tokensIndex)
+{
+    uint256 tokenid, hashBlock;
+    uint8_t evalcode, funcid;
+    uint160 addrHash;
+    CTransaction vintx;
+    const CTransaction *pvintx = NULL;
+
+    if (!GetTokensIndexAddress(out.scriptPubKey, addrHash))
+        return;
+    std::map<uint256, const CTransaction*>::const_iterator it;
+    if (blockTokens != NULL && (it = blockTokens->find(prevout.hash)) != blockTokens->end())
+        pvintx = it->second;
+    else if (myGetTransaction(prevout.hash, vintx, hashBlock))
+        pvintx = &vintx;
+    if (pvintx != NULL && prevout.n < pvintx->vout.size() && (evalcode = DecodeTokensIndexTx(*pvintx, tokenid, funcid)) != 0 &&
+        TokensIndexVoutAmount(*pvintx, prevout.n, tokenid, evalcode) > 0)
+        tokensIndex.push_back(make_pair(CTokensIndexKey(tokenid, addrHash, prevout.hash, prevout.n),
+            fUndo ? CTokensIndexValue(out.nValue, height, evalcode) : CTokensIndexValue()));
+}
+
 bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool* pfClean)
 {
     assert(pindex->GetBlockHash() == view.GetBestBlock());
@@ -3253,6 +3520,8 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
     std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
     std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
     std::vector<std::pair<CUnspentCCIndexKey, CUnspentCCIndexValue> > unspentCCIndex; // index for cc transactions
+    std::vector<std::pair<CTokensIndexKey, CTokensIndexValue> > tokensIndex;
+    std::vector<std::pair<uint256, CTokensIndexValue> > tokensCreate;
 
     // undo transactions in reverse order
     for (int i = block.vtx.size() - 1; i >= 0; i--) {
@@ -3303,6 +3572,8 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
                 }
             }
         }
+        if (fTokensIndex)
+            TokensIndexOutputs(tx, pindex->GetHeight(), true, tokensIndex, tokensCreate, NULL);
 
         // Check that all outputs are available and match the outputs in the block itself
         // exactly.
@@ -3346,6 +3617,9 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
                     spentIndex.push_back(make_pair(CSpentIndexKey(input.prevout.hash, input.prevout.n), CSpentIndexValue()));
                 }
 
+                if (fTokensIndex)
+                    TokensIndexInput(input.prevout, view.GetOutputFor(tx.vin[j]), undo.nHeight, true, NULL, tokensIndex);
+
                 if (fAddressIndex || fUnspentCCIndex) {
                     const CTxOut &prevout = view.GetOutputFor(tx.vin[j]);
 
@@ -3424,6 +3698,8 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
         return true;
     }
 
+    TxCacheDisconnectBlock(block);
+
     if (fAddressIndex) {
         if (!pblocktree->EraseAddressIndex(addressIndex)) {
             return AbortNode(state, "Failed to delete address index");
@@ -3439,6 +3715,12 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
         }
     }
 
+    if (fTokensIndex) {
+        if (!pblocktree->UpdateTokensIndex(tokensIndex, tokensCreate)) {
+            return AbortNode(state, "Failed to write tokens index");
+        }
+    }
+
     return fClean;
 }
 
@@ -3686,6 +3968,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     }
     CCheckQueueControl<CScriptCheck> control(fExpensiveChecks && nScriptCheckThreads ? &scriptcheckqueue : NULL);
     std::shared_ptr<CCheckCCEvalCodes> evalcodeChecker(new CCheckCCEvalCodes());
+    evalcodeChecker->snapshot.Set(pindex->pprev);  // lets thread-safe CC validators run on the check threads
 
     int64_t nTimeStart = GetTimeMicros();
     CAmount nFees = 0;
@@ -3702,6 +3985,9 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
     std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
     std::vector<std::pair<CUnspentCCIndexKey, CUnspentCCIndexValue> > unspentCCIndex; // index for cc transactions
+    std::vector<std::pair<CTokensIndexKey, CTokensIndexValue> > tokensIndex;
+    std::vector<std::pair<uint256, CTokensIndexValue> > tokensCreate;
+    std::map<uint256, const CTransaction*> blockTokens; // token txns in this block
 
     // Construct the incremental merkle tree at the current
     // block position,
@@ -3820,6 +4106,14 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                     }
                 }
             }
+            if (fTokensIndex)
+            {
+                for (size_t j = 0; j < tx.vin.size(); j++)
+                {
+                    if (tx.IsPegsImport() && j==0) continue;
+                    TokensIndexInput(tx.vin[j].prevout, view.GetOutputFor(tx.vin[j]), 0, false, &blockTokens, tokensIndex);
+                }
+            }
             // Add in sigops done by pay-to-script-hash inputs;
             // this is to prevent a "rogue miner" from creating
             // an incredibly-expensive-to-validate block.
@@ -3913,6 +4207,9 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             }
         }
 
+        if (fTokensIndex)
+            TokensIndexOutputs(tx, pindex->GetHeight(), false, tokensIndex, tokensCreate, &blockTokens);
+
         //if ( ASSETCHAINS_SYMBOL[0] == 0 )
         //    komodo_earned_interest(pindex->GetHeight(),sum);
         CTxUndo undoDummy;
@@ -4053,6 +4350,12 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         }
     }
 
+    if (fTokensIndex)    {
+        if (!pblocktree->UpdateTokensIndex(tokensIndex, tokensCreate)) {
+            return AbortNode(state, "Failed to write tokens index");
+        }
+    }
+
     if (fSpentIndex)
         if (!pblocktree->UpdateSpentIndex(spentIndex))
             return AbortNode(state, "Failed to write transaction index");
@@ -4081,6 +4384,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHash());
+    TxCacheConnectBlock(block, pindex);
 
     int64_t nTime3 = GetTimeMicros(); nTimeIndex += nTime3 - nTime2;
     LogPrint("bench", "    - Index writing: %.2fms [%.2fs]\n", 0.001 * (nTime3 - nTime2), nTimeIndex * 0.000001);
@@ -5642,6 +5946,10 @@ bool CheckBlock(int32_t *futureblockp,int32_t height,CBlockIndex *pindex,const C
                     if (fUnspentCCIndex) {
                         mempool.addUnspentCCIndex(e, view);  // add mempool unspent cc index for cc vin/vouts
                     }
+
+                    if (fTokensIndex) {
+                        mempool.addTokensIndex(e, view);
+                    }
                 }
                 else
                 {
@@ -6554,6 +6862,9 @@ bool static LoadBlockIndexDB()
     pblocktree->ReadFlag("unspentccindex", fUnspentCCIndex);
     LogPrintf("%s: unspent cc index %s\n", __func__, fUnspentCCIndex ? "enabled" : "disabled");
 
+    pblocktree->ReadFlag("tokensindex", fTokensIndex);
+    LogPrintf("%s: tokens index %s\n", __func__, fTokensIndex ? "enabled" : "disabled");
+
     // Fill in-memory data
     BOOST_FOREACH(const PAIRTYPE(uint256, CBlockIndex*)& item, mapBlockIndex)
     {
@@ -6925,6 +7236,9 @@ bool InitBlockIndex() {
         pblocktree->WriteFlag("unspentccindex", true);
         fprintf(stderr,"fUnspentCCIndex.%d\n", true);
 
+        fTokensIndex = GetBoolArg("-tokensindex", DEFAULT_TOKENSINDEX);
+        pblocktree->WriteFlag("tokensindex", fTokensIndex);
+
         LogPrintf("Initializing databases...\n");
     }
     // Only add the genesis block if not reindexing (in which case we reuse the one already on disk)
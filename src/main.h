@@ -44,6 +44,7 @@
 #include "txmempool.h"
 #include "uint256.h"
 #include "unspentccindex.h"
+#include "tokensindex.h"
 
 #include <algorithm>
 #include <exception>
@@ -121,6 +122,9 @@ static const unsigned int DATABASE_FLUSH_INTERVAL = 24 * 60 * 60;
 static const unsigned int MAX_REJECT_MESSAGE_LENGTH = 111;
 static const int64_t DEFAULT_MAX_TIP_AGE = 24 * 60 * 60;
 
+/** Default megabytes of decoded confirmed transactions kept for myGetTransaction */
+static const int64_t DEFAULT_TXCACHE = 32;
+
 /** Default NSPV support enabled */
 static const bool DEFAULT_NSPV_PROCESSING = false;
 
@@ -129,6 +133,7 @@ static const bool DEFAULT_NSPV_PROCESSING = false;
 #define DEFAULT_ADDRESSINDEX (GetArg("-ac_cc",0) != 0 || GetArg("-ac_ccactivate",0) != 0)
 #define DEFAULT_SPENTINDEX (GetArg("-ac_cc",0) != 0 || GetArg("-ac_ccactivate",0) != 0)
 #define DEFAULT_UNSPENTCCINDEX (GetArg("-ac_cc",0) != 0 || GetArg("-ac_ccactivate",0) != 0)
+static const bool DEFAULT_TOKENSINDEX = false;
 
 static const bool DEFAULT_TIMESTAMPINDEX = false;
 static const unsigned int DEFAULT_DB_MAX_OPEN_FILES = 1000;
@@ -163,6 +168,7 @@ extern bool fImporting;
 extern bool fReindex;
 extern int nScriptCheckThreads;
 extern bool fTxIndex;
+extern bool fTokensIndex;
 extern bool fIsBareMultisigStd;
 extern bool fCheckBlockIndex;
 extern bool fCheckpointsEnabled;
@@ -170,6 +176,7 @@ extern bool fCheckpointsEnabled;
 // it is unneeded for testing
 extern bool fCoinbaseEnforcedProtectionEnabled;
 extern size_t nCoinCacheUsage;
+extern size_t nTxCacheUsage;
 extern CFeeRate minRelayTxFee;
 extern bool fAlerts;
 extern int64_t nMaxTipAge;
@@ -257,6 +264,12 @@ int IsNotInSync();
 std::string GetWarnings(const std::string& strFor);
 /** Retrieve a transaction (from memory pool, or from disk, if possible) */
 bool GetTransaction(const uint256 &hash, CTransaction &tx, uint256 &hashBlock, bool fAllowSlow = false);
+/** Counters of the decoded transaction cache that serves myGetTransaction */
+struct CTxCacheStats
+{
+    int64_t nEntries, nBytes, nMaxBytes, nHits, nMisses, nInserts, nEvictions, nInvalidations;
+};
+void GetTxCacheStats(CTxCacheStats &stats);
 /** Find the best known block, and make it the tip of the block chain */
 bool ActivateBestChain(bool fSkipdpow, CValidationState &state, CBlock *pblock = NULL);
 CAmount GetBlockSubsidy(int nHeight, const Consensus::Params& consensusParams);
@@ -665,6 +678,31 @@ struct CDiskTxPos : public CDiskBlockPos
 
 CAmount GetMinRelayFee(const CTransaction& tx, unsigned int nBytes, bool fAllowFree);
 
+/**
+ * Read-only chain state CC validators run against, captured under cs_main before the
+ * script checks of a block are queued. Thread-safe validators read it from the check
+ * threads instead of chainActive.
+ */
+struct CCEvalSnapshot
+{
+    int32_t nHeight;    //! height of the tip the checked txns are connected on
+    uint32_t nTipTime;
+    uint256 hashTip;
+
+    CCEvalSnapshot() : nHeight(-1), nTipTime(0) {}
+
+    void Set(const CBlockIndex *pindexTip)
+    {
+        if (pindexTip != NULL) {
+            nHeight = pindexTip->GetHeight();
+            nTipTime = pindexTip->nTime;
+            hashTip = pindexTip->GetBlockHash();
+        }
+    }
+
+    bool IsSet() const { return nHeight >= 0; }
+};
+
 class CCheckCCEvalCodes
 {
     //! The set of evalcodes that are already processed in CC validation.
@@ -674,6 +712,9 @@ class CCheckCCEvalCodes
     boost::mutex mutex_eval;
 
 public:
+    //! chain state for CC validators, unset unless they may run on the script check threads
+    CCEvalSnapshot snapshot;
+
     void MarkEvalCode(uint256 txid,uint8_t ecode)
     {
         boost::unique_lock<boost::mutex> lock(mutex_eval);
@@ -851,10 +892,22 @@ bool GetAddressIndex(uint160 addressHash, int type,
                      int start = 0, int end = 0);
 bool GetAddressUnspent(uint160 addressHash, int type,
                        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs);
+// same as GetAddressUnspent but only reads entries [skip, skip+maxOutputs) of the index
+bool GetAddressUnspentPage(uint160 addressHash, int type, int &skip, int maxOutputs,
+                           std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs);
+// pages of several addresses read with one index iterator, maxOutputs is the total over all pages.
+// Only the first page may be cut short, nextSkips[i] is where to continue its address or -1 if the page is complete
+bool GetAddressUnspentPages(const std::vector<std::pair<uint160, int> > &addresses, std::vector<int> &skips, int maxOutputs,
+                            std::vector<std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > > &pages,
+                            std::vector<int> &nextSkips);
 
 // get utxos from unspet cc index
 bool GetUnspentCCIndex(uint160 addressHash, uint256 creationId,
                        std::vector<std::pair<CUnspentCCIndexKey, CUnspentCCIndexValue> > &unspentOutputs, int32_t beginHeight, int32_t endHeight, int64_t maxOutputs);
+// get unspent token outputs of tokenid for one address or all holders if addressHash is null, optionally with mempool txns applied
+bool GetTokensIndex(uint256 tokenid, uint160 addressHash, std::vector<std::pair<CTokensIndexKey, CTokensIndexValue> > &unspentOutputs, bool fMempool);
+// get token creation entries with the full supply, all tokens if tokenid is null
+bool GetTokensCreate(uint256 tokenid, std::vector<std::pair<uint256, CTokensIndexValue> > &creates);
 
 /** Functions for disk access for blocks */
 bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
@@ -1006,5 +1059,19 @@ CMutableTransaction CreateNewContextualCMutableTransaction(const Consensus::Para
  */
 int8_t GetAddressType(const CScript &scriptPubKey, CTxDestination &vDest, txnouttype &txType, std::vector<std::vector<unsigned char>> &vSols);
 
+/** Address hash a cc output is kept under in the tokens index, false if not a cc output */
+bool GetTokensIndexAddress(const CScript &scriptPubKey, uint160 &addrHash);
+
+/** Tokens index entries for the token outputs of tx, and its creation entry, as ConnectBlock (DisconnectBlock if fUndo) writes them */
+void TokensIndexOutputs(const CTransaction &tx, int32_t height, bool fUndo,
+                        std::vector<std::pair<CTokensIndexKey, CTokensIndexValue> > &tokensIndex,
+                        std::vector<std::pair<uint256, CTokensIndexValue> > &tokensCreate,
+                        std::map<uint256, const CTransaction*> *blockTokens);
+
+/** Tokens index entry for a spent token output, as ConnectBlock (DisconnectBlock if fUndo) writes it */
+void TokensIndexInput(const COutPoint &prevout, const CTxOut &out, int32_t height, bool fUndo,
+                      const std::map<uint256, const CTransaction*> *blockTokens,
+                      std::vector<std::pair<CTokensIndexKey, CTokensIndexValue> > &tokensIndex);
+
 
 #endif // BITCOIN_MAIN_H
@@ -445,6 +445,7 @@ void CNode::CloseSocketDisconnect()
 }
 
 extern int32_t KOMODO_NSPV,KOMODO_DEX_P2P;
+void komodo_DEXpeerfinalize(int32_t peerid);
 #ifndef KOMODO_NSPV_FULLNODE
 #define KOMODO_NSPV_FULLNODE (KOMODO_NSPV <= 0)
 #endif // !KOMODO_NSPV_FULLNODE
@@ -2114,6 +2115,9 @@ CNode::CNode(SOCKET hSocketIn, const CAddress& addrIn, const std::string& addrNa
     nRecvBytes = 0;
     nTimeConnected = GetTime();
     nTimeOffset = 0;
+    dexrelaytime = 0;
+    dexrelaytokens = 0;
+    nspvversion = 0;
     addr = addrIn;
     addrName = addrNameIn == "" ? addr.ToStringIPPort() : addrNameIn;
     nVersion = 0;
@@ -2165,6 +2169,8 @@ CNode::~CNode()
         delete pfilter;
 
     GetNodeSignals().FinalizeNode(GetId());
+    if ( KOMODO_DEX_P2P != 0 )
+        komodo_DEXpeerfinalize(GetId());
 }
 
 void CNode::AskFor(const CInv& inv)
@@ -284,7 +284,9 @@ public:
     int64_t nLastRecv;
     int64_t nTimeConnected;
     int64_t nTimeOffset;
-    uint32_t prevtimes[16],dexlastping;
+    uint32_t prevtimes[16],dexlastping,dexrelaytime;
+    uint32_t nspvversion; // nSPV protocol version from the peer's last NSPV_INFORESP, 0 until then
+    int64_t dexrelaytokens; // -dexrelaybps token bucket
     // Address of this peer
     CAddress addr;
     // Bind address of our side of the connection
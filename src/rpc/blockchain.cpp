@@ -423,12 +423,12 @@ bool myIsutxo_spentinmempool(uint256 &spenttxid, int32_t &spentvini, uint256 txi
     return(false);
     */
 
-    // indexed impl: 
-    CSpentIndexKey key { txid, (uint32_t)vout };
-    CSpentIndexValue value;
-    if (mempool.getSpentIndex(key, value))  {
-        spenttxid = value.txid;
-        spentvini = value.inputIndex;
+    // indexed impl, mapNextTx is maintained whether or not -spentindex is on:
+    LOCK(mempool.cs);
+    std::map<COutPoint, CInPoint>::const_iterator it = mempool.mapNextTx.find(COutPoint(txid, vout));
+    if (it != mempool.mapNextTx.end())  {
+        spenttxid = it->second.ptx->GetHash();
+        spentvini = it->second.n;
         return true;
     }
     else
@@ -951,13 +951,14 @@ UniValue gettxoutsetinfo(const UniValue& params, bool fHelp, const CPubKey& mypk
 
 UniValue kvsearch(const UniValue& params, bool fHelp, const CPubKey& mypk)
 {
-    UniValue ret(UniValue::VOBJ); uint32_t flags; uint8_t value[IGUANA_MAXSCRIPTSIZE * 8], key[IGUANA_MAXSCRIPTSIZE * 8]; int32_t duration, j, height, valuesize, keylen; uint256 refpubkey; static uint256 zeroes;
-    if (fHelp || params.size() != 1)
+    UniValue ret(UniValue::VOBJ); uint32_t flags; uint8_t value[IGUANA_MAXSCRIPTSIZE * 8], key[IGUANA_MAXSCRIPTSIZE * 8]; int32_t duration, j, height, valuesize, keylen; uint256 refpubkey, txid; static uint256 zeroes; bool fPending = false;
+    if (fHelp || params.size() < 1 || params.size() > 2)
         throw runtime_error(
-            "kvsearch key\n"
+            "kvsearch key ( pending )\n"
             "\nSearch for a key stored via the kvupdate command. This feature is only available for asset chains.\n"
             "\nArguments:\n"
             "1. key                      (string, required) search the chain for this key\n"
+            "2. pending                  (boolean, optional, default=false) let a kvupdate still in the mempool override the confirmed value\n"
             "\nResult:\n"
             "{\n"
             "  \"coin\": \"xxxxx\",          (string) chain the key is stored on\n"
@@ -970,11 +971,15 @@ UniValue kvsearch(const UniValue& params, bool fHelp, const CPubKey& mypk)
             "  \"flags\": x                  (numeric) 1 if the key was created with a password; 0 otherwise.\n"
             "  \"value\": \"xxxxx\",         (string) stored value\n"
             "  \"valuesize\": xxxxx          (string) amount of characters stored\n"
+            "  \"pending\": \"xxxxx\"         (string, only if pending=true and the value is unconfirmed) txid of the mempool kvupdate\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("kvsearch", "examplekey")
+            + HelpExampleCli("kvsearch", "examplekey true")
             + HelpExampleRpc("kvsearch", "\"examplekey\"")
         );
+    if (params.size() > 1)
+        fPending = params[1].get_bool();
     LOCK(cs_main);
     if ((keylen = (int32_t)strlen(params[0].get_str().c_str())) > 0)
     {
@@ -985,7 +990,10 @@ UniValue kvsearch(const UniValue& params, bool fHelp, const CPubKey& mypk)
         if (keylen < sizeof(key))
         {
             memcpy(key, params[0].get_str().c_str(), keylen);
-            if ((valuesize = komodo_kvsearch(&refpubkey, chainActive.LastTip()->GetHeight(), &flags, &height, value, key, keylen)) >= 0)
+            if (fPending)
+                valuesize = komodo_kvsearch_pending(&refpubkey, chainActive.LastTip()->GetHeight(), &flags, &height, value, key, keylen, &txid);
+            else valuesize = komodo_kvsearch(&refpubkey, chainActive.LastTip()->GetHeight(), &flags, &height, value, key, keylen);
+            if (valuesize >= 0)
             {
                 std::string val; char *valuestr;
                 val.resize(valuesize);
@@ -999,6 +1007,8 @@ UniValue kvsearch(const UniValue& params, bool fHelp, const CPubKey& mypk)
                 ret.push_back(Pair("flags", (int64_t)flags));
                 ret.push_back(Pair("value", val));
                 ret.push_back(Pair("valuesize", valuesize));
+                if (!txid.IsNull())
+                    ret.push_back(Pair("pending", txid.GetHex()));
             }
             else ret.push_back(Pair("error", (char *)"cant find key"));
         }
@@ -1008,6 +1018,72 @@ UniValue kvsearch(const UniValue& params, bool fHelp, const CPubKey& mypk)
     return ret;
 }
 
+UniValue kvprefix(const UniValue& params, bool fHelp, const CPubKey& mypk)
+{
+    UniValue ret(UniValue::VOBJ), a(UniValue::VARR); std::vector<struct komodo_kvitem> items; std::string prefix, afterkey; int32_t i, maxn = 100, tipheight; bool fPending = false; static bits256 zeroes;
+    if (fHelp || params.size() < 1 || params.size() > 4)
+        throw runtime_error(
+            "kvprefix prefix ( count afterkey pending )\n"
+            "\nList the live keys stored via the kvupdate command that start with prefix, in key order. This feature is only available for asset chains.\n"
+            "\nArguments:\n"
+            "1. prefix                   (string, required) key prefix, \"\" lists every key\n"
+            "2. count                    (numeric, optional, default=100, max=1000) maximum number of keys to return\n"
+            "3. afterkey                 (string, optional) only return keys sorting after this one, pass the last key of the previous page\n"
+            "4. pending                  (boolean, optional, default=false) overlay kvupdates still in the mempool\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"coin\": \"xxxxx\",          (string) chain the keys are stored on\n"
+            "  \"currentheight\": xxxxx,     (numeric) current height of the chain\n"
+            "  \"prefix\": \"xxxxx\",        (string) prefix\n"
+            "  \"keys\": [                   (array) one object per key, same fields as kvsearch\n"
+            "    ...\n"
+            "  ],\n"
+            "  \"more\": xxxxx              (boolean) true if count keys were returned and more may follow\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("kvprefix", "example")
+            + HelpExampleCli("kvprefix", "example 10 examplekey true")
+            + HelpExampleRpc("kvprefix", "\"example\", 10")
+        );
+    prefix = params[0].get_str();
+    if (params.size() > 1)
+        maxn = params[1].get_int();
+    if (maxn <= 0 || maxn > 1000)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "count must be between 1 and 1000");
+    if (params.size() > 2)
+        afterkey = params[2].get_str();
+    if (params.size() > 3)
+        fPending = params[3].get_bool();
+    LOCK(cs_main);
+    tipheight = chainActive.LastTip()->GetHeight();
+    komodo_kvprefix(items, tipheight, prefix, afterkey, maxn, fPending);
+    ret.push_back(Pair("coin", (char *)(ASSETCHAINS_SYMBOL[0] == 0 ? "KMD" : ASSETCHAINS_SYMBOL)));
+    ret.push_back(Pair("currentheight", (int64_t)tipheight));
+    ret.push_back(Pair("prefix", prefix));
+    for (i = 0; i < items.size(); i++)
+    {
+        UniValue item(UniValue::VOBJ); uint256 refpubkey;
+        item.push_back(Pair("key", items[i].key));
+        item.push_back(Pair("keylen", (int64_t)items[i].key.size()));
+        if (memcmp(&zeroes, &items[i].pubkey, sizeof(zeroes)) != 0)
+        {
+            memcpy(&refpubkey, &items[i].pubkey, sizeof(refpubkey));
+            item.push_back(Pair("owner", refpubkey.GetHex()));
+        }
+        item.push_back(Pair("height", items[i].height));
+        item.push_back(Pair("expiration", (int64_t)(items[i].height + ((items[i].flags >> 2) + 1) * KOMODO_KVDURATION)));
+        item.push_back(Pair("flags", (int64_t)items[i].flags));
+        item.push_back(Pair("value", std::string(items[i].value.begin(), items[i].value.end())));
+        item.push_back(Pair("valuesize", (int64_t)items[i].value.size()));
+        if (items[i].pending != 0)
+            item.push_back(Pair("pending", items[i].txid.GetHex()));
+        a.push_back(item);
+    }
+    ret.push_back(Pair("keys", a));
+    ret.push_back(Pair("more", (bool)(items.size() == maxn)));
+    return ret;
+}
+
 UniValue minerids(const UniValue& params, bool fHelp, const CPubKey& mypk)
 {
     uint32_t timestamp = 0; UniValue ret(UniValue::VOBJ); UniValue a(UniValue::VARR); uint8_t minerids[2000], pubkeys[65][33]; int32_t i, j, n, numnotaries, tally[129];
@@ -1655,6 +1731,78 @@ UniValue getmempoolinfo(const UniValue& params, bool fHelp, const CPubKey& mypk)
     return mempoolInfoToJSON();
 }
 
+UniValue gettxcacheinfo(const UniValue& params, bool fHelp, const CPubKey& mypk)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "gettxcacheinfo\n"
+            "\nReturns the state of the decoded transaction cache used by contract validation (-txcache).\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"entries\": xxxxx            (numeric) Cached transactions\n"
+            "  \"bytes\": xxxxx              (numeric) Memory used by the cached transactions\n"
+            "  \"maxbytes\": xxxxx           (numeric) Configured limit, 0 when disabled\n"
+            "  \"hits\": xxxxx               (numeric) Lookups served from the cache\n"
+            "  \"misses\": xxxxx             (numeric) Lookups that went to the mempool or disk\n"
+            "  \"hitrate\": x.xxx            (numeric) hits / (hits + misses)\n"
+            "  \"inserts\": xxxxx            (numeric) Transactions added\n"
+            "  \"evictions\": xxxxx          (numeric) Transactions dropped to stay within maxbytes\n"
+            "  \"invalidations\": xxxxx      (numeric) Transactions dropped because their block was disconnected\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("gettxcacheinfo", "")
+            + HelpExampleRpc("gettxcacheinfo", "")
+        );
+
+    CTxCacheStats stats;
+    GetTxCacheStats(stats);
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("entries", stats.nEntries));
+    ret.push_back(Pair("bytes", stats.nBytes));
+    ret.push_back(Pair("maxbytes", stats.nMaxBytes));
+    ret.push_back(Pair("hits", stats.nHits));
+    ret.push_back(Pair("misses", stats.nMisses));
+    ret.push_back(Pair("hitrate", stats.nHits + stats.nMisses > 0 ? (double)stats.nHits / (stats.nHits + stats.nMisses) : 0.));
+    ret.push_back(Pair("inserts", stats.nInserts));
+    ret.push_back(Pair("evictions", stats.nEvictions));
+    ret.push_back(Pair("invalidations", stats.nInvalidations));
+    return ret;
+}
+
+UniValue getccevalcacheinfo(const UniValue& params, bool fHelp, const CPubKey& mypk)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getccevalcacheinfo\n"
+            "\nReturns the state of the cache of successful CC evals (-maxccevalcachesize).\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"entries\": xxxxx            (numeric) Cached evals\n"
+            "  \"maxentries\": xxxxx         (numeric) Configured limit, 0 when disabled\n"
+            "  \"hits\": xxxxx               (numeric) Evals skipped because they passed before on the same tip\n"
+            "  \"misses\": xxxxx             (numeric) Evals that had to run the contract validator\n"
+            "  \"hitrate\": x.xxx            (numeric) hits / (hits + misses)\n"
+            "  \"inserts\": xxxxx            (numeric) Evals added\n"
+            "  \"evictions\": xxxxx          (numeric) Evals dropped to stay within maxentries\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getccevalcacheinfo", "")
+            + HelpExampleRpc("getccevalcacheinfo", "")
+        );
+
+    CCEvalCacheStats stats;
+    GetCCEvalCacheStats(stats);
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("entries", stats.nEntries));
+    ret.push_back(Pair("maxentries", stats.nMaxEntries));
+    ret.push_back(Pair("hits", stats.nHits));
+    ret.push_back(Pair("misses", stats.nMisses));
+    ret.push_back(Pair("hitrate", stats.nHits + stats.nMisses > 0 ? (double)stats.nHits / (stats.nHits + stats.nMisses) : 0.));
+    ret.push_back(Pair("inserts", stats.nInserts));
+    ret.push_back(Pair("evictions", stats.nEvictions));
+    return ret;
+}
+
 inline CBlockIndex* LookupBlockIndex(const uint256& hash)
 {
     AssertLockHeld(cs_main);
@@ -131,6 +131,8 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "getaddressdeltas", 0},
     { "getaddressutxos", 0},
     { "getaddressmempool", 0},
+    { "tokenholders", 1},
+    { "tokenv2holders", 1},
     { "zcrawjoinsplit", 1 },
     { "zcrawjoinsplit", 2 },
     { "zcrawjoinsplit", 3 },
@@ -166,6 +168,8 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "notaries", 2 },
     { "minerids", 1 },
     { "kvsearch", 1 },
+    { "kvprefix", 1 },
+    { "kvprefix", 3 },
     { "kvupdate", 4 },
     { "z_importkey", 2 },
     { "z_importviewingkey", 2 },
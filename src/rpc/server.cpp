@@ -326,6 +326,8 @@ static const CRPCCommand vRPCCommands[] =
     { "blockchain",         "getchaintips",           &getchaintips,           true  },
     { "blockchain",         "getdifficulty",          &getdifficulty,          true  },
     { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         true  },
+    { "blockchain",         "gettxcacheinfo",         &gettxcacheinfo,         true  },
+    { "blockchain",         "getccevalcacheinfo",     &getccevalcacheinfo,     true  },
     { "blockchain",         "getrawmempool",          &getrawmempool,          true  },
     { "blockchain",         "gettxout",               &gettxout,               true  },
     { "blockchain",         "gettxoutproof",          &gettxoutproof,          true  },
@@ -341,6 +343,7 @@ static const CRPCCommand vRPCCommands[] =
     //{ "blockchain",         "txMoMproof",             &txMoMproof,             true  },
     { "blockchain",         "minerids",               &minerids,               true  },
     { "blockchain",         "kvsearch",               &kvsearch,               true  },
+    { "blockchain",         "kvprefix",               &kvprefix,               true  },
     { "blockchain",         "kvupdate",               &kvupdate,               true  },
 
     /* Cross chain utilities */
@@ -424,6 +427,7 @@ static const CRPCCommand vRPCCommands[] =
     { "DEX",   "DEX_get",               &DEX_get, true },
     { "DEX",   "DEX_stats",             &DEX_stats, true },
     { "DEX",   "DEX_orderbook",         &DEX_orderbook, true },
+    { "DEX",   "DEX_orderbookchanges",  &DEX_orderbookchanges, true },
     { "DEX",   "DEX_cancel",            &DEX_cancel, true },
     { "DEX",   "DEX_setpubkey",         &DEX_setpubkey, true },
     { "DEX",   "DEX_publish",           &DEX_publish, true },
@@ -442,9 +446,11 @@ static const CRPCCommand vRPCCommands[] =
     { "nSPV",   "nspv_notarizations",   &nspv_notarizations,    true },
     { "nSPV",   "nspv_hdrsproof",       &nspv_hdrsproof,    true },
     { "nSPV",   "nspv_txproof",         &nspv_txproof,    true },
+    { "nSPV",   "nspv_batch",           &nspv_batch,    true },
     { "nSPV",   "nspv_spend",           &nspv_spend,    true },
     { "nSPV",   "nspv_broadcast",       &nspv_broadcast,    true },
     { "nSPV",   "nspv_logout",          &nspv_logout,    true },
+    { "nSPV",   "nspv_cacheinfo",       &nspv_cacheinfo,    true },
     { "nSPV",   "nspv_listccmoduleunspent",     &nspv_listccmoduleunspent,  true },
 
     // rewards
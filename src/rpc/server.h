@@ -421,6 +421,8 @@ extern UniValue getbestblockhash(const UniValue& params, bool fHelp, const CPubK
 extern UniValue getdifficulty(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue settxfee(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue getmempoolinfo(const UniValue& params, bool fHelp, const CPubKey& mypk);
+extern UniValue gettxcacheinfo(const UniValue& params, bool fHelp, const CPubKey& mypk);
+extern UniValue getccevalcacheinfo(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue getrawmempool(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue getblockhashes(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue getblockdeltas(const UniValue& params, bool fHelp, const CPubKey& mypk);
@@ -460,9 +462,11 @@ extern UniValue nspv_spentinfo(const UniValue& params, bool fHelp, const CPubKey
 extern UniValue nspv_notarizations(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue nspv_hdrsproof(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue nspv_txproof(const UniValue& params, bool fHelp, const CPubKey& mypk);
+extern UniValue nspv_batch(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue nspv_spend(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue nspv_broadcast(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue nspv_logout(const UniValue& params, bool fHelp, const CPubKey& mypk);
+extern UniValue nspv_cacheinfo(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue nspv_listccmoduleunspent(const UniValue& params, bool fHelp, const CPubKey& mypk);
 
 extern UniValue DEX_broadcast(const UniValue& params, bool fHelp, const CPubKey& mypk);
@@ -471,6 +475,7 @@ extern UniValue DEX_list(const UniValue& params, bool fHelp, const CPubKey& mypk
 extern UniValue DEX_get(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue DEX_stats(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue DEX_orderbook(const UniValue& params, bool fHelp, const CPubKey& mypk);
+extern UniValue DEX_orderbookchanges(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue DEX_cancel(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue DEX_setpubkey(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue DEX_publish(const UniValue& params, bool fHelp, const CPubKey& mypk);
@@ -522,6 +527,7 @@ extern UniValue migrate_createnotaryapprovaltransaction(const UniValue& params,
 extern UniValue notaries(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue minerids(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue kvsearch(const UniValue& params, bool fHelp, const CPubKey& mypk);
+extern UniValue kvprefix(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue kvupdate(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue paxprice(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue paxpending(const UniValue& params, bool fHelp, const CPubKey& mypk);
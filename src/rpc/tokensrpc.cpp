@@ -220,6 +220,65 @@ UniValue tokenv2balance(const UniValue& params, bool fHelp, const CPubKey& remot
     return tokenbalance<V2>("tokenv2balance", params, fHelp, remotepk);
 }
 
+// lists cc addresses holding a token with their balances, read with one range scan of the tokens index
+template <class V>
+static UniValue tokenholders(const std::string& name, const UniValue& params, bool fHelp, const CPubKey& remotepk)
+{
+    UniValue result(UniValue::VOBJ), holders(UniValue::VARR); uint256 tokenid; bool fMempool = false; CAmount total = 0;
+    std::vector<std::pair<CTokensIndexKey, CTokensIndexValue> > tokenOutputs;
+    std::vector<std::pair<uint256, CTokensIndexValue> > creates;
+    std::map<uint160, std::pair<CAmount, int32_t> > balances;
+
+    if ( fHelp || params.size() < 1 || params.size() > 2 )
+        throw runtime_error(name + " tokenid [includemempool]\n");
+    if ( ensure_CCrequirements(V::EvalCode()) < 0 )
+        throw runtime_error(CC_REQUIREMENTS_MSG);
+    if ( !fTokensIndex )
+        throw runtime_error("tokens index not enabled, restart with -tokensindex\n");
+
+    tokenid = Parseuint256((char *)params[0].get_str().c_str());
+    if ( params.size() == 2 )
+        fMempool = params[1].get_bool();
+
+    if ( !GetTokensCreate(tokenid, creates) || !GetTokensIndex(tokenid, uint160(), tokenOutputs, fMempool) )
+        return MakeResultError("could not read tokens index");
+    if ( creates.size() == 0 || creates[0].second.evalcode != V::EvalCode() )
+        return MakeResultError("not a tokenid");
+
+    for (std::vector<std::pair<CTokensIndexKey, CTokensIndexValue> >::const_iterator it = tokenOutputs.begin(); it != tokenOutputs.end(); it++)
+    {
+        if ( it->second.evalcode != V::EvalCode() || it->second.satoshis == 0 )
+            continue;
+        balances[it->first.hashBytes].first += it->second.satoshis;
+        balances[it->first.hashBytes].second++;
+        total += it->second.satoshis;
+    }
+    for (std::map<uint160, std::pair<CAmount, int32_t> >::const_iterator it = balances.begin(); it != balances.end(); it++)
+    {
+        UniValue holder(UniValue::VOBJ);
+        holder.push_back(Pair("address", CBitcoinAddress(CKeyID(it->first)).ToString()));
+        holder.push_back(Pair("balance", (int64_t)it->second.first));
+        holder.push_back(Pair("outputs", (int64_t)it->second.second));
+        holders.push_back(holder);
+    }
+    result.push_back(Pair("result", "success"));
+    result.push_back(Pair("tokenid", params[0].get_str()));
+    result.push_back(Pair("supply", (int64_t)creates[0].second.satoshis));
+    result.push_back(Pair("height", (int64_t)creates[0].second.blockHeight));
+    result.push_back(Pair("total", (int64_t)total));
+    result.push_back(Pair("holders", holders));
+    return result;
+}
+
+UniValue tokenholders(const UniValue& params, bool fHelp, const CPubKey& remotepk)
+{
+    return tokenholders<V1>("tokenholders", params, fHelp, remotepk);
+}
+UniValue tokenv2holders(const UniValue& params, bool fHelp, const CPubKey& remotepk)
+{
+    return tokenholders<V2>("tokenv2holders", params, fHelp, remotepk);
+}
+
 uint256 fvintxid;
 int32_t fvinn;
 
@@ -797,6 +856,8 @@ static const CRPCCommand commands[] =
     { "tokens",       "tokenv2address",   &tokenv2address,      true },
     { "tokens",       "tokenbalance",     &tokenbalance,      true },
     { "tokens",       "tokenv2balance",   &tokenv2balance,      true },
+    { "tokens",       "tokenholders",     &tokenholders,      true },
+    { "tokens",       "tokenv2holders",   &tokenv2holders,      true },
     { "tokens",       "tokencreate",      &tokencreate,       true },
     { "tokens",       "tokenv2create",    &tokenv2create,       true },
     { "tokens",       "tokentransfer",    &tokentransfer,     true },
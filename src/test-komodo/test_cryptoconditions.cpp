@@ -5,6 +5,7 @@
 #include "key.h"
 #include "script/cc.h"
 #include "cc/eval.h"
+#include "cc/CCinclude.h"
 #include "primitives/transaction.h"
 #include "script/interpreter.h"
 #include "script/serverchecker.h"
@@ -198,3 +199,62 @@ TEST_F(CCTest, testLargeCondition)
     EXPECT_EQ(1744, CCSig(cond).size());
     ASSERT_TRUE(CCVerify(mtxTo, cond));
 }
+
+
+extern struct CCcontract_info CCinfos[0x100];
+extern int32_t KOMODO_CONNECTING;
+
+static bool CCAlwaysInvalid(struct CCcontract_info *cp, Eval* eval, const CTransaction &tx, uint32_t nIn)
+{
+    return eval->Invalid("always-invalid");
+}
+
+/*
+ * AcceptToMemoryPool first checks inputs with KOMODO_CONNECTING unset, when ProcessCC
+ * returns true without running the validator. That pass must not fill the CC eval cache,
+ * or the mempool re-check and ConnectBlock on the same tip would skip the validator.
+ */
+TEST_F(CCTest, testEvalCacheIgnoresBypassedEvals)
+{
+    const uint8_t ecode = 0xf6;  // unused evalcode
+    struct CCcontract_info *cp = &CCinfos[ecode];
+    cp->init_to_zeros();
+    cp->evalcode = ecode;
+    cp->validate = CCAlwaysInvalid;
+    cp->didinit = 1;
+    EVAL_TEST = 0;
+
+    CC *cond = CCNewEval({ecode});
+    CMutableTransaction mtx;
+    mtx.nLockTime = GetRand(1000000);
+    CTransaction tx(mtx);
+
+    auto check = [&]() {
+        std::shared_ptr<CCheckCCEvalCodes> evalcodeChecker(new CCheckCCEvalCodes());
+        evalcodeChecker->snapshot.nHeight = 100;
+        evalcodeChecker->snapshot.hashTip = uint256S("01");
+        return RunCCEval(cond, tx, 0, evalcodeChecker, true);
+    };
+    CCEvalCacheStats before, after;
+    GetCCEvalCacheStats(before);
+
+    // mempool, standard flags pass: validator not run
+    KOMODO_CONNECTING = -1;
+    ASSERT_TRUE(check());
+
+    // mempool, mandatory flags pass
+    KOMODO_CONNECTING = (1<<30) + 101;
+    ASSERT_FALSE(check());
+
+    // ConnectBlock on the same tip
+    KOMODO_CONNECTING = 101;
+    ASSERT_FALSE(check());
+
+    GetCCEvalCacheStats(after);
+    EXPECT_EQ(before.nInserts, after.nInserts);
+    EXPECT_EQ(before.nHits, after.nHits);
+
+    KOMODO_CONNECTING = -1;
+    cp->init_to_zeros();
+    cc_free(cond);
+}
@@ -0,0 +1,61 @@
+#include <gtest/gtest.h>
+
+#include "uint256.h"
+#include "komodo_structs.h"
+
+
+extern struct komodo_state *komodo_stateptr(char *symbol,char *dest);
+extern void komodo_notarized_update(struct komodo_state *sp,int32_t nHeight,int32_t notarized_height,uint256 notarized_hash,uint256 notarized_desttxid,uint256 MoM,int32_t MoMdepth);
+extern void komodo_notarized_undo(struct komodo_state *sp,int32_t nHeight,int32_t notarized_height);
+extern struct notarized_checkpoint *komodo_npptr_for_height(int32_t height, int *idx);
+extern int32_t komodo_prevMoMheight();
+
+
+namespace TestNotarizedIndex {
+
+    TEST(TestNotarizedIndex, lookup_and_undo)
+    {
+        char symbol[KOMODO_ASSETCHAIN_MAXLEN],dest[KOMODO_ASSETCHAIN_MAXLEN]; int idx;
+        uint256 hash = uint256S("01"), txid = uint256S("02"), MoM = uint256S("03"), zero;
+        struct komodo_state *sp = komodo_stateptr(symbol,dest);
+        ASSERT_TRUE(sp != 0);
+        int32_t base = sp->NUM_NPOINTS, prevMoM = komodo_prevMoMheight();
+
+        komodo_notarized_update(sp,2000100,2000090,hash,txid,MoM,20);    // (2000070,2000090]
+        komodo_notarized_update(sp,2000110,2000105,hash,txid,zero,15);   // (2000090,2000105]
+        komodo_notarized_update(sp,2000120,2000100,hash,txid,MoM,30);    // (2000070,2000100], overrides the first
+        komodo_notarized_update(sp,2000910,2000900,hash,txid,zero,10);   // (2000890,2000900], spans two buckets
+        ASSERT_EQ(sp->NUM_NPOINTS, base+4);
+
+        EXPECT_TRUE(komodo_npptr_for_height(2000070,&idx) == 0);
+        EXPECT_EQ(idx, -1);
+        EXPECT_TRUE(komodo_npptr_for_height(2000080,&idx) != 0);
+        EXPECT_EQ(idx, base+2);
+        EXPECT_TRUE(komodo_npptr_for_height(2000103,&idx) != 0);
+        EXPECT_EQ(idx, base+1);
+        EXPECT_TRUE(komodo_npptr_for_height(2000895,&idx) != 0);
+        EXPECT_EQ(idx, base+3);
+        EXPECT_TRUE(komodo_npptr_for_height(2000900,&idx) != 0);
+        EXPECT_EQ(idx, base+3);
+        EXPECT_TRUE(komodo_npptr_for_height(2000901,&idx) == 0);
+        EXPECT_EQ(komodo_prevMoMheight(), 2000100);
+
+        // rewinding in reverse order restores the earlier lookups
+        komodo_notarized_undo(sp,2000910,2000900);
+        komodo_notarized_undo(sp,2000120,2000100);
+        EXPECT_TRUE(komodo_npptr_for_height(2000895,&idx) == 0);
+        EXPECT_TRUE(komodo_npptr_for_height(2000080,&idx) != 0);
+        EXPECT_EQ(idx, base);
+        EXPECT_EQ(komodo_prevMoMheight(), 2000090);
+
+        // an undo that doesnt match the latest checkpoint is ignored
+        komodo_notarized_undo(sp,2000100,2000090);
+        EXPECT_EQ(sp->NUM_NPOINTS, base+2);
+
+        komodo_notarized_undo(sp,2000110,2000105);
+        komodo_notarized_undo(sp,2000100,2000090);
+        EXPECT_EQ(sp->NUM_NPOINTS, base);
+        EXPECT_EQ(komodo_prevMoMheight(), prevMoM);
+    }
+
+}
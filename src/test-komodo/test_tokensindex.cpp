@@ -0,0 +1,80 @@
+#include <gtest/gtest.h>
+
+#include "main.h"
+#include "primitives/transaction.h"
+#include "utilstrencodings.h"
+#include "cc/CCinclude.h"
+#include "cc/CCtokens.h"
+
+#include "testutils.h"
+
+
+namespace TestTokensIndex {
+
+
+class TestTokensIndex : public ::testing::Test {
+protected:
+    virtual void SetUp() {
+        // enable CC
+        ASSETCHAINS_CC = 1;
+    }
+
+    // tokens v2 create tx: marker in vout 0, the token supply in vout 1
+    CTransaction CreateTx(CPubKey pk, CAmount supply)
+    {
+        struct CCcontract_info *cp, C;
+        cp = CCinit(&C, EVAL_TOKENSV2);
+        CMutableTransaction mtx;
+        mtx.vout.push_back(V2::MakeCC1vout(EVAL_TOKENSV2, 10000, GetUnspendable(cp, NULL)));
+        mtx.vout.push_back(V2::MakeTokensCC1vout(EVAL_TOKENSV2, supply, pk));
+        mtx.vout.push_back(CTxOut(0, EncodeTokenCreateOpRetV2(vscript_t(pk.begin(), pk.end()), "T", "test token", {})));
+        return CTransaction(mtx);
+    }
+};
+
+
+/*
+ * A tx spending the marker of a token create tx must not touch the tokens index:
+ * the marker never was a token output, so connecting the spend has nothing to erase
+ * and disconnecting it must not restore a holding that never existed.
+ */
+TEST_F(TestTokensIndex, testSpentMarkerNotIndexed)
+{
+    CPubKey pk(ParseHex(notaryPubkey));
+    CTransaction createTx = CreateTx(pk, 100);
+    uint256 tokenid = createTx.GetHash();
+    uint160 addrHash;
+    ASSERT_TRUE(GetTokensIndexAddress(createTx.vout[0].scriptPubKey, addrHash));
+    ASSERT_TRUE(GetTokensIndexAddress(createTx.vout[1].scriptPubKey, addrHash));
+
+    std::vector<std::pair<CTokensIndexKey, CTokensIndexValue> > tokensIndex;
+    std::vector<std::pair<uint256, CTokensIndexValue> > tokensCreate;
+    std::map<uint256, const CTransaction*> blockTokens;
+
+    // connect the create tx: only the supply vout is a holding
+    TokensIndexOutputs(createTx, 10, false, tokensIndex, tokensCreate, &blockTokens);
+    ASSERT_EQ(1, tokensIndex.size());
+    EXPECT_EQ(tokenid, tokensIndex[0].first.tokenid);
+    EXPECT_EQ(1, tokensIndex[0].first.index);
+    EXPECT_EQ(100, tokensIndex[0].second.satoshis);
+    ASSERT_EQ(1, tokensCreate.size());
+    ASSERT_EQ(1, blockTokens.count(tokenid));
+
+    for (bool fUndo : { false, true }) {
+        // connect (disconnect if fUndo) a spend of the marker
+        tokensIndex.clear();
+        TokensIndexInput(COutPoint(tokenid, 0), createTx.vout[0], 10, fUndo, &blockTokens, tokensIndex);
+        EXPECT_EQ(0, tokensIndex.size()) << "fUndo=" << fUndo;
+
+        // a spend of the supply vout is erased (restored if fUndo)
+        TokensIndexInput(COutPoint(tokenid, 1), createTx.vout[1], 10, fUndo, &blockTokens, tokensIndex);
+        ASSERT_EQ(1, tokensIndex.size()) << "fUndo=" << fUndo;
+        EXPECT_EQ(1, tokensIndex[0].first.index);
+        EXPECT_EQ(!fUndo, tokensIndex[0].second.IsNull());
+        if (fUndo)
+            EXPECT_EQ(100, tokensIndex[0].second.satoshis);
+    }
+}
+
+
+} /* namespace TestTokensIndex */
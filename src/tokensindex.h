@@ -0,0 +1,182 @@
+/******************************************************************************
+ * Copyright © 2014-2019 The SuperNET Developers.                             *
+ *                                                                            *
+ * See the AUTHORS, DEVELOPER-AGREEMENT and LICENSE files at                  *
+ * the top-level directory of this distribution for the individual copyright  *
+ * holder information and the developer policies on copyright and licensing.  *
+ *                                                                            *
+ * Unless otherwise agreed in a custom licensing agreement, no part of the    *
+ * SuperNET software, including this file may be copied, modified, propagated *
+ * or distributed except according to the terms contained in the LICENSE file *
+ *                                                                            *
+ * Removal or modification of this copyright notice is prohibited.            *
+ *                                                                            *
+ ******************************************************************************/
+
+#ifndef TOKENSINDEX_H
+#define TOKENSINDEX_H
+
+#include "uint256.h"
+#include "amount.h"
+
+// unspent token output key, ordered by tokenid first so holders of one token are a single range
+struct CTokensIndexKey {
+    uint256 tokenid;
+    uint160 hashBytes;
+    uint256 txhash;
+    uint32_t index;
+
+    size_t GetSerializeSize(int nType, int nVersion) const {
+        return sizeof(uint256) + sizeof(uint160) + sizeof(uint256) + sizeof(uint32_t);
+    }
+    template<typename Stream>
+    void Serialize(Stream& s) const {
+        tokenid.Serialize(s);
+        hashBytes.Serialize(s);
+        txhash.Serialize(s);
+        ser_writedata32(s, index);
+    }
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        tokenid.Unserialize(s);
+        hashBytes.Unserialize(s);
+        txhash.Unserialize(s);
+        index = ser_readdata32(s);
+    }
+
+    CTokensIndexKey(uint256 _tokenid, uint160 addressHash, uint256 _txid, uint32_t _index) {
+        tokenid = _tokenid;
+        hashBytes = addressHash;
+        txhash = _txid;
+        index = _index;
+    }
+
+    CTokensIndexKey() {
+        SetNull();
+    }
+
+    void SetNull() {
+        tokenid.SetNull();
+        hashBytes.SetNull();
+        txhash.SetNull();
+        index = 0;
+    }
+};
+
+// partial key for tokenid only, also the key of the token creation entry
+struct CTokensIndexKeyTokenId {
+    uint256 tokenid;
+
+    size_t GetSerializeSize(int nType, int nVersion) const {
+        return sizeof(uint256);
+    }
+    template<typename Stream>
+    void Serialize(Stream& s) const {
+        tokenid.Serialize(s);
+    }
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        tokenid.Unserialize(s);
+    }
+
+    CTokensIndexKeyTokenId(uint256 _tokenid) {
+        tokenid = _tokenid;
+    }
+
+    CTokensIndexKeyTokenId() {
+        SetNull();
+    }
+
+    void SetNull() {
+        tokenid.SetNull();
+    }
+};
+
+// partial key for tokenid+address
+struct CTokensIndexKeyAddr {
+    uint256 tokenid;
+    uint160 hashBytes;
+
+    size_t GetSerializeSize(int nType, int nVersion) const {
+        return sizeof(uint256) + sizeof(uint160);
+    }
+    template<typename Stream>
+    void Serialize(Stream& s) const {
+        tokenid.Serialize(s);
+        hashBytes.Serialize(s);
+    }
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        tokenid.Unserialize(s);
+        hashBytes.Unserialize(s);
+    }
+
+    CTokensIndexKeyAddr(uint256 _tokenid, uint160 addressHash) {
+        tokenid = _tokenid;
+        hashBytes = addressHash;
+    }
+
+    CTokensIndexKeyAddr() {
+        SetNull();
+    }
+
+    void SetNull() {
+        tokenid.SetNull();
+        hashBytes.SetNull();
+    }
+};
+
+// unspent token output value, for a creation entry satoshis is the full supply
+struct CTokensIndexValue {
+    CAmount satoshis;
+    int blockHeight;
+    uint8_t evalcode;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(satoshis);
+        READWRITE(blockHeight);
+        READWRITE(evalcode);
+    }
+
+    CTokensIndexValue(CAmount sats, int32_t _height, uint8_t _evalcode) {
+        satoshis = sats;
+        blockHeight = _height;
+        evalcode = _evalcode;
+    }
+
+    CTokensIndexValue() {
+        SetNull();
+    }
+
+    void SetNull() {
+        satoshis = -1;
+        blockHeight = 0;
+        evalcode = 0;
+    }
+
+    bool IsNull() const {
+        return (satoshis == -1);
+    }
+};
+
+struct CTokensIndexKeyCompare
+{
+    bool operator()(const CTokensIndexKey& a, const CTokensIndexKey& b) const
+    {
+        if (a.tokenid == b.tokenid)
+            if (a.hashBytes == b.hashBytes)
+                if (a.txhash == b.txhash)
+                    return a.index < b.index;
+                else
+                    return a.txhash < b.txhash;
+            else
+                return a.hashBytes < b.hashBytes;
+        else
+            return a.tokenid < b.tokenid;
+    }
+};
+
+#endif // #ifndef TOKENSINDEX_H
@@ -59,6 +59,10 @@ static const char DB_LAST_BLOCK = 'l';
 // cc module outputs index with opdrop or opreturn data
 static const char DB_ADDRESSUNSPENT_CC_INDEX = 'O';
 
+// tokens index: unspent token outputs by tokenid+address and token creations by tokenid
+static const char DB_TOKENS_INDEX = 'k';
+static const char DB_TOKENS_CREATE = 'K';
+
 
 CCoinsViewDB::CCoinsViewDB(std::string dbName, size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / dbName, nCacheSize, fMemory, fWipe) {
 }
@@ -380,6 +384,89 @@ bool CBlockTreeDB::ReadAddressUnspentIndex(uint160 addressHash, int type,
     return true;
 }
 
+// reads one page of an address from an already open cursor, so a batch of addresses can share the iterator
+static bool ReadAddressUnspentCursorPage(CDBIterator *pcursor, uint160 addressHash, int type, int &skip, int maxOutputs,
+                                         std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs) {
+
+    std::pair<CAddressUnspentKey, CAddressUnspentValue> last;
+    int n = 0;
+
+    pcursor->Seek(make_pair(DB_ADDRESSUNSPENTINDEX, CAddressIndexIteratorKey(type, addressHash)));
+
+    // walk the cursor, skipping the first skip entries and stopping once maxOutputs have been collected
+    while (pcursor->Valid() && unspentOutputs.size() < maxOutputs) {
+        boost::this_thread::interruption_point();
+        try {
+            pair<char, CAddressUnspentKey> keyObj;
+            pcursor->GetKey(keyObj);
+            char chType = keyObj.first;
+            CAddressUnspentKey indexKey = keyObj.second;
+
+            if (chType == DB_ADDRESSUNSPENTINDEX && indexKey.hashBytes == addressHash) {
+                try {
+                    CAddressUnspentValue nValue;
+                    pcursor->GetValue(nValue);
+                    if (n >= skip)
+                        unspentOutputs.push_back(make_pair(indexKey, nValue));
+                    else last = make_pair(indexKey, nValue);
+                    n++;
+                    pcursor->Next();
+                } catch (const std::exception& e) {
+                    return error("failed to get address unspent value");
+                }
+            } else {
+                break;
+            }
+        } catch (const std::exception& e) {
+            break;
+        }
+    }
+    // skipped past the end: return the last entry, as the unpaged query did
+    if (n > 0 && n <= skip) {
+        skip = n - 1;
+        unspentOutputs.push_back(last);
+    }
+    return true;
+}
+
+bool CBlockTreeDB::ReadAddressUnspentIndexPage(uint160 addressHash, int type, int &skip, int maxOutputs,
+                                               std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs) {
+
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    return ReadAddressUnspentCursorPage(pcursor.get(), addressHash, type, skip, maxOutputs, unspentOutputs);
+}
+
+bool CBlockTreeDB::ReadAddressUnspentIndexPages(const std::vector<std::pair<uint160, int> > &addresses, std::vector<int> &skips, int maxOutputs,
+                                                std::vector<std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > > &pages,
+                                                std::vector<int> &nextSkips) {
+
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    int total = 0;
+
+    // maxOutputs is shared by all addresses, pages stops short of addresses.size() once it is used up.
+    // One entry more than what is left is read to tell a complete page from a cut one: only the first page
+    // may be cut (nextSkips says where its address continues), a later page that does not fit is left out whole
+    pages.clear();
+    nextSkips.clear();
+    for (size_t i = 0; i < addresses.size() && i < skips.size() && total < maxOutputs; i++) {
+        pages.push_back(std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >());
+        if (!ReadAddressUnspentCursorPage(pcursor.get(), addresses[i].first, addresses[i].second, skips[i], maxOutputs - total + 1, pages.back()))
+            return false;
+        if (pages.back().size() > (size_t)(maxOutputs - total)) {
+            if (i > 0) {
+                pages.pop_back();
+                break;
+            }
+            pages.back().pop_back();
+            nextSkips.push_back(skips[i] + (int)pages.back().size());
+            break;
+        }
+        nextSkips.push_back(-1);
+        total += pages.back().size();
+    }
+    return true;
+}
+
 bool CBlockTreeDB::WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect) {
     CDBBatch batch(*this);
     for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
@@ -804,3 +891,97 @@ bool CBlockTreeDB::ReadUnspentCCIndex(uint160 addressHash, uint256 creationid,
     }
     return true;
 }
+
+// update or erase entries for tokens index, creations are keyed by tokenid only
+bool CBlockTreeDB::UpdateTokensIndex(const std::vector<std::pair<CTokensIndexKey, CTokensIndexValue> > &vect,
+                                     const std::vector<std::pair<uint256, CTokensIndexValue> > &creates) {
+    CDBBatch batch(*this);
+    for (std::vector<std::pair<CTokensIndexKey, CTokensIndexValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
+        if (it->second.IsNull()) {
+            batch.Erase(make_pair(DB_TOKENS_INDEX, it->first));
+        } else {
+            batch.Write(make_pair(DB_TOKENS_INDEX, it->first), it->second);
+        }
+    }
+    for (std::vector<std::pair<uint256, CTokensIndexValue> >::const_iterator it=creates.begin(); it!=creates.end(); it++) {
+        if (it->second.IsNull()) {
+            batch.Erase(make_pair(DB_TOKENS_CREATE, CTokensIndexKeyTokenId(it->first)));
+        } else {
+            batch.Write(make_pair(DB_TOKENS_CREATE, CTokensIndexKeyTokenId(it->first)), it->second);
+        }
+    }
+    return WriteBatch(batch);
+}
+
+// read unspent token outputs by tokenid (all holders) or tokenid+address key
+bool CBlockTreeDB::ReadTokensIndex(uint256 tokenid, uint160 addressHash,
+                                   std::vector<std::pair<CTokensIndexKey, CTokensIndexValue> > &unspentOutputs) {
+
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+
+    if (addressHash.IsNull())
+        pcursor->Seek(make_pair(DB_TOKENS_INDEX, CTokensIndexKeyTokenId(tokenid)));  // search first tokenid
+    else
+        pcursor->Seek(make_pair(DB_TOKENS_INDEX, CTokensIndexKeyAddr(tokenid, addressHash)));  // search first tokenid+address
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        try {
+            pair<char, CTokensIndexKey> keyObj;
+            pcursor->GetKey(keyObj);
+            char chType = keyObj.first;
+            CTokensIndexKey indexKey = keyObj.second;
+
+            if (chType == DB_TOKENS_INDEX && indexKey.tokenid == tokenid && (addressHash.IsNull() || indexKey.hashBytes == addressHash)) {
+                try {
+                    CTokensIndexValue tokensValue;
+                    pcursor->GetValue(tokensValue);
+                    unspentOutputs.push_back(make_pair(indexKey, tokensValue));
+                    pcursor->Next();
+                } catch (const std::exception& e) {
+                    return error("failed to get tokens index value");
+                }
+            }
+            else {
+                break;
+            }
+        } catch (const std::exception& e) {
+            break;
+        }
+    }
+    return true;
+}
+
+// read token creation entries, all of them if tokenid is null
+bool CBlockTreeDB::ReadTokensCreate(uint256 tokenid, std::vector<std::pair<uint256, CTokensIndexValue> > &creates) {
+
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+
+    pcursor->Seek(make_pair(DB_TOKENS_CREATE, CTokensIndexKeyTokenId(tokenid)));
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        try {
+            pair<char, CTokensIndexKeyTokenId> keyObj;
+            pcursor->GetKey(keyObj);
+            char chType = keyObj.first;
+
+            if (chType == DB_TOKENS_CREATE && (tokenid.IsNull() || keyObj.second.tokenid == tokenid)) {
+                try {
+                    CTokensIndexValue tokensValue;
+                    pcursor->GetValue(tokensValue);
+                    creates.push_back(make_pair(keyObj.second.tokenid, tokensValue));
+                    pcursor->Next();
+                } catch (const std::exception& e) {
+                    return error("failed to get tokens create value");
+                }
+            }
+            else {
+                break;
+            }
+        } catch (const std::exception& e) {
+            break;
+        }
+    }
+    return true;
+}
@@ -24,6 +24,7 @@
 #include "coins.h"
 #include "dbwrapper.h"
 #include "unspentccindex.h"
+#include "tokensindex.h"
 
 #include <map>
 #include <string>
@@ -103,6 +104,11 @@ public:
     bool UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue > >&vect);
     bool ReadAddressUnspentIndex(uint160 addressHash, int type,
                                  std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect);
+    bool ReadAddressUnspentIndexPage(uint160 addressHash, int type, int &skip, int maxOutputs,
+                                     std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect);
+    bool ReadAddressUnspentIndexPages(const std::vector<std::pair<uint160, int> > &addresses, std::vector<int> &skips, int maxOutputs,
+                                      std::vector<std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > > &pages,
+                                      std::vector<int> &nextSkips);
     bool WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect);
     bool EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect);
     bool ReadAddressIndex(uint160 addressHash, int type,
@@ -122,6 +128,11 @@ public:
     bool UpdateUnspentCCIndex(const std::vector<std::pair<CUnspentCCIndexKey, CUnspentCCIndexValue > >&vect);
     bool ReadUnspentCCIndex(uint160 addressHash, uint256 creationid,
                                  std::vector<std::pair<CUnspentCCIndexKey, CUnspentCCIndexValue> > &vect, int32_t beginHeight, int32_t endHeight, int64_t maxOutputs);
+
+    bool UpdateTokensIndex(const std::vector<std::pair<CTokensIndexKey, CTokensIndexValue> > &vect,
+                           const std::vector<std::pair<uint256, CTokensIndexValue> > &creates);
+    bool ReadTokensIndex(uint256 tokenid, uint160 addressHash, std::vector<std::pair<CTokensIndexKey, CTokensIndexValue> > &vect);
+    bool ReadTokensCreate(uint256 tokenid, std::vector<std::pair<uint256, CTokensIndexValue> > &creates);
 };
 
 #endif // BITCOIN_TXDB_H
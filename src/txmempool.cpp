@@ -172,6 +172,8 @@ void CTxMemPool::addAddressIndex(const CTxMemPoolEntry &entry, const CCoinsViewC
                 CMempoolAddressDelta delta(entry.GetTime(), prevout.nValue * -1, input.prevout.hash, input.prevout.n);
                 mapAddress.insert(make_pair(key, delta));
                 inserted.push_back(key);
+                // a mempool output spent by this tx is no longer unspent
+                mapAddressUnspent.erase(CMempoolAddressDeltaKey(keyType, key.addressBytes, input.prevout.hash, input.prevout.n, 0));
             }
         }
     }
@@ -190,6 +192,8 @@ void CTxMemPool::addAddressIndex(const CTxMemPoolEntry &entry, const CCoinsViewC
                 // add index entry for vouts:
                 CMempoolAddressDeltaKey key(keyType, addr.size() == 20 ? uint160(addr) : Hash160(addr), txhash, k, 0);
                 mapAddress.insert(make_pair(key, CMempoolAddressDelta(entry.GetTime(), out.nValue)));
+                if (mapNextTx.count(COutPoint(txhash, k)) == 0)
+                    mapAddressUnspent.insert(make_pair(key, CMempoolAddressDelta(entry.GetTime(), out.nValue)));
                 inserted.push_back(key);
             }
         }
@@ -212,6 +216,21 @@ bool CTxMemPool::getAddressIndex(std::vector<std::pair<uint160, int> > &addresse
     return true;
 }
 
+// same as getAddressIndex but returns only the outputs not spent by another mempool tx
+bool CTxMemPool::getAddressUnspent(std::vector<std::pair<uint160, int> > &addresses,
+                                   std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> > &results)
+{
+    LOCK(cs);
+    for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
+        addressDeltaMap::iterator ait = mapAddressUnspent.lower_bound(CMempoolAddressDeltaKey((*it).second, (*it).first));
+        while (ait != mapAddressUnspent.end() && (*ait).first.addressBytes == (*it).first && (*ait).first.type == (*it).second) {
+            results.push_back(*ait);
+            ait++;
+        }
+    }
+    return true;
+}
+
 bool CTxMemPool::removeAddressIndex(const uint256 txhash)
 {
     LOCK(cs);
@@ -219,10 +238,24 @@ bool CTxMemPool::removeAddressIndex(const uint256 txhash)
 
     if (it != mapAddressInserted.end()) {
         std::vector<CMempoolAddressDeltaKey> keys = (*it).second;
+        std::vector<CMempoolAddressDeltaKey> unspent;
         for (std::vector<CMempoolAddressDeltaKey>::iterator mit = keys.begin(); mit != keys.end(); mit++) {
+            if ((*mit).spending) {
+                addressDeltaMap::iterator ait = mapAddress.find(*mit);
+                if (ait != mapAddress.end())
+                    unspent.push_back(CMempoolAddressDeltaKey((*mit).type, (*mit).addressBytes, (*ait).second.prevhash, (*ait).second.prevout, 0));
+            }
             mapAddress.erase(*mit);
+            mapAddressUnspent.erase(*mit);
         }
         mapAddressInserted.erase(it);
+
+        // outputs of parents still in the mempool become unspent again (mapNextTx is already cleared for this tx)
+        for (std::vector<CMempoolAddressDeltaKey>::iterator mit = unspent.begin(); mit != unspent.end(); mit++) {
+            addressDeltaMap::iterator ait = mapAddress.find(*mit);
+            if (ait != mapAddress.end() && mapNextTx.count(COutPoint((*mit).txhash, (*mit).index)) == 0)
+                mapAddressUnspent.insert(*ait);
+        }
     }
 
     return true;
@@ -487,6 +520,89 @@ bool CTxMemPool::removeUnspentCCIndex(const CTransaction &tx)
     return true;
 }
 
+void CTxMemPool::addTokensIndex(const CTxMemPoolEntry &entry, const CCoinsViewCache &view)
+{
+    LOCK(cs);
+    const CTransaction& tx = entry.GetTx();
+    std::vector<std::pair<CTokensIndexKey, bool> > inserted;
+    uint256 txhash = tx.GetHash(), tokenid, hashBlock;
+    uint8_t evalcode, funcid;
+    uint160 addrHash;
+
+    for (unsigned int j = 0; j < tx.vin.size(); j++) {
+        if (tx.IsPegsImport() && j==0) continue;
+        const CTxIn input = tx.vin[j];
+        const CTxOut &prevout = view.GetOutputFor(input);
+
+        if (GetTokensIndexAddress(prevout.scriptPubKey, addrHash)) {
+            CTransaction vintx;
+            indexed_transaction_set::const_iterator mit = mapTx.find(input.prevout.hash);
+
+            // spent output may be a mempool tx or a confirmed one
+            if (mit != mapTx.end())
+                vintx = mit->GetTx();
+            else if (!myGetTransaction(input.prevout.hash, vintx, hashBlock))
+                continue;
+            // only spent token outputs, as in TokensIndexInput
+            if ((evalcode = DecodeTokensIndexTx(vintx, tokenid, funcid)) != 0 && input.prevout.n < vintx.vout.size() &&
+                TokensIndexVoutAmount(vintx, input.prevout.n, tokenid, evalcode) > 0) {
+                CTokensIndexKey key(tokenid, addrHash, input.prevout.hash, input.prevout.n);
+                mapTokensSpent.insert(make_pair(key, CTokensIndexValue(prevout.nValue, 0, evalcode)));
+                inserted.push_back(make_pair(key, true));
+            }
+        }
+    }
+
+    if ((evalcode = DecodeTokensIndexTx(tx, tokenid, funcid)) != 0) {
+        for (unsigned int k = 0; k < tx.vout.size(); k++) {
+            if (GetTokensIndexAddress(tx.vout[k].scriptPubKey, addrHash) && TokensIndexVoutAmount(tx, k, tokenid, evalcode) > 0) {
+                CTokensIndexKey key(tokenid, addrHash, txhash, k);
+                mapTokensIndex.insert(make_pair(key, CTokensIndexValue(tx.vout[k].nValue, 0, evalcode)));
+                inserted.push_back(make_pair(key, false));
+            }
+        }
+    }
+
+    mapTokensIndexInserted.insert(make_pair(txhash, inserted));
+}
+
+// finds token outputs created and spent by mempool txns by tokenid or by tokenid and hash160 of a cc address
+bool CTxMemPool::getTokensIndex(uint256 tokenid, uint160 addressHash, std::vector<std::pair<CTokensIndexKey, CTokensIndexValue> > &outputs,
+                                std::vector<CTokensIndexKey> &spent)
+{
+    LOCK(cs);
+    mapTokensIndexType::iterator ait = mapTokensIndex.lower_bound(CTokensIndexKey(tokenid, addressHash, zeroid, 0));
+    while (ait != mapTokensIndex.end() && (*ait).first.tokenid == tokenid && (addressHash.IsNull() || (*ait).first.hashBytes == addressHash)) {
+        outputs.push_back(*ait);
+        ait++;
+    }
+    ait = mapTokensSpent.lower_bound(CTokensIndexKey(tokenid, addressHash, zeroid, 0));
+    while (ait != mapTokensSpent.end() && (*ait).first.tokenid == tokenid && (addressHash.IsNull() || (*ait).first.hashBytes == addressHash)) {
+        spent.push_back((*ait).first);
+        ait++;
+    }
+    return true;
+}
+
+bool CTxMemPool::removeTokensIndex(const uint256 txhash)
+{
+    LOCK(cs);
+    mapTokensIndexInsertedType::iterator it = mapTokensIndexInserted.find(txhash);
+
+    if (it != mapTokensIndexInserted.end()) {
+        std::vector<std::pair<CTokensIndexKey, bool> > keys = (*it).second;
+        for (std::vector<std::pair<CTokensIndexKey, bool> >::iterator mit = keys.begin(); mit != keys.end(); mit++) {
+            if ((*mit).second)
+                mapTokensSpent.erase((*mit).first);
+            else
+                mapTokensIndex.erase((*mit).first);
+        }
+        mapTokensIndexInserted.erase(it);
+    }
+
+    return true;
+}
+
 void CTxMemPool::remove(const CTransaction &origTx, std::list<CTransaction>& removed, bool fRecursive)
 {
     // Remove transaction from memory pool
@@ -542,6 +658,7 @@ void CTxMemPool::remove(const CTransaction &origTx, std::list<CTransaction>& rem
             removeAddressIndex(hash);
             removeSpentIndex(hash);
             removeUnspentCCIndex(txCopy);  // erase cc index entry if present
+            removeTokensIndex(hash);
         }
     }
 }
@@ -31,6 +31,7 @@
 #include "sync.h"
 
 #include "unspentccindex.h"
+#include "tokensindex.h"
 
 #undef foreach
 #include "boost/multi_index_container.hpp"
@@ -183,6 +184,9 @@ private:
     typedef std::map<uint256, std::vector<CMempoolAddressDeltaKey> > addressDeltaMapInserted;
     addressDeltaMapInserted mapAddressInserted;
 
+    // output entries of mapAddress that no mempool tx spends, so unspent lookups skip spent chains
+    addressDeltaMap mapAddressUnspent;
+
     typedef std::map<CSpentIndexKey, CSpentIndexValue, CSpentIndexKeyCompare> mapSpentIndex;
     mapSpentIndex mapSpent;
 
@@ -195,6 +199,14 @@ private:
     typedef std::map<uint256, std::vector<CUnspentCCIndexKey> > mapUnspentCCIndexInsertedType;
     mapUnspentCCIndexInsertedType mapUnspentCCIndexInserted;
 
+    // token outputs created by mempool txns and token outputs (confirmed or in mempool) spent by mempool txns
+    typedef std::map<CTokensIndexKey, CTokensIndexValue, CTokensIndexKeyCompare> mapTokensIndexType;
+    mapTokensIndexType mapTokensIndex;
+    mapTokensIndexType mapTokensSpent;
+
+    typedef std::map<uint256, std::vector<std::pair<CTokensIndexKey, bool> > > mapTokensIndexInsertedType;
+    mapTokensIndexInsertedType mapTokensIndexInserted;
+
 public:
     std::map<COutPoint, CInPoint> mapNextTx;
     std::map<uint256, std::pair<double, CAmount> > mapDeltas;
@@ -215,6 +227,8 @@ public:
     void addAddressIndex(const CTxMemPoolEntry &entry, const CCoinsViewCache &view);
     bool getAddressIndex(std::vector<std::pair<uint160, int> > &addresses,
                          std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> > &results);
+    bool getAddressUnspent(std::vector<std::pair<uint160, int> > &addresses,
+                           std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> > &results);
     bool removeAddressIndex(const uint256 txhash);
 
     void addSpentIndex(const CTxMemPoolEntry &entry, const CCoinsViewCache &view);
@@ -226,6 +240,12 @@ public:
     bool getUnspentCCIndex(const std::vector<std::pair<uint160, uint256> > &keys, std::vector<std::pair<CUnspentCCIndexKey, CUnspentCCIndexValue> > &outputs);
     bool removeUnspentCCIndex(const CTransaction &tx);
 
+    // tokens index support:
+    void addTokensIndex(const CTxMemPoolEntry &entry, const CCoinsViewCache &view);
+    bool getTokensIndex(uint256 tokenid, uint160 addressHash, std::vector<std::pair<CTokensIndexKey, CTokensIndexValue> > &outputs,
+                        std::vector<CTokensIndexKey> &spent);
+    bool removeTokensIndex(const uint256 txhash);
+
     void remove(const CTransaction &tx, std::list<CTransaction>& removed, bool fRecursive = false);
     void removeWithAnchor(const uint256 &invalidRoot, ShieldedType type);
     void removeForReorg(const CCoinsViewCache *pcoins, unsigned int nMemPoolHeight, int flags);
@@ -1016,6 +1016,7 @@ extern int32_t KOMODO_NSPV,KOMODO_DEX_P2P;
 #endif // !KOMODO_NSPV_SUPERLITE
 uint256 zeroid;
 UniValue NSPV_getinfo_req(int32_t reqht);
+UniValue NSPV_respcache_stats();
 UniValue NSPV_login(char *wifstr);
 UniValue NSPV_logout();
 UniValue NSPV_addresstxids(char *coinaddr,int32_t CCflag,int32_t skipcount,int32_t filter);
@@ -1027,11 +1028,14 @@ UniValue NSPV_spentinfo(uint256 txid,int32_t vout);
 UniValue NSPV_notarizations(int32_t height);
 UniValue NSPV_hdrsproof(int32_t prevheight,int32_t nextheight);
 UniValue NSPV_txproof(int32_t vout,uint256 txid,int32_t height);
+UniValue NSPV_batch(std::string method,UniValue items,int32_t CCflag);
 UniValue NSPV_ccmoduleutxos(char *coinaddr, int64_t amount, uint8_t evalcode, std::string funcids, uint256 filtertxid);
 
 UniValue komodo_DEXbroadcast(uint64_t *locatorp,uint8_t funcid,char *hexstr,int32_t priority,char *tagA,char *tagB,char *destpub33,char *volA,char *volB);
 UniValue komodo_DEXlist(uint32_t stopat,int32_t minpriority,char *tagA,char *tagB,char *destpub33,char *minA,char *maxA,char *minB,char *maxB,char *stophashstr);
 UniValue komodo_DEXorderbook(int32_t revflag,int32_t maxentries,int32_t minpriority,char *tagA,char *tagB,char *destpub33,char *minA,char *maxA,char *minB,char *maxB);
+UniValue komodo_DEXorderbookchanges(int32_t revflag,uint32_t sinceid,char *tagA,char *tagB);
+uint32_t komodo_DEX_booklistid();
 UniValue komodo_DEXget(uint32_t shorthash);
 UniValue komodo_DEXpublish(char *fname,int32_t priority,int32_t sliceid);
 UniValue komodo_DEXsubscribe(int32_t &cmpflag,char *fname,int32_t priority,uint32_t shorthash,char *publisher,int32_t sliceid);
@@ -1170,6 +1174,7 @@ UniValue DEX_orderbook(const UniValue& params, bool fHelp, const CPubKey& mypk)
         minpriority = atol((char *)params[1].get_str().c_str());
     if ( params.size() > 0 )
         maxentries = atol((char *)params[0].get_str().c_str());
+    result.push_back(Pair((char *)"listid",(int64_t)komodo_DEX_booklistid()));
     result.push_back(Pair((char *)"asks",komodo_DEXorderbook(0,maxentries,minpriority,tagA,tagB,destpub33,minA,maxA,minB,maxB)));
     result.push_back(Pair((char *)"bids",komodo_DEXorderbook(1,maxentries,minpriority,tagB,tagA,destpub33,minB,maxB,minA,maxA)));
     result.push_back(Pair((char *)"base",tagA));
@@ -1177,6 +1182,24 @@ UniValue DEX_orderbook(const UniValue& params, bool fHelp, const CPubKey& mypk)
     return(result);
 }
 
+UniValue DEX_orderbookchanges(const UniValue& params, bool fHelp, const CPubKey& mypk)
+{
+    UniValue result(UniValue::VOBJ); uint32_t sinceid=0; char *tagA=(char *)"",*tagB=(char *)"";
+    if ( fHelp || params.size() != 3 )
+        throw runtime_error("DEX_orderbookchanges listid tagA tagB\n");
+    if ( KOMODO_DEX_P2P == 0 )
+        throw runtime_error("only -dexp2p nodes have DEX_orderbookchanges\n");
+    sinceid = (uint32_t)atol((char *)params[0].get_str().c_str());
+    tagA = (char *)params[1].get_str().c_str();
+    tagB = (char *)params[2].get_str().c_str();
+    result.push_back(Pair((char *)"listid",(int64_t)komodo_DEX_booklistid()));
+    result.push_back(Pair((char *)"asks",komodo_DEXorderbookchanges(0,sinceid,tagA,tagB)));
+    result.push_back(Pair((char *)"bids",komodo_DEXorderbookchanges(1,sinceid,tagB,tagA)));
+    result.push_back(Pair((char *)"base",tagA));
+    result.push_back(Pair((char *)"rel",tagB));
+    return(result);
+}
+
 UniValue DEX_cancel(const UniValue& params, bool fHelp, const CPubKey& mypk)
 {
     uint32_t shorthash=0; char *tagA=(char *)"",*tagB=(char *)"",*pubkeystr=(char *)"";
@@ -1307,6 +1330,15 @@ UniValue nspv_getinfo(const UniValue& params, bool fHelp, const CPubKey& mypk)
     return(NSPV_getinfo_req(reqht));
 }
 
+UniValue nspv_cacheinfo(const UniValue& params, bool fHelp, const CPubKey& mypk)
+{
+    if ( fHelp || params.size() != 0 )
+        throw runtime_error("nspv_cacheinfo\nhit/miss counters of the nSPV server response cache, sized with -nspvcache=MB (0 disables)\n");
+    if ( KOMODO_NSPV_SUPERLITE )
+        throw runtime_error("nspv_cacheinfo is only available on nSPV full nodes\n");
+    return(NSPV_respcache_stats());
+}
+
 UniValue nspv_logout(const UniValue& params, bool fHelp, const CPubKey& mypk)
 {
     if ( fHelp || params.size() != 0 )
@@ -1442,6 +1474,22 @@ UniValue nspv_txproof(const UniValue& params, bool fHelp, const CPubKey& mypk)
     return(NSPV_txproof(0,txid,height));
 }
 
+UniValue nspv_batch(const UniValue& params, bool fHelp, const CPubKey& mypk)
+{
+    UniValue items; int32_t CCflag = 0;
+    if ( fHelp || params.size() < 2 || params.size() > 3 )
+        throw runtime_error("nspv_batch listunspent|listtransactions|txproof|spentinfo items [isCC]\nitems is a json array of addresses, or of {\"txid\",\"vout\",\"height\"} objects for txproof and spentinfo\n");
+    if ( KOMODO_NSPV_FULLNODE )
+        throw runtime_error("-nSPV=1 must be set to use nspv\n");
+    if ( params[1].isArray() )
+        items = params[1];
+    else if ( items.read(params[1].get_str()) == false || items.isArray() == false )
+        throw runtime_error("items must be a json array\n");
+    if ( params.size() == 3 )
+        CCflag = atol((char *)params[2].get_str().c_str());
+    return(NSPV_batch(params[0].get_str(),items,CCflag));
+}
+
 UniValue nspv_spend(const UniValue& params, bool fHelp, const CPubKey& mypk)
 {
     uint64_t satoshis;